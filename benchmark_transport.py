@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Compares the calls per second of the MCP server over HTTP POST and over the WebSocket endpoint.
+
+Usage: python3 benchmark_transport.py [--calls 100] [--tool system_status] [--in-flight 1] [--json] <host>
+
+Each transport sends the same tools/call request: HTTP with one kept-alive connection (and, for comparison, a new
+connection per call), the WebSocket with up to --in-flight requests outstanding on one connection. Only the Python
+standard library is used.
+"""
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import struct
+import sys
+import time
+
+
+def request(call_id, tool):
+    return json.dumps({"jsonrpc": "2.0", "id": call_id, "method": "tools/call",
+                       "params": {"name": tool, "arguments": {}}}).encode()
+
+
+class WebSocket:
+    """Minimal RFC 6455 client: text messages, fragment reassembly, answers pings"""
+
+    def __init__(self, host, port, path):
+        self.sock = socket.create_connection((host, port), timeout=30)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           f"Sec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n").encode())
+        self.buffer = b""
+        while b"\r\n\r\n" not in self.buffer:
+            self.buffer += self.receive()
+        header, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        if not header.startswith(b"HTTP/1.1 101"):
+            raise RuntimeError("WebSocket upgrade failed: " + header.split(b"\r\n")[0].decode())
+
+    def receive(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise RuntimeError("Connection closed")
+        return data
+
+    def read(self, length):
+        while len(self.buffer) < length:
+            self.buffer += self.receive()
+        data, self.buffer = self.buffer[:length], self.buffer[length:]
+        return data
+
+    def send_frame(self, opcode, payload):
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        elif len(payload) <= 0xffff:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        else:
+            header += bytes([0x80 | 127]) + struct.pack(">Q", len(payload))
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def send(self, text):
+        self.send_frame(0x1, text)
+
+    def receive_message(self):
+        message = b""
+        while True:
+            first, second = self.read(2)
+            length = second & 0x7f
+            if length == 126:
+                length = struct.unpack(">H", self.read(2))[0]
+            elif length == 127:
+                length = struct.unpack(">Q", self.read(8))[0]
+            payload = self.read(length)
+            opcode = first & 0x0f
+            if opcode == 0x9:
+                self.send_frame(0xa, payload)
+            elif opcode == 0x8:
+                raise RuntimeError("Connection closed by the server")
+            elif opcode in (0x0, 0x1, 0x2):
+                message += payload
+                if first & 0x80:
+                    return message
+
+    def close(self):
+        self.send_frame(0x8, struct.pack(">H", 1000))
+        self.sock.close()
+
+
+def check(reply):
+    response = json.loads(reply)
+    if "error" in response:
+        raise RuntimeError("Error response: " + json.dumps(response["error"]))
+    return response
+
+
+def benchmark_http(host, port, calls, tool, keep_alive):
+    connection = None
+    start = time.perf_counter()
+    for call_id in range(calls):
+        if connection is None:
+            connection = http.client.HTTPConnection(host, port, timeout=30)
+        connection.request("POST", "/", body=request(call_id, tool),
+                           headers={"Content-Type": "application/json",
+                                    "Connection": "keep-alive" if keep_alive else "close"})
+        check(connection.getresponse().read())
+        if not keep_alive:
+            connection.close()
+            connection = None
+    elapsed = time.perf_counter() - start
+    if connection:
+        connection.close()
+    return elapsed
+
+
+def benchmark_websocket(host, port, calls, tool, in_flight):
+    ws = WebSocket(host, port, "/ws")
+    sent = received = 0
+    start = time.perf_counter()
+    while received < calls:
+        while sent < calls and sent - received < in_flight:
+            ws.send(request(sent, tool))
+            sent += 1
+        check(ws.receive_message())
+        received += 1
+    elapsed = time.perf_counter() - start
+    ws.close()
+    return elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Calls per second over HTTP POST and WebSocket")
+    parser.add_argument("host", help="Host name or IP address of the ESP32-CAM")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--calls", type=int, default=100, help="Calls per transport")
+    parser.add_argument("--tool", default="system_status", help="Tool to call (without arguments)")
+    parser.add_argument("--in-flight", type=int, default=1, help="Outstanding WebSocket requests")
+    parser.add_argument("--json", action="store_true", help="Print the results as JSON")
+    args = parser.parse_args()
+
+    runs = [
+        ("http_keep_alive", lambda: benchmark_http(args.host, args.port, args.calls, args.tool, True)),
+        ("http_new_connection", lambda: benchmark_http(args.host, args.port, args.calls, args.tool, False)),
+        ("websocket", lambda: benchmark_websocket(args.host, args.port, args.calls, args.tool, args.in_flight)),
+    ]
+
+    results = []
+    for name, run in runs:
+        try:
+            elapsed = run()
+        except (OSError, RuntimeError) as error:
+            print(f"{name}: {error}", file=sys.stderr)
+            continue
+        results.append({"transport": name, "tool": args.tool, "calls": args.calls,
+                        "in_flight": args.in_flight if name == "websocket" else 1,
+                        "seconds": round(elapsed, 3), "calls_per_second": round(args.calls / elapsed, 1)})
+
+    if args.json:
+        print(json.dumps({"benchmarks": results}, indent=2))
+    else:
+        for result in results:
+            print(f"{result['transport']:<20} {result['calls_per_second']:>8} calls/s "
+                  f"({result['calls']} calls in {result['seconds']} s)")
+
+    return 0 if len(results) == len(runs) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,6 +2,18 @@
 
 #include <esp_camera.h>
 
+// Number of frame buffers. The grab task (CAMERA_GRAB_TASK) keeps the latest frame, so it needs at least two
+#ifndef CAMERA_FB_COUNT
+#ifdef CAMERA_GRAB_TASK
+#define CAMERA_FB_COUNT 2
+#else
+#define CAMERA_FB_COUNT 1
+#endif
+#endif
+
+// With multiple frame buffers, always hand out the latest frame
+#define CAMERA_GRAB_MODE (CAMERA_FB_COUNT > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY)
+
 constexpr camera_config_t esp32cam_settings = {
     .pin_pwdn = -1,
     .pin_reset = 15,
@@ -25,8 +37,9 @@ constexpr camera_config_t esp32cam_settings = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_VGA,
     .jpeg_quality = 20,
-    .fb_count = 1,
-    .fb_location = CAMERA_FB_IN_PSRAM // Use PSRAM for frame buffer
+    .fb_count = CAMERA_FB_COUNT,
+    .fb_location = CAMERA_FB_IN_PSRAM, // Use PSRAM for frame buffer
+    .grab_mode = CAMERA_GRAB_MODE
 };
 
 constexpr camera_config_t esp32cam_aithinker_settings = {
@@ -52,8 +65,9 @@ constexpr camera_config_t esp32cam_aithinker_settings = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_VGA,
     .jpeg_quality = 20,
-    .fb_count = 1,
-    .fb_location = CAMERA_FB_IN_PSRAM // Use PSRAM for frame buffer
+    .fb_count = CAMERA_FB_COUNT,
+    .fb_location = CAMERA_FB_IN_PSRAM, // Use PSRAM for frame buffer
+    .grab_mode = CAMERA_GRAB_MODE
 };
 
 constexpr camera_config_t esp32cam_ttgo_t_settings = {
@@ -79,8 +93,9 @@ constexpr camera_config_t esp32cam_ttgo_t_settings = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_VGA,
     .jpeg_quality = 20,
-    .fb_count = 1,
-    .fb_location = CAMERA_FB_IN_PSRAM // Use PSRAM for frame buffer
+    .fb_count = CAMERA_FB_COUNT,
+    .fb_location = CAMERA_FB_IN_PSRAM, // Use PSRAM for frame buffer
+    .grab_mode = CAMERA_GRAB_MODE
 };
 
 constexpr camera_config_t esp32cam_m5stack_settings = {
@@ -106,8 +121,9 @@ constexpr camera_config_t esp32cam_m5stack_settings = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_VGA,
     .jpeg_quality = 20,
-    .fb_count = 1,
-    .fb_location = CAMERA_FB_IN_PSRAM // Use PSRAM for frame buffer
+    .fb_count = CAMERA_FB_COUNT,
+    .fb_location = CAMERA_FB_IN_PSRAM, // Use PSRAM for frame buffer
+    .grab_mode = CAMERA_GRAB_MODE
 };
 
 constexpr camera_config_t esp32cam_wrover_kit_settings = {
@@ -133,6 +149,7 @@ constexpr camera_config_t esp32cam_wrover_kit_settings = {
     .pixel_format = PIXFORMAT_JPEG,
     .frame_size = FRAMESIZE_VGA,
     .jpeg_quality = 20,
-    .fb_count = 1,
-    .fb_location = CAMERA_FB_IN_PSRAM // Use PSRAM for frame buffer
+    .fb_count = CAMERA_FB_COUNT,
+    .fb_location = CAMERA_FB_IN_PSRAM, // Use PSRAM for frame buffer
+    .grab_mode = CAMERA_GRAB_MODE
 };
\ No newline at end of file
@@ -0,0 +1,862 @@
+#include "camera_tools.h"
+
+#include <WiFi.h>
+#include <esp_timer.h>
+
+#include <base64_codec.h>
+#include <image.h>
+#include <metrics.h>
+
+// Memory for cropped/scaled captures shared by requests for the same frame (bytes; 0 disables the cache) and the time
+// a capture is reused (milliseconds). Only used with CAMERA_GRAB_TASK
+#ifndef CAPTURE_CACHE_SIZE
+#define CAPTURE_CACHE_SIZE 262144
+#endif
+#ifndef CAPTURE_CACHE_TTL
+#define CAPTURE_CACHE_TTL 1000
+#endif
+
+// Images captured with delivery "url" can be retrieved from /capture.jpg?token=... for this time
+constexpr auto CAPTURE_TOKEN_TTL = 30000UL; // 30 seconds
+constexpr auto CAPTURE_TOKEN_SLOTS = 2;
+
+constexpr auto CAPTURE_TIMEOUT = 5000UL; // 5 seconds
+// Frames skipped after switching on the flash
+constexpr uint8_t CAPTURE_FLASH_SKIP_FRAMES = 1;
+// Quality of cropped or scaled captures (0-100) when not specified
+constexpr auto CAPTURE_REENCODE_QUALITY = 80;
+
+// Captures with a hash distance up to this (of 64 bits) are considered unchanged (if_changed_since)
+constexpr auto CAPTURE_HASH_THRESHOLD = 4;
+// Number of delivered captures remembered to look up if_changed_since by sequence number
+constexpr auto CAPTURE_HASH_HISTORY = 8;
+
+// Maximal number of frames returned by the history tool
+constexpr auto HISTORY_MAX_COUNT = 5;
+
+// Upper limit of the frames per recording segment (the index of a segment is kept in PSRAM: 8 bytes per frame)
+constexpr auto RECORDING_MAX_SEGMENT_FRAMES = 9000;
+
+// Frame sizes of the capture tool
+constexpr const char *frame_size_names[] = {"QQVGA", "QVGA", "CIF", "HVGA", "VGA", "SVGA", "XGA", "HD", "SXGA", "UXGA", nullptr};
+constexpr framesize_t frame_size_values[] = {FRAMESIZE_QQVGA, FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_HVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA, FRAMESIZE_XGA, FRAMESIZE_HD, FRAMESIZE_SXGA, FRAMESIZE_UXGA};
+
+esp_err_t camera_init_result = ESP_OK;
+std::mutex camera_mutex;
+sensor_state camera_sensor;
+#ifdef CAMERA_GRAB_TASK
+frame_cache frames;
+capture_cache captures(CAPTURE_CACHE_SIZE, CAPTURE_CACHE_TTL);
+#else
+// Every request takes its own frame from the driver, so there is nothing to share
+capture_cache captures(0, CAPTURE_CACHE_TTL);
+#endif
+#ifdef MOTION_DETECTION
+motion_detector motion;
+#endif
+#ifdef FRAME_HISTORY
+frame_history history;
+#endif
+#ifdef RECORDING
+recorder video_recorder;
+#endif
+std::function<void(String &status_text)> system_status_details;
+
+// Temperature export (funny; has a typo!)
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    uint8_t temprature_sens_read();
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef CAMERA_GRAB_TASK
+// Sequence of the first frame of the grab task taken with the applied settings; guarded by camera_mutex
+static uint32_t settled_sequence = 0;
+#endif
+
+// Captured image waiting to be retrieved through /capture.jpg
+struct capture_slot
+{
+    String token;
+    unsigned long created = 0;
+    // Shared, so a response can send the image without holding capture_slots_mutex
+    std::shared_ptr<const uint8_t> data;
+    size_t length = 0;
+};
+
+static capture_slot capture_slots[CAPTURE_TOKEN_SLOTS];
+static std::mutex capture_slots_mutex;
+
+// Sequence number and hash of the last delivered captures
+struct delivered_capture
+{
+    uint32_t sequence;
+    uint64_t hash;
+};
+
+static delivered_capture delivered_captures[CAPTURE_HASH_HISTORY];
+static size_t delivered_captures_next = 0;
+static std::mutex delivered_captures_mutex;
+
+static void tool_led(JsonObject arguments, mcp_response &response)
+{
+    auto state = arguments["state"].as<String>();
+    if (state == "on")
+    {
+        digitalWrite(LED_GPIO, LED_ON_LEVEL);
+        auto result = response.create_result();
+        auto result_content = result["content"].to<JsonArray>();
+        auto result_content_item = result_content.add<JsonObject>();
+        result_content_item["type"] = "text";
+        result_content_item["text"] = "LED turned on";
+    }
+    else if (state == "off")
+    {
+        digitalWrite(LED_GPIO, LED_ON_LEVEL == LOW ? HIGH : LOW);
+        auto result = response.create_result();
+        auto result_content = result["content"].to<JsonArray>();
+        auto result_content_item = result_content.add<JsonObject>();
+        result_content_item["type"] = "text";
+        result_content_item["text"] = "LED turned off";
+    }
+    else
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::invalid_params;
+        error["message"] = "Invalid LED state. Use 'on' or 'off'.";
+    }
+}
+
+static void tool_flash(JsonObject arguments, mcp_response &response)
+{
+    auto duration = arguments["duration"].is<int>() ? arguments["duration"].as<int>() : 50; // Default to 50ms if not provided
+    digitalWrite(FLASH_GPIO, FLASH_ON_LEVEL);
+    delay(duration); // 5-100ms
+    digitalWrite(FLASH_GPIO, !FLASH_ON_LEVEL);
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = "Flash executed";
+}
+
+// Takes a frame exposed after now, skipping another skip frames (for example after a settings change).
+// The camera mutex must be held
+static frame_ptr fresh_frame(bool flash, uint8_t skip, unsigned long max_age)
+{
+    if (flash)
+    {
+        digitalWrite(FLASH_GPIO, FLASH_ON_LEVEL);
+        // The frame being exposed while switching on may not be lit
+        skip = std::max<uint8_t>(skip, CAPTURE_FLASH_SKIP_FRAMES);
+#ifndef CAMERA_GRAB_TASK
+        delay(20); // Allow flash to stabilize
+#endif
+    }
+
+#ifdef CAMERA_GRAB_TASK
+    auto image = frames.next(frames.sequence() + 1 + skip, CAPTURE_TIMEOUT);
+#else
+    // The frame in the buffer was exposed before now; it can only be used when nothing changed and it is recent enough
+    auto fb = esp_camera_fb_get();
+    if (fb && (skip > 0 || esp_timer_get_time() - (fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec) > max_age * 1000LL))
+    {
+        for (auto i = 0; fb && i < skip; i++)
+        {
+            esp_camera_fb_return(fb);
+            fb = esp_camera_fb_get();
+        }
+
+        if (fb)
+            esp_camera_fb_return(fb);
+
+        fb = esp_camera_fb_get();
+    }
+
+    auto image = fb ? std::make_shared<const frame>(fb) : nullptr;
+#endif
+
+    // Turn flash off immediately after capture attempt
+    if (flash)
+        digitalWrite(FLASH_GPIO, !FLASH_ON_LEVEL);
+
+    return image;
+}
+
+// Writes the settings that changed (camera_mutex held). Returns the number of frames to skip
+static uint8_t apply_settings(const sensor_settings &settings)
+{
+    auto skip = camera_sensor.apply(settings);
+#ifdef CAMERA_GRAB_TASK
+    if (skip > 0)
+        settled_sequence = frames.sequence() + 1 + skip;
+#endif
+    return skip;
+}
+
+frame_ptr capture_frame(bool flash, unsigned long max_age, const sensor_settings &settings)
+{
+    stage_timer timer(metric_stage::grab);
+    std::unique_lock<std::mutex> lock(camera_mutex);
+    auto skip = apply_settings(settings);
+#ifdef CAMERA_GRAB_TASK
+    if (!flash && skip == 0)
+    {
+        auto settled = settled_sequence;
+        lock.unlock();
+        auto image = frames.get(max_age, CAPTURE_TIMEOUT);
+        // The latest frame may still have the settings before the last change
+        return image && image->sequence < settled ? frames.next(settled, CAPTURE_TIMEOUT) : image;
+    }
+#endif
+
+    return fresh_frame(flash, skip, max_age);
+}
+
+// Frame source of the stream, motion detection, history and recording: the cached frame or a new frame from the driver,
+// always with the configured settings. Settings left by a capture with frame_size or quality are reverted here, so
+// consecutive captures with the same settings skip no frames while nothing else uses the camera
+frame_ptr stream_frame()
+{
+    // The sensor is shared with the captures of the requests, which change the settings under the same lock
+    std::unique_lock<std::mutex> lock(camera_mutex);
+    auto skip = apply_settings(camera_sensor.configured());
+#ifdef CAMERA_GRAB_TASK
+    (void)skip;
+    auto settled = settled_sequence;
+    lock.unlock();
+    // Until the reverted settings are in effect there is no frame (the consumers try again later)
+    auto image = frames.get(ULONG_MAX, 0);
+    return image && image->sequence >= settled ? image : nullptr;
+#else
+    auto fb = esp_camera_fb_get();
+    for (auto i = 0; fb && i < skip; i++)
+    {
+        esp_camera_fb_return(fb);
+        fb = esp_camera_fb_get();
+    }
+
+    return fb ? std::make_shared<const frame>(fb) : nullptr;
+#endif
+}
+
+// Keeps a copy of the image for /capture.jpg and returns the token to retrieve it. Returns an empty string on failure
+static String store_capture(const uint8_t *data, size_t length)
+{
+    // Use an expired slot or else the oldest one
+    std::lock_guard<std::mutex> lock(capture_slots_mutex);
+    auto now = millis();
+    auto slot = &capture_slots[0];
+    for (auto &candidate : capture_slots)
+    {
+        if (!candidate.data || now - candidate.created >= CAPTURE_TOKEN_TTL)
+        {
+            slot = &candidate;
+            break;
+        }
+
+        if (now - candidate.created > now - slot->created)
+            slot = &candidate;
+    }
+
+    // A response still sending the previous image keeps it
+    slot->data.reset();
+    auto copy = static_cast<uint8_t *>(ps_malloc(length));
+    if (!copy)
+        return String();
+
+    memcpy(copy, data, length);
+    slot->data = std::shared_ptr<const uint8_t>(copy, free);
+    slot->length = length;
+    slot->created = now;
+    char token[17];
+    snprintf(token, sizeof(token), "%08x%08x", esp_random(), esp_random());
+    slot->token = token;
+    return slot->token;
+}
+
+std::shared_ptr<const uint8_t> find_capture(const String &token, size_t &length)
+{
+    // Only the lookup is locked: sending to a slow client must not block other captures
+    std::lock_guard<std::mutex> lock(capture_slots_mutex);
+    for (const auto &slot : capture_slots)
+    {
+        if (slot.data && slot.token == token && millis() - slot.created < CAPTURE_TOKEN_TTL)
+        {
+            length = slot.length;
+            return slot.data;
+        }
+    }
+
+    return nullptr;
+}
+
+static void remember_delivered(uint32_t sequence, uint64_t hash)
+{
+    std::lock_guard<std::mutex> lock(delivered_captures_mutex);
+    delivered_captures[delivered_captures_next++ % CAPTURE_HASH_HISTORY] = {sequence, hash};
+}
+
+// Hash of a delivered capture. Returns false if not (or no longer) known
+static bool find_delivered(uint32_t sequence, uint64_t &hash)
+{
+    std::lock_guard<std::mutex> lock(delivered_captures_mutex);
+    for (const auto &delivered : delivered_captures)
+        if (delivered.sequence == sequence && sequence != 0)
+        {
+            hash = delivered.hash;
+            return true;
+        }
+
+    return false;
+}
+
+// Parses if_changed_since: a 16 digit hexadecimal frame hash or the decimal sequence number of a delivered capture
+static bool parse_changed_since(const char *value, uint64_t &hash)
+{
+    char *end;
+    if (strlen(value) == 16)
+    {
+        hash = strtoull(value, &end, 16);
+        return *end == '\0';
+    }
+
+    auto sequence = strtoul(value, &end, 10);
+    return *value != '\0' && *end == '\0' && find_delivered(sequence, hash);
+}
+
+static void tool_capture(JsonObject arguments, mcp_response &response)
+{
+    if (camera_init_result != ESP_OK)
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::internal_error;
+        error["message"] = "Camera not initialized or failed to initialize";
+        return;
+    }
+
+    auto delivery = arguments["delivery"].is<String>() ? arguments["delivery"].as<String>() : String("inline");
+
+    // Settings that are not specified return to the configured settings
+    auto settings = camera_sensor.configured();
+    if (arguments["frame_size"].is<const char *>())
+    {
+        for (auto i = 0; frame_size_names[i]; i++)
+            if (strcmp(arguments["frame_size"].as<const char *>(), frame_size_names[i]) == 0)
+                settings.frame_size = frame_size_values[i];
+
+        // The frame buffers are allocated for the configured frame size
+        if (resolution[settings.frame_size].width > resolution[camera_sensor.configured().frame_size].width)
+        {
+            auto error = response.create_error();
+            error["code"] = error_code::invalid_params;
+            error["message"] = "Frame size is larger than the configured frame size";
+            return;
+        }
+    }
+
+    auto scale = arguments["scale"].is<int>() ? arguments["scale"].as<int>() : 1;
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::invalid_params;
+        error["message"] = "Invalid scale. Use 1, 2, 4 or 8.";
+        return;
+    }
+
+    auto crop = arguments["crop"].as<JsonObject>();
+    // Cropping and scaling decode and re-encode the image; the quality is then used for encoding
+    auto reencode = scale > 1 || !crop.isNull();
+    auto quality = arguments["quality"].is<int>() ? arguments["quality"].as<int>() : -1;
+    if (quality >= 0 && !reencode)
+        settings.quality = 63 - quality * 53 / 100; // 100 -> 10 (best usable sensor quality), 0 -> 63
+
+    auto max_age = arguments["max_age"].is<unsigned long>() ? arguments["max_age"].as<unsigned long>() : CAPTURE_MAX_AGE;
+    auto image = capture_frame(arguments["flash"].as<String>() == "on", max_age, settings);
+    if (!image)
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::internal_error;
+        error["message"] = "Camera capture failed";
+        return;
+    }
+
+    // The JPEG to deliver: the frame buffer (shared through the grab task) or the processed image, which requests for the
+    // same frame and parameters share with its hash and encoding
+    auto inline_delivery = delivery != "url";
+    auto sequence = image->sequence;
+    std::shared_ptr<const void> owner = image;
+    const uint8_t *data = image->fb->buf;
+    size_t length = image->fb->len;
+    uint16_t width = image->fb->width;
+    uint16_t height = image->fb->height;
+    cached_capture_ptr capture;
+    auto cached = false;
+    if (reencode)
+    {
+        image_rect region = {0, 0, width, height};
+        if (!crop.isNull())
+            region = {crop["x"] | uint16_t(0), crop["y"] | uint16_t(0), crop["width"] | width, crop["height"] | height};
+
+        char key[64];
+        snprintf(key, sizeof(key), "%s %d %d %u,%u,%u,%u", inline_delivery ? "base64" : "jpeg", scale, quality, region.x, region.y, region.width, region.height);
+        auto make_capture = [&]() -> std::shared_ptr<cached_capture>
+        {
+            auto made = std::make_shared<cached_capture>();
+            // Downscaling is done in the DCT domain while decoding
+            made->image = crop_jpeg(data, length, width, height, region, static_cast<jpg_scale_t>(__builtin_ctz(scale)), quality >= 0 ? quality : CAPTURE_REENCODE_QUALITY, sequence);
+            if (!made->image)
+                return nullptr;
+
+            made->encode = inline_delivery;
+            return made;
+        };
+
+        capture = captures.get(sequence, key, make_capture, cached);
+        // The frame buffer can be returned to the driver
+        image.reset();
+        owner = capture;
+        if (!capture)
+        {
+            auto error = response.create_error();
+            error["code"] = error_code::internal_error;
+            error["message"] = "Unable to crop or scale the image (empty region or out of memory)";
+            return;
+        }
+
+        if (cached)
+            log_d("Capture of frame %u served from the cache", static_cast<unsigned>(sequence));
+
+        data = capture->image->data;
+        length = capture->image->length;
+        width = capture->image->width;
+        height = capture->image->height;
+    }
+
+    // The frame hash decodes the image, so it is only computed for if_changed_since (and shared through the cache)
+    auto changed_since = arguments["if_changed_since"].is<const char *>();
+    uint64_t hash = 0;
+    auto hashed = false;
+    if (changed_since)
+        hashed = capture ? capture->hash(hash) : average_hash(data, length, width, height, hash);
+
+    auto dimensions = String(width) + "x" + String(height);
+    char hash_text[17];
+    snprintf(hash_text, sizeof(hash_text), "%016llx", static_cast<unsigned long long>(hash));
+    auto metadata = changed_since ? "Frame hash: " + String(hashed ? hash_text : "unavailable") + ", sequence: " + String(sequence) : "Sequence: " + String(sequence);
+
+    if (hashed)
+    {
+        uint64_t previous_hash = 0;
+        // An unknown sequence number counts as changed
+        if (parse_changed_since(arguments["if_changed_since"].as<const char *>(), previous_hash) && hash_distance(hash, previous_hash) <= CAPTURE_HASH_THRESHOLD)
+        {
+            auto result = response.create_result();
+            auto result_content = result["content"].to<JsonArray>();
+            auto result_content_item = result_content.add<JsonObject>();
+            result_content_item["type"] = "text";
+            result_content_item["text"] = "Not modified. " + metadata + " (" + dimensions + ", distance " + String(hash_distance(hash, previous_hash)) + ")";
+            return;
+        }
+
+        remember_delivered(sequence, hash);
+    }
+
+    if (delivery == "url")
+    {
+        // Keep a copy of the JPEG for the time the token is valid, so the frame buffer can be returned to the driver
+        auto token = store_capture(data, length);
+        image.reset();
+        owner.reset();
+        if (token.isEmpty())
+        {
+            auto error = response.create_error();
+            error["code"] = error_code::internal_error;
+            error["message"] = "Not enough memory to store the image";
+            return;
+        }
+
+        auto uri = "http://" + WiFi.localIP().toString() + "/capture.jpg?token=" + token;
+        auto result = response.create_result();
+        auto result_content = result["content"].to<JsonArray>();
+        auto result_content_item = result_content.add<JsonObject>();
+        result_content_item["type"] = "text";
+        result_content_item["text"] = "Image captured successfully. Size: " + String(length) + " bytes (image/jpeg, " + dimensions + "). " + metadata + ". Available for " + String(CAPTURE_TOKEN_TTL / 1000) + " seconds at: " + uri;
+        return;
+    }
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = "Image captured successfully. Size: " + String(base64_encoded_length(length)) + " bytes (base64 encoded, " + dimensions + "). " + metadata;
+
+    auto result_content_image_item = result_content.add<JsonObject>();
+    result_content_image_item["type"] = "image";
+    // The image is sent with the response and released afterwards. The request making a capture encodes it while
+    // sending; requests sharing it use the kept encoding
+    image.reset();
+    auto encoded = cached ? capture->base64() : nullptr;
+    if (encoded)
+        response.attach_base64(result_content_image_item, "data", data, length, encoded, [owner]() mutable
+                               { owner.reset(); });
+    else
+        response.attach_base64(result_content_image_item, "data", data, length, [owner]() mutable
+                               { owner.reset(); });
+    result_content_image_item["mimeType"] = "image/jpeg";
+}
+
+static void tool_wifi_status(JsonObject arguments, mcp_response &response)
+{
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+
+    auto status_text = String();
+    status_text += "IP Address: " + WiFi.localIP().toString() + "\n";
+    status_text += "Signal Strength: " + String(WiFi.RSSI()) + " dBm\n";
+    status_text += "MAC Address: " + WiFi.macAddress() + "\n";
+    status_text += "Gateway: " + WiFi.gatewayIP().toString() + "\n";
+    status_text += "DNS: " + WiFi.dnsIP().toString() + "\n";
+    result_content_item["text"] = status_text;
+}
+
+#ifdef MOTION_DETECTION
+static void tool_motion_status(JsonObject arguments, mcp_response &response)
+{
+    auto status = motion.status();
+    auto now = millis();
+    auto status_text = String("Motion Status:\n");
+    status_text += "Motion: " + String(status.motion ? "Yes" : "No") + "\n";
+    status_text += "Changed Blocks: " + String(status.changed_blocks) + " of " + String(status.blocks) + "\n";
+    status_text += "Analysis Resolution: " + String(status.width) + "x" + String(status.height) + "\n";
+    status_text += "Frames Analysed: " + String(status.frames) + "\n";
+    status_text += "Frame Sequence: " + String(status.sequence) + "\n";
+    status_text += "Last Motion: " + (status.last_motion ? String((now - status.last_motion) / 1000.0, 1) + " seconds ago" : String("never")) + "\n";
+    status_text += "Last Event: " + String(status.last_event) + "\n";
+
+    // Events after the since cursor; pass the last event id to receive only new events
+    for (const auto &event : motion.events(arguments["since"] | 0U))
+    {
+        status_text += "Event " + String(event.id) + ": started " + String((now - event.start) / 1000.0, 1) + " seconds ago";
+        if (event.end)
+            status_text += ", lasted " + String((event.end - event.start) / 1000.0, 1) + " seconds";
+        else
+            status_text += ", in progress";
+
+        status_text += ", peak " + String(event.peak_blocks) + " blocks, frame " + String(event.sequence) + "\n";
+    }
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = status_text;
+}
+#endif
+
+#ifdef FRAME_HISTORY
+static void tool_history(JsonObject arguments, mcp_response &response)
+{
+    auto now = millis();
+    // Without a point in time only the state of the history is returned
+    auto timestamp = 0UL;
+    auto at_time = true;
+    if (arguments["event"].is<uint32_t>())
+    {
+#ifdef MOTION_DETECTION
+        auto id = arguments["event"].as<uint32_t>();
+        auto events = motion.events(id - 1);
+        if (events.empty() || events.front().id != id)
+        {
+            auto error = response.create_error();
+            error["code"] = error_code::invalid_params;
+            error["message"] = "Unknown motion event: " + String(id);
+            return;
+        }
+
+        // Frames around the start of the event, including the frames before it was detected
+        timestamp = events.front().start;
+#else
+        auto error = response.create_error();
+        error["code"] = error_code::invalid_params;
+        error["message"] = "Motion detection is not enabled";
+        return;
+#endif
+    }
+    else if (arguments["seconds_ago"].is<float>())
+        timestamp = now - static_cast<unsigned long>(arguments["seconds_ago"].as<float>() * 1000);
+    else
+        at_time = false;
+
+    auto status = history.status();
+    auto status_text = "Frames: " + String(status.frames) + ", " + String(status.bytes) + " of " + String(status.capacity) + " bytes";
+    if (status.frames)
+        status_text += ", from " + String((now - status.oldest) / 1000.0, 1) + " to " + String((now - status.newest) / 1000.0, 1) + " seconds ago";
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    if (!at_time)
+    {
+        result_content_item["text"] = status_text;
+        return;
+    }
+
+    auto frames = history.around(timestamp, arguments["count"] | 1);
+    if (frames.empty())
+    {
+        result_content_item["text"] = status_text + ". No frame available";
+        return;
+    }
+
+    result_content_item["text"] = status_text + ". Returning " + String(frames.size()) + " frame(s), oldest first";
+    for (const auto &frame : frames)
+    {
+        auto image = frame.image;
+        auto frame_text_item = result_content.add<JsonObject>();
+        frame_text_item["type"] = "text";
+        frame_text_item["text"] = "Frame " + String(image->sequence) + ": " + String((now - frame.timestamp) / 1000.0, 1) + " seconds ago, " + String(image->width) + "x" + String(image->height) + ", " + String(image->length) + " bytes";
+
+        auto frame_image_item = result_content.add<JsonObject>();
+        frame_image_item["type"] = "image";
+        response.attach_base64(frame_image_item, "data", image->data, image->length, [image]() mutable
+                               { image.reset(); });
+        frame_image_item["mimeType"] = "image/jpeg";
+    }
+}
+#endif
+
+#ifdef RECORDING
+static void tool_recording_start(JsonObject arguments, mcp_response &response)
+{
+    unsigned long interval = arguments["interval"] | 1000;
+    auto segment_frames = std::max(1UL, std::min<unsigned long>((arguments["segment_duration"] | 300) * 1000UL / interval, RECORDING_MAX_SEGMENT_FRAMES));
+    if (!video_recorder.start(interval, segment_frames))
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::internal_error;
+        error["message"] = video_recorder.running() ? "Already recording, or not enough memory" : "No file system for recordings";
+        return;
+    }
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = "Recording started: one frame every " + String(interval) + " ms, " + String(segment_frames) + " frames per file";
+}
+
+static void tool_recording_stop(JsonObject arguments, mcp_response &response)
+{
+    video_recorder.stop();
+    auto status = video_recorder.status();
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = "Recording stopped: " + String(status.frames) + " frames written, " + String(status.dropped) + " dropped, " + String(status.queued) + " still queued";
+}
+
+static void tool_recordings(JsonObject arguments, mcp_response &response)
+{
+    auto status = video_recorder.status();
+    auto status_text = String("Recording: ") + (status.recording ? "Yes" : "No") + "\n";
+    if (status.frames || status.recording)
+    {
+        status_text += "Current File: " + status.segment + "\n";
+        status_text += "Interval: " + String(status.interval) + " ms\n";
+        status_text += "Frames: " + String(status.frames) + " written (" + String(status.bytes) + " bytes, " + String(status.segments) + " files completed), " + String(status.dropped) + " dropped, " + String(status.queued) + " queued\n";
+        status_text += "Longest Write: " + String(status.max_write_time) + " ms\n";
+    }
+
+    for (const auto &file : video_recorder.list())
+        status_text += file.name + ": " + String(file.size) + " bytes\n";
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = status_text;
+}
+
+static void tool_recording_fetch(JsonObject arguments, mcp_response &response)
+{
+    auto name = arguments["name"].as<String>();
+    if (!video_recorder.open(name))
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::invalid_params;
+        error["message"] = "Unknown recording: " + name;
+        return;
+    }
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    auto uri = "http://" + WiFi.localIP().toString() + "/recording?name=" + name;
+    if (!arguments["seconds"].is<float>())
+    {
+        result_content_item["text"] = "Recording available at: " + uri;
+        return;
+    }
+
+    auto image = video_recorder.frame_at(name, arguments["seconds"].as<float>());
+    if (!image)
+    {
+        result_content_item["text"] = "No frame available (the recording may still be in progress). Recording available at: " + uri;
+        return;
+    }
+
+    result_content_item["text"] = "Frame " + String(image->sequence) + " of " + name + " (" + String(image->width) + "x" + String(image->height) + ", " + String(image->length) + " bytes)";
+    auto result_content_image_item = result_content.add<JsonObject>();
+    result_content_image_item["type"] = "image";
+    response.attach_base64(result_content_image_item, "data", image->data, image->length, [image]() mutable
+                           { image.reset(); });
+    result_content_image_item["mimeType"] = "image/jpeg";
+}
+#endif
+
+static void tool_metrics(JsonObject arguments, mcp_response &response)
+{
+    auto status_text = String("Stage: count, p50 / p95 / p99 / max (microseconds)\n");
+    for (size_t stage = 0; stage < metric_stage_count; stage++)
+    {
+        auto snapshot = metric_histogram(static_cast<metric_stage>(stage)).read();
+        status_text += String(metric_stage_name(static_cast<metric_stage>(stage))) + ": " + String(snapshot.count);
+        if (snapshot.count)
+            status_text += ", " + String(snapshot.percentile(50)) + " / " + String(snapshot.percentile(95)) + " / " + String(snapshot.percentile(99)) + " / " + String(snapshot.max);
+
+        status_text += "\n";
+    }
+
+    status_text += "Requests: " + String(metric_value(metric_counter::requests)) + "\n";
+    status_text += "Errors: " + String(metric_value(metric_counter::errors)) + "\n";
+    status_text += "Response Bytes: " + String(metric_value(metric_counter::response_bytes)) + "\n";
+
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+    result_content_item["text"] = status_text;
+}
+
+static void tool_system_status(JsonObject arguments, mcp_response &response)
+{
+    auto result = response.create_result();
+    auto result_content = result["content"].to<JsonArray>();
+    auto result_content_item = result_content.add<JsonObject>();
+    result_content_item["type"] = "text";
+
+    // Get the tem
+
+    auto status_text = String("System Status:\n");
+    status_text += "Uptime: " + String(millis() / 1000) + " seconds\n";
+    status_text += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
+    status_text += "Min Free Heap: " + String(ESP.getMinFreeHeap()) + " bytes\n";
+    status_text += "Max Alloc Heap: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
+    status_text += "CPU Frequency: " + String(getCpuFrequencyMhz()) + " MHz\n";
+    status_text += "Flash Size: " + String(ESP.getFlashChipSize()) + " bytes\n";
+    status_text += "Flash Speed: " + String(ESP.getFlashChipSpeed()) + " Hz\n";
+    status_text += "Sketch Size: " + String(ESP.getSketchSize()) + " bytes\n";
+    status_text += "Free Sketch Space: " + String(ESP.getFreeSketchSpace()) + " bytes\n";
+    status_text += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
+    status_text += "Reset Reason: " + String(esp_reset_reason()) + "\n";
+    status_text += "Camera initialized: " + String(camera_init_result == ESP_OK ? "Yes" : "No (code = 0x" + String(camera_init_result, 16) + ")") + "\n";
+    auto internal_temperature = (temprature_sens_read() - 32) / 1.8;
+    status_text += "Internal Temperature: " + String(internal_temperature, 2) + " °C\n";
+    if (system_status_details)
+        system_status_details(status_text);
+    auto cache = captures.status();
+    status_text += "Capture Cache: " + String(cache.entries) + " captures, " + String(cache.bytes) + " of " + String(CAPTURE_CACHE_SIZE) + " bytes (" + String(cache.hits) + " hits, " + String(cache.misses) + " misses)\n";
+    result_content_item["text"] = status_text;
+}
+
+constexpr const char *on_off_values[] = {"on", "off", nullptr};
+constexpr const char *delivery_values[] = {"inline", "url", nullptr};
+
+constexpr mcp_param led_params[] = {
+    mcp_string("state", "LED state", on_off_values, nullptr, true)};
+
+constexpr mcp_param flash_params[] = {
+    mcp_integer("duration", "Flash duration in milliseconds", 5, 100, 50)};
+
+constexpr mcp_param crop_params[] = {
+    mcp_integer("x", "Left edge", 0, UINT16_MAX, 0),
+    mcp_integer("y", "Top edge", 0, UINT16_MAX, 0),
+    mcp_integer("width", "Width", 1, UINT16_MAX, mcp_unset, true),
+    mcp_integer("height", "Height", 1, UINT16_MAX, mcp_unset, true)};
+
+constexpr mcp_param capture_params[] = {
+    mcp_string("flash", "Use flash when capturing", on_off_values),
+    mcp_string("delivery", "Return the image inline (base64) or as a short-lived URL to the binary JPEG", delivery_values, "inline"),
+    mcp_integer("max_age", "Maximum age in milliseconds of a cached frame (continuous capture mode only)", 0, mcp_unset, CAPTURE_MAX_AGE),
+    mcp_string("frame_size", "Sensor frame size for this capture (up to the configured frame size)", frame_size_names),
+    mcp_integer("quality", "JPEG quality (0-100, higher is better)", 0, 100),
+    mcp_object("crop", "Region to return, in pixels of the captured frame", crop_params),
+    mcp_integer("scale", "Downscale factor (1, 2, 4 or 8)", 1, 8, 1),
+    mcp_string("if_changed_since", "Frame hash or sequence number of an earlier capture; the image is only returned if the scene changed")};
+
+#ifdef FRAME_HISTORY
+constexpr mcp_param history_params[] = {
+    mcp_number("seconds_ago", "Return the frame(s) nearest to this many seconds ago", 0, mcp_unset),
+    mcp_integer("event", "Return the frame(s) around the start of this motion event (id)", 1, mcp_unset),
+    mcp_integer("count", "Number of frames around that point in time", 1, HISTORY_MAX_COUNT, 1)};
+#endif
+
+#ifdef RECORDING
+constexpr mcp_param recording_start_params[] = {
+    mcp_integer("interval", "Time between recorded frames in milliseconds", 100, 3600000, 1000),
+    mcp_integer("segment_duration", "Duration of a recording file in seconds", 10, 86400, 300)};
+constexpr mcp_param recording_fetch_params[] = {
+    mcp_string("name", "Name of the recording file", nullptr, nullptr, true),
+    mcp_number("seconds", "Return the frame at this time (seconds from the start of the file) instead of the download URL", 0, mcp_unset)};
+#endif
+
+#ifdef MOTION_DETECTION
+constexpr mcp_param motion_status_params[] = {
+    mcp_integer("since", "Only return events with a larger id (the last event id seen)", 0, mcp_unset, 0)};
+#endif
+
+// Sorted by name
+constexpr mcp_tool tools[] = {
+    mcp_define_tool("capture", "Captures a photo from the ESP32-CAM", tool_capture, capture_params),
+    mcp_define_tool("flash", "Controls the ESP32-CAM Flash", tool_flash, flash_params),
+#ifdef FRAME_HISTORY
+    mcp_define_tool("history", "Gets recent frames from the frame history, by time or around a motion event", tool_history, history_params),
+#endif
+    mcp_define_tool("led", "Controls the ESP32-CAM LED state", tool_led, led_params),
+    mcp_define_tool("metrics", "Gets latency percentiles of the request handling stages and request counters", tool_metrics),
+#ifdef MOTION_DETECTION
+    mcp_define_tool("motion_status", "Gets the motion detection state and the motion events after an event id", tool_motion_status, motion_status_params),
+#endif
+#ifdef RECORDING
+    mcp_define_tool("recording_fetch", "Gets the download URL of a recording, or the frame at a time in the recording", tool_recording_fetch, recording_fetch_params),
+    mcp_define_tool("recording_start", "Starts recording frames to segmented MJPEG AVI files (timelapse)", tool_recording_start, recording_start_params),
+    mcp_define_tool("recording_stop", "Stops the recording", tool_recording_stop),
+    mcp_define_tool("recordings", "Lists the recordings and the state of the recorder", tool_recordings),
+#endif
+    mcp_define_tool("system_status", "Gets comprehensive system status including memory, uptime, and hardware info", tool_system_status),
+    mcp_define_tool("wifi_status", "Gets current WiFi connection status and network information", tool_wifi_status)};
+
+static_assert(mcp_sorted(tools), "Tools must be sorted by name");
+
+constexpr mcp_tool_registry tool_registry(tools);
+
+// The tools list never changes at runtime: serialized (and deflated) once
+mcp_cached_result tools_list_result([](JsonObject result)
+                                    { tool_registry.build_list(result); });
+
+void handle_tools_call(const mcp_request &request, mcp_response &response)
+{
+    auto params = request.params();
+    // Arguments are validated against the tool declaration before the tool is called
+    tool_registry.call(params["name"] | "", params["arguments"].as<JsonObject>(), response);
+}
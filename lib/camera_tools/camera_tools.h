@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <capture_cache.h>
+#include <frame_cache.h>
+#include <mcp.h>
+#include <mcp_tools.h>
+#include <sensor_state.h>
+#ifdef MOTION_DETECTION
+#include <motion_detector.h>
+#endif
+#ifdef FRAME_HISTORY
+#include <frame_history.h>
+#endif
+#ifdef RECORDING
+#include <recorder.h>
+#endif
+
+// The MCP tools of the camera (the handlers, their declarations and the registry) and the capture path they share with
+// the HTTP endpoints of the firmware. The native environment builds the same code against the stubs in test/stubs.
+
+// Default maximum age of a cached frame returned by capture (grab task only)
+constexpr auto CAPTURE_MAX_AGE = 500UL; // 0.5 seconds
+
+// Result of camera initialization; the tools report an error unless ESP_OK
+extern esp_err_t camera_init_result;
+// Serializes direct access to the sensor and the flash (requests are handled concurrently)
+extern std::mutex camera_mutex;
+// Settings applied to the sensor; guarded by camera_mutex
+extern sensor_state camera_sensor;
+#ifdef CAMERA_GRAB_TASK
+// Latest frame of the continuous grab task
+extern frame_cache frames;
+#endif
+// Processed captures of recent frames, shared by concurrent requests
+extern capture_cache captures;
+#ifdef MOTION_DETECTION
+extern motion_detector motion;
+#endif
+#ifdef FRAME_HISTORY
+// Recent frames for looking back in time
+extern frame_history history;
+#endif
+#ifdef RECORDING
+extern recorder video_recorder;
+#endif
+
+// Lines the firmware adds to the system_status text (the state of the request path); optional
+extern std::function<void(String &status_text)> system_status_details;
+
+// Returns a frame with the settings, optionally using the flash. Settings that are already applied are not written again
+// and frames are only skipped when the settings changed. With the grab task, a cached frame not older than
+// max_age (ms) is returned if nothing changed. Returns nullptr on failure
+frame_ptr capture_frame(bool flash, unsigned long max_age, const sensor_settings &settings);
+// Frame source of the stream, motion detection, history and recording: the cached frame or a new frame from the driver,
+// always with the configured settings
+frame_ptr stream_frame();
+// Image of a capture with delivery "url" (for /capture.jpg?token=...). Returns nullptr if the token is unknown or expired
+std::shared_ptr<const uint8_t> find_capture(const String &token, size_t &length);
+
+// Tools sorted by name
+extern const mcp_tool_registry tool_registry;
+// The tools list never changes at runtime: serialized (and deflated) once
+extern mcp_cached_result tools_list_result;
+
+// tools/call: the arguments are validated against the tool declaration before the tool is called. Throws an
+// mcp_exception if the tool is unknown or the arguments are invalid
+void handle_tools_call(const mcp_request &request, mcp_response &response);
@@ -0,0 +1,134 @@
+#include "capture_cache.h"
+
+#include <base64_codec.h>
+#include <metrics.h>
+
+cached_capture::~cached_capture()
+{
+    free(base64_);
+}
+
+const char *cached_capture::base64() const
+{
+    std::call_once(encoded_, [this]()
+                   {
+                       auto encoded = static_cast<char *>(ps_malloc(base64_encoded_length(image->length)));
+                       if (!encoded)
+                           return;
+
+                       stage_timer timer(metric_stage::encode);
+                       base64_encode(image->data, image->length, encoded);
+                       base64_ = encoded; });
+    return base64_;
+}
+
+bool cached_capture::hash(uint64_t &hash) const
+{
+    std::call_once(hashed_once_, [this]()
+                   { hashed_ = average_hash(image->data, image->length, image->width, image->height, hash_); });
+    hash = hash_;
+    return hashed_;
+}
+
+size_t cached_capture::size() const
+{
+    return image->length + (encode ? base64_encoded_length(image->length) : 0);
+}
+
+capture_cache::capture_cache(size_t max_bytes, unsigned long ttl)
+    : max_bytes_(max_bytes), ttl_(ttl)
+{
+}
+
+std::vector<capture_cache::entry>::iterator capture_cache::find(uint32_t sequence, const String &key)
+{
+    for (auto it = entries_.begin(); it != entries_.end(); ++it)
+        if (it->sequence == sequence && it->key == key)
+            return it;
+
+    return entries_.end();
+}
+
+void capture_cache::evict(uint32_t sequence, size_t length)
+{
+    auto now = millis();
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+        // Captures being made are never evicted
+        if (it->capture && (expired(*it, now) || it->sequence < sequence || bytes_ + length > max_bytes_))
+        {
+            bytes_ -= it->capture->size();
+            it = entries_.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+cached_capture_ptr capture_cache::get(uint32_t sequence, const String &key, producer produce, bool &hit)
+{
+    hit = false;
+    if (max_bytes_ == 0)
+        return produce();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        auto it = find(sequence, key);
+        if (it == entries_.end())
+            break;
+
+        if (it->capture)
+        {
+            // Expired captures are removed when the next capture is stored
+            if (expired(*it, millis()))
+                break;
+
+            hits_++;
+            hit = true;
+            return it->capture;
+        }
+
+        // Another request is making this capture. If it fails, the entry is removed and this request tries itself
+        capture_done_.wait(lock);
+    }
+
+    misses_++;
+    auto it = find(sequence, key);
+    if (it == entries_.end())
+        entries_.push_back({sequence, key, millis(), nullptr});
+    else
+    {
+        // Expired: made again
+        bytes_ -= it->capture->size();
+        it->capture = nullptr;
+    }
+
+    lock.unlock();
+
+    cached_capture_ptr capture = produce();
+
+    lock.lock();
+    it = find(sequence, key);
+    // Checked before anything is encoded: the encoding of a kept capture is made when it is shared
+    if (capture && capture->size() <= max_bytes_)
+    {
+        evict(sequence, capture->size());
+        // Erasing other entries may have moved it
+        it = find(sequence, key);
+        it->capture = capture;
+        it->created = millis();
+        bytes_ += capture->size();
+    }
+    else
+        entries_.erase(it);
+
+    capture_done_.notify_all();
+    return capture;
+}
+
+capture_cache_status capture_cache::status()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {entries_.size(), bytes_, hits_, misses_};
+}
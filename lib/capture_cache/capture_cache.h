@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <image.h>
+
+// Finished capture: the processed JPEG with, once needed, its frame hash and, for inline delivery, its base64 encoding
+struct cached_capture
+{
+    cached_capture() = default;
+    cached_capture(const cached_capture &) = delete;
+    cached_capture &operator=(const cached_capture &) = delete;
+    ~cached_capture();
+
+    // Base64 encoding of the image (allocated in PSRAM), made by the first caller and shared with the later ones.
+    // Returns nullptr when out of memory
+    const char *base64() const;
+    // Frame hash of the image (average_hash), made by the first caller that needs it and shared with the later ones.
+    // Returns false if the image cannot be decoded
+    bool hash(uint64_t &hash) const;
+    // Memory used by the capture, including the encoding if encode is set
+    size_t size() const;
+
+    jpeg_ptr image;
+    // Delivered base64 encoded
+    bool encode = false;
+
+private:
+    mutable std::once_flag hashed_once_;
+    mutable uint64_t hash_ = 0;
+    mutable bool hashed_ = false;
+    mutable std::once_flag encoded_;
+    // base64_encoded_length(image->length) characters, or nullptr if not encoded
+    mutable char *base64_ = nullptr;
+};
+
+using cached_capture_ptr = std::shared_ptr<const cached_capture>;
+
+struct capture_cache_status
+{
+    size_t entries;
+    size_t bytes;
+    uint32_t hits;
+    uint32_t misses;
+};
+
+// Keeps the finished captures of recent frames in PSRAM, keyed by frame sequence number and a key describing the
+// capture parameters and encoding. Requests for the same frame and parameters share one crop/scale and hash: a request
+// arriving while the capture is being made waits for it. Hits return the same capture; nothing is copied. The request
+// making a capture encodes it while sending; the base64 encoding is kept once a second request uses the capture.
+class capture_cache
+{
+public:
+    // Returns the new capture, or nullptr on failure
+    using producer = std::function<std::shared_ptr<cached_capture>()>;
+
+    // Captures are used for ttl milliseconds after they were made; at most max_bytes are kept (0 disables the cache)
+    capture_cache(size_t max_bytes, unsigned long ttl);
+    bool enabled() const
+    {
+        return max_bytes_ > 0;
+    }
+
+    // Returns the cached capture of the frame for key, or makes it using produce. hit is set if it was cached.
+    // A capture is only kept if its size (with the encoding, if encode is set) fits
+    cached_capture_ptr get(uint32_t sequence, const String &key, producer produce, bool &hit);
+
+    capture_cache_status status();
+
+private:
+    struct entry
+    {
+        uint32_t sequence;
+        String key;
+        unsigned long created;
+        // nullptr while the capture is being made
+        cached_capture_ptr capture;
+    };
+
+    std::vector<entry>::iterator find(uint32_t sequence, const String &key);
+    bool expired(const entry &entry, unsigned long now) const
+    {
+        return entry.capture && now - entry.created > ttl_;
+    }
+    // Removes expired captures and captures of older frames (never requested again), and the oldest ones until
+    // length more bytes fit
+    void evict(uint32_t sequence, size_t length);
+
+    const size_t max_bytes_;
+    const unsigned long ttl_;
+
+    std::mutex mutex_;
+    std::condition_variable capture_done_;
+    std::vector<entry> entries_;
+    size_t bytes_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+};
@@ -0,0 +1,163 @@
+#include "deflate_stream.h"
+
+#include <metrics.h>
+
+// Bodies smaller than this are not worth compressing
+constexpr size_t DEFLATE_MIN_LENGTH = 256;
+// Maximum fraction of compressed (incompressible) data in a body worth compressing
+constexpr auto DEFLATE_MAX_INCOMPRESSIBLE = 0.5;
+
+deflate_stream::deflate_stream(Print &output, content_encoding encoding)
+    : output_(output), encoding_(encoding), checksum_(encoding == content_encoding::gzip ? 0 : 1) // Initial crc32 / adler32
+{
+}
+
+deflate_stream::~deflate_stream()
+{
+    free(compressor_);
+}
+
+bool deflate_stream::begin()
+{
+    // The compressor is large (dictionary and hash tables); prefer PSRAM
+    compressor_ = static_cast<tdefl_compressor *>(ps_malloc(sizeof(tdefl_compressor)));
+    if (!compressor_)
+        compressor_ = static_cast<tdefl_compressor *>(malloc(sizeof(tdefl_compressor)));
+
+    if (!compressor_)
+    {
+        log_w("Not enough memory for the compressor");
+        return false;
+    }
+
+    // Raw deflate: the zlib or gzip framing is added here
+    auto flags = tdefl_create_comp_flags_from_zip_params(MZ_DEFAULT_LEVEL, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+    return tdefl_init(compressor_, put_buffer, this, flags) == TDEFL_STATUS_OKAY;
+}
+
+void deflate_stream::write_header()
+{
+    header_written_ = true;
+    if (encoding_ == content_encoding::gzip)
+    {
+        // Magic, CM = deflate, no flags, no modification time, no extra flags, OS = unknown
+        static const uint8_t gzip_header[] = {0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff};
+        put(gzip_header, sizeof(gzip_header));
+    }
+    else
+    {
+        // CM = deflate with 32K window, default compression level
+        static const uint8_t zlib_header[] = {0x78, 0x9c};
+        put(zlib_header, sizeof(zlib_header));
+    }
+}
+
+bool deflate_stream::end()
+{
+    if (!compressor_)
+        return false;
+
+    if (!header_written_)
+        write_header();
+
+    auto start = micros();
+    auto status = tdefl_compress_buffer(compressor_, nullptr, 0, TDEFL_FINISH);
+    compress_time_ += micros() - start;
+    // Time spent compressing, without writing the compressed data
+    metric_histogram(metric_stage::compress).record(compress_time_ - output_time_);
+    if (status != TDEFL_STATUS_DONE)
+        return false;
+
+    if (encoding_ == content_encoding::gzip)
+    {
+        // CRC32 and size (modulo 2^32), little endian
+        uint8_t trailer[8];
+        for (auto i = 0; i < 4; i++)
+        {
+            trailer[i] = checksum_ >> (8 * i);
+            trailer[4 + i] = bytes_in_ >> (8 * i);
+        }
+
+        put(trailer, sizeof(trailer));
+    }
+    else
+    {
+        // Adler32, big endian
+        const uint8_t trailer[] = {uint8_t(checksum_ >> 24), uint8_t(checksum_ >> 16), uint8_t(checksum_ >> 8), uint8_t(checksum_)};
+        put(trailer, sizeof(trailer));
+    }
+
+    return !failed_;
+}
+
+size_t deflate_stream::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t deflate_stream::write(const uint8_t *buffer, size_t size)
+{
+    if (!compressor_ || failed_)
+        return 0;
+
+    if (!header_written_)
+        write_header();
+
+    auto start = micros();
+    checksum_ = encoding_ == content_encoding::gzip ? mz_crc32(checksum_, buffer, size) : mz_adler32(checksum_, buffer, size);
+    bytes_in_ += size;
+    // Compressed data is passed to the output by the callback as soon as a block is complete
+    auto status = tdefl_compress_buffer(compressor_, buffer, size, TDEFL_NO_FLUSH);
+    compress_time_ += micros() - start;
+    if (status != TDEFL_STATUS_OKAY)
+    {
+        failed_ = true;
+        return 0;
+    }
+
+    return size;
+}
+
+mz_bool deflate_stream::put_buffer(const void *buffer, int length, void *user)
+{
+    auto stream = static_cast<deflate_stream *>(user);
+    stream->put(buffer, length);
+    return stream->failed_ ? MZ_FALSE : MZ_TRUE;
+}
+
+void deflate_stream::put(const void *data, size_t length)
+{
+    auto start = micros();
+    auto written = output_.write(static_cast<const uint8_t *>(data), length);
+    output_time_ += micros() - start;
+    bytes_out_ += written;
+    if (written != length)
+        failed_ = true;
+}
+
+const char *deflate_stream::name(content_encoding encoding)
+{
+    switch (encoding)
+    {
+    case content_encoding::deflate:
+        return "deflate";
+    case content_encoding::gzip:
+        return "gzip";
+    default:
+        return "identity";
+    }
+}
+
+bool deflate_stream::worthwhile(const char *content_type, size_t length, size_t incompressible /*= 0*/)
+{
+    if (length < DEFLATE_MIN_LENGTH || incompressible > length * DEFLATE_MAX_INCOMPRESSIBLE)
+        return false;
+
+    // Already compressed formats
+    static const char *const compressed_types[] = {"image/", "video/", "audio/", "application/zip", "application/gzip", "application/octet-stream"};
+    for (auto type : compressed_types)
+        if (strncmp(content_type, type, strlen(type)) == 0)
+            return false;
+
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <miniz.h>
+
+enum class content_encoding
+{
+    identity,
+    deflate, // zlib framing (RFC 1950)
+    gzip     // gzip framing (RFC 1952)
+};
+
+// Print that compresses everything written to it and passes the compressed data on to output while writing,
+// so the body is never held in memory as a whole. Usually the output is a chunked http_response.
+class deflate_stream : public Print
+{
+public:
+    deflate_stream(Print &output, content_encoding encoding);
+    deflate_stream(const deflate_stream &) = delete;
+    deflate_stream &operator=(const deflate_stream &) = delete;
+    ~deflate_stream();
+
+    // Allocates the compressor. Returns false if out of memory; nothing has been written to the output then
+    bool begin();
+    // Flushes the compressor and writes the trailer. Returns false on failure
+    bool end();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    // Uncompressed and compressed bytes
+    size_t bytes_in() const
+    {
+        return bytes_in_;
+    }
+    size_t bytes_out() const
+    {
+        return bytes_out_;
+    }
+
+    static const char *name(content_encoding encoding);
+
+    // True if compressing a body is worthwhile. Small bodies and bodies that are mostly compressed data (images,
+    // archives or incompressible bytes, for example base64 encoded JPEG) are sent uncompressed
+    static bool worthwhile(const char *content_type, size_t length, size_t incompressible = 0);
+
+private:
+    static mz_bool put_buffer(const void *buffer, int length, void *user);
+    void write_header();
+    void put(const void *data, size_t length);
+
+    Print &output_;
+    content_encoding encoding_;
+    tdefl_compressor *compressor_ = nullptr;
+    // adler32 (deflate) or crc32 (gzip) of the uncompressed data
+    mz_ulong checksum_;
+    size_t bytes_in_ = 0;
+    size_t bytes_out_ = 0;
+    // Microseconds in the compressor, and in writing to the output (from the callback of the compressor)
+    unsigned long compress_time_ = 0;
+    unsigned long output_time_ = 0;
+    bool header_written_ = false;
+    bool failed_ = false;
+};
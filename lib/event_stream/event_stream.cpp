@@ -0,0 +1,231 @@
+#include "event_stream.h"
+
+#include <algorithm>
+#include <lwip/sockets.h>
+
+constexpr auto EVENT_TASK_STACK_SIZE = 4096;
+constexpr auto EVENT_TASK_PRIORITY = 1;
+// Wait time when nothing could be sent
+constexpr auto EVENT_IDLE_DELAY = 20; // ms
+// Comment sent on idle streams, so proxies and clients do not time out
+constexpr auto EVENT_KEEPALIVE_INTERVAL = 15000UL; // 15 seconds
+// Sessions without a stream expire after this time
+constexpr auto SESSION_TIMEOUT = 600000UL; // 10 minutes
+
+bool event_stream::begin(BaseType_t core)
+{
+    if (xTaskCreatePinnedToCore(send_task, "events", EVENT_TASK_STACK_SIZE, this, EVENT_TASK_PRIORITY, &task_, core) != pdPASS)
+    {
+        task_ = nullptr;
+        log_e("Unable to create the event stream task");
+        return false;
+    }
+
+    return true;
+}
+
+String event_stream::create_session()
+{
+    char id[33];
+    snprintf(id, sizeof(id), "%08x%08x%08x%08x", esp_random(), esp_random(), esp_random(), esp_random());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    session *slot = nullptr;
+    for (auto &session : sessions_)
+    {
+        if (session.id.isEmpty())
+        {
+            slot = &session;
+            break;
+        }
+
+        if (!session.connected && (!slot || session.last_activity < slot->last_activity))
+            slot = &session;
+    }
+
+    if (!slot)
+        return String();
+
+    *slot = session();
+    slot->id = id;
+    slot->last_activity = millis();
+    return slot->id;
+}
+
+bool event_stream::has_session(const String &id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &session : sessions_)
+        if (!id.isEmpty() && session.id == id)
+            return true;
+
+    return false;
+}
+
+bool event_stream::end_session(const String &id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &session : sessions_)
+    {
+        if (!id.isEmpty() && session.id == id)
+        {
+            disconnect(session);
+            session = event_stream::session();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool event_stream::attach(const String &id, const WiFiClient &client)
+{
+    if (!task_)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = false;
+        for (auto &session : sessions_)
+        {
+            if (!id.isEmpty() && session.id == id)
+            {
+                disconnect(session);
+                session.client = client;
+                session.connected = true;
+                session.last_activity = millis();
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+            return false;
+    }
+
+    xTaskNotifyGive(task_);
+    return true;
+}
+
+void event_stream::publish(const String &message)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &session : sessions_)
+        {
+            if (session.id.isEmpty())
+                continue;
+
+            if (session.queue.size() >= queue_length)
+                session.queue.pop_front();
+
+            session.queue.push_back({session.next_event_id++, message});
+        }
+    }
+
+    if (task_)
+        xTaskNotifyGive(task_);
+}
+
+size_t event_stream::session_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::count_if(std::begin(sessions_), std::end(sessions_), [](const session &session)
+                         { return !session.id.isEmpty(); });
+}
+
+size_t event_stream::stream_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::count_if(std::begin(sessions_), std::end(sessions_), [](const session &session)
+                         { return session.connected; });
+}
+
+void event_stream::disconnect(session &session)
+{
+    if (session.connected)
+        session.client.stop();
+
+    session.connected = false;
+    // A partly sent event is sent again completely on the next stream
+    session.position = 0;
+    session.last_activity = millis();
+}
+
+bool event_stream::send(session &session, bool &progress)
+{
+    auto fd = session.client.fd();
+    if (fd < 0)
+        return false;
+
+    while (session.position < session.sending.length())
+    {
+        auto sent = ::send(fd, session.sending.c_str() + session.position, session.sending.length() - session.position, MSG_DONTWAIT);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        session.position += sent;
+        progress = true;
+    }
+
+    // Event complete
+    session.sending = String();
+    session.position = 0;
+    session.last_activity = millis();
+    return true;
+}
+
+void event_stream::send_task(void *parameter)
+{
+    auto stream = static_cast<event_stream *>(parameter);
+    for (;;)
+    {
+        auto progress = false;
+        auto streams = false;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex_);
+            auto now = millis();
+            for (auto &session : stream->sessions_)
+            {
+                if (session.id.isEmpty())
+                    continue;
+
+                if (!session.connected)
+                {
+                    if (now - session.last_activity >= SESSION_TIMEOUT)
+                    {
+                        log_i("Session expired");
+                        session = event_stream::session();
+                    }
+
+                    continue;
+                }
+
+                if (session.sending.isEmpty())
+                {
+                    if (!session.queue.empty())
+                    {
+                        const auto &event = session.queue.front();
+                        session.sending = "id: " + String(event.id) + "\nevent: message\ndata: " + event.message + "\n\n";
+                        session.queue.pop_front();
+                    }
+                    else if (now - session.last_activity >= EVENT_KEEPALIVE_INTERVAL)
+                        session.sending = ": keepalive\n\n";
+                }
+
+                if (!session.sending.isEmpty() && !stream->send(session, progress))
+                {
+                    log_i("Event stream client disconnected");
+                    stream->disconnect(session);
+                    continue;
+                }
+
+                streams = true;
+            }
+        }
+
+        // Without open streams, only wake up for new streams and to expire sessions
+        if (!progress)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(streams ? EVENT_IDLE_DELAY : EVENT_KEEPALIVE_INTERVAL));
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <deque>
+#include <mutex>
+
+// Server-Sent Events for the MCP streamable HTTP transport. Every session has an id, a bounded queue of messages and
+// at most one open event stream (GET). Messages are queued while the stream is not connected, so a client that
+// reconnects receives what it missed (up to the queue length). Streams are written without blocking by one task.
+class event_stream
+{
+public:
+    static constexpr size_t max_sessions = 4;
+    // Messages per session; when full, the oldest message is dropped
+    static constexpr size_t queue_length = 16;
+
+    // Starts the send task pinned to core
+    bool begin(BaseType_t core);
+
+    // Creates a session and returns its id. When all sessions are in use, the least recently active one without
+    // a stream is replaced; returns an empty string if all sessions have a stream
+    String create_session();
+    bool has_session(const String &id);
+    // Ends the session and closes its stream. Returns false if unknown
+    bool end_session(const String &id);
+
+    // Takes over the client as the event stream of the session (the HTTP response header must have been sent already).
+    // An earlier stream of the session is closed
+    bool attach(const String &id, const WiFiClient &client);
+
+    // Queues a message (JSON) for all sessions
+    void publish(const String &message);
+
+    size_t session_count();
+    size_t stream_count();
+
+private:
+    struct queued_event
+    {
+        // Assigned when queued, so dropped events leave a gap in the ids the client receives
+        uint32_t id;
+        String message;
+    };
+
+    struct session
+    {
+        String id;
+        WiFiClient client;
+        bool connected = false;
+        std::deque<queued_event> queue;
+        uint32_t next_event_id = 1;
+        // Event being sent and the position in it
+        String sending;
+        size_t position = 0;
+        unsigned long last_activity = 0;
+    };
+
+    static void send_task(void *parameter);
+    // Sends as much as possible without blocking. Returns false if the client has disconnected
+    bool send(session &session, bool &progress);
+    void disconnect(session &session);
+
+    TaskHandle_t task_ = nullptr;
+    std::mutex mutex_;
+    session sessions_[max_sessions];
+};
@@ -0,0 +1,86 @@
+#include "frame_cache.h"
+
+#include <atomic>
+
+constexpr auto GRAB_TASK_STACK_SIZE = 4096;
+constexpr auto GRAB_TASK_PRIORITY = 2;
+
+static std::atomic<uint32_t> frame_sequence(0);
+
+frame::frame(camera_fb_t *fb)
+    : fb(fb), sequence(++frame_sequence), timestamp(millis())
+{
+}
+
+frame::~frame()
+{
+    esp_camera_fb_return(fb);
+}
+
+bool frame_cache::begin(unsigned long interval, BaseType_t core)
+{
+    if (task_)
+        return true;
+
+    interval_ = interval;
+    if (xTaskCreatePinnedToCore(grab_task, "grab", GRAB_TASK_STACK_SIZE, this, GRAB_TASK_PRIORITY, &task_, core) != pdPASS)
+    {
+        task_ = nullptr;
+        log_e("Unable to create the grab task");
+        return false;
+    }
+
+    log_i("Grab task started on core %d (interval %lu ms)", core, interval);
+    return true;
+}
+
+frame_ptr frame_cache::get(unsigned long max_age, unsigned long timeout)
+{
+    // No age at all: a frame grabbed after the call (an age of 0 ms would only match within the same millisecond)
+    if (max_age == 0)
+        return next(sequence() + 1, timeout);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    frame_available_.wait_for(lock, std::chrono::milliseconds(timeout), [this, max_age]()
+                              { return latest_ && millis() - latest_->timestamp <= max_age; });
+    return latest_ && millis() - latest_->timestamp <= max_age ? latest_ : nullptr;
+}
+
+frame_ptr frame_cache::next(uint32_t sequence, unsigned long timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    frame_available_.wait_for(lock, std::chrono::milliseconds(timeout), [this, sequence]()
+                              { return latest_ && latest_->sequence >= sequence; });
+    return latest_ && latest_->sequence >= sequence ? latest_ : nullptr;
+}
+
+uint32_t frame_cache::sequence()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latest_ ? latest_->sequence : 0;
+}
+
+void frame_cache::grab_task(void *parameter)
+{
+    auto cache = static_cast<frame_cache *>(parameter);
+    for (;;)
+    {
+        auto start = millis();
+        auto fb = esp_camera_fb_get();
+        if (fb)
+        {
+            auto grabbed = std::make_shared<const frame>(fb);
+            {
+                std::lock_guard<std::mutex> lock(cache->mutex_);
+                // The previous frame is returned to the driver (outside the lock) unless a client still holds it
+                cache->latest_.swap(grabbed);
+            }
+            cache->frame_available_.notify_all();
+        }
+        else
+            log_w("Grab task: camera capture failed");
+
+        auto elapsed = millis() - start;
+        vTaskDelay(pdMS_TO_TICKS(elapsed < cache->interval_ ? cache->interval_ - elapsed : 1));
+    }
+}
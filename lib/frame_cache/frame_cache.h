@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// Frame buffer taken from the camera driver. The buffer is returned to the driver when the frame is destroyed
+struct frame
+{
+    explicit frame(camera_fb_t *fb);
+    frame(const frame &) = delete;
+    frame &operator=(const frame &) = delete;
+    ~frame();
+
+    camera_fb_t *const fb;
+    // Increments for every frame taken from the driver
+    const uint32_t sequence;
+    // millis() when the frame was taken
+    const unsigned long timestamp;
+};
+
+// Reference counted frame; the frame buffer is returned when the last reference is released
+using frame_ptr = std::shared_ptr<const frame>;
+
+// Keeps the latest frame of a continuous grab task.
+// Note: every frame held by a client is unavailable to the driver, so use at least two frame buffers.
+class frame_cache
+{
+public:
+    // Starts the grab task pinned to core. A frame is grabbed at most every interval milliseconds
+    bool begin(unsigned long interval, BaseType_t core);
+    bool running() const
+    {
+        return task_ != nullptr;
+    }
+
+    // Returns the latest frame if it is not older than max_age milliseconds, otherwise waits (up to timeout) for the next one.
+    // With max_age 0, always waits for the next frame
+    frame_ptr get(unsigned long max_age, unsigned long timeout);
+    // Returns the first frame with a sequence number of at least sequence. Waits up to timeout
+    frame_ptr next(uint32_t sequence, unsigned long timeout);
+    // Sequence number of the latest frame (0 if none)
+    uint32_t sequence();
+
+private:
+    static void grab_task(void *parameter);
+
+    unsigned long interval_ = 0;
+    TaskHandle_t task_ = nullptr;
+
+    std::mutex mutex_;
+    std::condition_variable frame_available_;
+    frame_ptr latest_;
+};
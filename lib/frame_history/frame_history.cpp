@@ -0,0 +1,144 @@
+#include "frame_history.h"
+
+constexpr auto HISTORY_TASK_STACK_SIZE = 4096;
+constexpr auto HISTORY_TASK_PRIORITY = 1;
+
+bool frame_history::begin(frame_source source, size_t capacity, size_t max_frames, unsigned long interval, BaseType_t core)
+{
+    buffer_ = static_cast<uint8_t *>(ps_malloc(capacity));
+    entries_ = static_cast<entry *>(ps_malloc(max_frames * sizeof(entry)));
+    if (!buffer_ || !entries_)
+    {
+        free(buffer_);
+        free(entries_);
+        buffer_ = nullptr;
+        entries_ = nullptr;
+        log_e("Not enough memory for a frame history of %u bytes", static_cast<unsigned>(capacity));
+        return false;
+    }
+
+    source_ = source;
+    capacity_ = capacity;
+    max_frames_ = max_frames;
+    interval_ = interval;
+    if (xTaskCreatePinnedToCore(history_task, "history", HISTORY_TASK_STACK_SIZE, this, HISTORY_TASK_PRIORITY, &task_, core) != pdPASS)
+    {
+        task_ = nullptr;
+        log_e("Unable to create the history task");
+        return false;
+    }
+
+    return true;
+}
+
+history_status frame_history::status()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {count_, bytes_, capacity_, count_ ? at(0).timestamp : 0, count_ ? at(count_ - 1).timestamp : 0};
+}
+
+std::vector<history_frame> frame_history::around(unsigned long timestamp, size_t count)
+{
+    std::vector<history_frame> frames;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == 0 || count == 0)
+        return frames;
+
+    // Binary search on the age (robust against the millis() overflow); the ages decrease with the index
+    auto now = millis();
+    auto age = now - timestamp;
+    size_t low = 0;
+    size_t high = count_ - 1;
+    while (low < high)
+    {
+        auto middle = (low + high) / 2;
+        if (now - at(middle).timestamp > age)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    // low is the first frame not older than timestamp; the previous one may be nearer
+    if (low > 0 && (now - at(low - 1).timestamp) - age < age - (now - at(low).timestamp))
+        low--;
+
+    count = std::min(count, count_);
+    auto first = low >= count / 2 ? low - count / 2 : 0;
+    first = std::min(first, count_ - count);
+    for (auto index = first; index < first + count; index++)
+    {
+        const auto &entry = at(index);
+        auto data = static_cast<uint8_t *>(ps_malloc(entry.length));
+        if (!data)
+            break;
+
+        memcpy(data, buffer_ + entry.offset, entry.length);
+        frames.push_back({std::make_shared<const jpeg_image>(data, entry.length, entry.width, entry.height, entry.sequence), entry.timestamp});
+    }
+
+    return frames;
+}
+
+void frame_history::evict()
+{
+    bytes_ -= at(0).length;
+    first_ = (first_ + 1) % max_frames_;
+    count_--;
+}
+
+bool frame_history::overlaps(size_t offset, size_t length)
+{
+    for (size_t index = 0; index < count_; index++)
+    {
+        const auto &entry = at(index);
+        if (entry.offset < offset + length && offset < entry.offset + entry.length)
+            return true;
+    }
+
+    return false;
+}
+
+void frame_history::add(const frame &frame)
+{
+    auto length = frame.fb->len;
+    if (length > capacity_)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Frames are not split: wrap around when the frame does not fit at the end
+    auto offset = head_ + length <= capacity_ ? head_ : 0;
+    // The frames behind the head are the oldest; after wrapping around they are never reached again
+    if (offset != head_)
+        while (count_ > 0 && at(0).offset >= head_)
+            evict();
+
+    // Evict the oldest frames until no frame overlaps
+    while (count_ > 0 && (count_ == max_frames_ || overlaps(offset, length)))
+        evict();
+
+    memcpy(buffer_ + offset, frame.fb->buf, length);
+    entries_[(first_ + count_) % max_frames_] = {frame.sequence, frame.timestamp, static_cast<uint16_t>(frame.fb->width), static_cast<uint16_t>(frame.fb->height), offset, length};
+    count_++;
+    bytes_ += length;
+    head_ = offset + length;
+}
+
+void frame_history::history_task(void *parameter)
+{
+    auto history = static_cast<frame_history *>(parameter);
+    uint32_t sequence = 0;
+    for (;;)
+    {
+        auto start = millis();
+        auto image = history->source_();
+        if (image && image->sequence != sequence)
+        {
+            sequence = image->sequence;
+            history->add(*image);
+        }
+
+        image.reset();
+        auto elapsed = millis() - start;
+        vTaskDelay(pdMS_TO_TICKS(elapsed < history->interval_ ? history->interval_ - elapsed : 1));
+    }
+}
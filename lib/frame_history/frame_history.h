@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <frame_cache.h>
+#include <image.h>
+
+// Frame from the history
+struct history_frame
+{
+    jpeg_ptr image;
+    // millis() when the frame was taken
+    unsigned long timestamp;
+};
+
+struct history_status
+{
+    size_t frames;
+    size_t bytes;
+    size_t capacity;
+    // millis() of the oldest and newest frame (0 if none)
+    unsigned long oldest;
+    unsigned long newest;
+};
+
+// Keeps the last frames in a ring buffer in PSRAM. The JPEG data is stored back to back in one block that is allocated
+// once; a new frame evicts the oldest frames until it overlaps none. There is no allocation per frame.
+class frame_history
+{
+public:
+    // Returns the latest frame (or nullptr)
+    using frame_source = std::function<frame_ptr()>;
+
+    // Allocates capacity bytes for at most max_frames frames and starts the history task pinned to core.
+    // A frame is stored every interval milliseconds
+    bool begin(frame_source source, size_t capacity, size_t max_frames, unsigned long interval, BaseType_t core);
+    bool running() const
+    {
+        return task_ != nullptr;
+    }
+
+    history_status status();
+    // Copies count frames around the frame nearest to timestamp (millis()), oldest first
+    std::vector<history_frame> around(unsigned long timestamp, size_t count);
+
+    // Stores a copy of frame (called by the history task)
+    void add(const frame &frame);
+
+private:
+    struct entry
+    {
+        uint32_t sequence;
+        unsigned long timestamp;
+        uint16_t width;
+        uint16_t height;
+        size_t offset;
+        size_t length;
+    };
+
+    static void history_task(void *parameter);
+    // Entry by age: 0 is the oldest
+    entry &at(size_t index)
+    {
+        return entries_[(first_ + index) % max_frames_];
+    }
+    void evict();
+    // True if a frame is stored in [offset, offset + length)
+    bool overlaps(size_t offset, size_t length);
+
+    frame_source source_;
+    unsigned long interval_ = 0;
+    TaskHandle_t task_ = nullptr;
+
+    std::mutex mutex_;
+    uint8_t *buffer_ = nullptr;
+    size_t capacity_ = 0;
+    // Position for the next frame
+    size_t head_ = 0;
+    size_t bytes_ = 0;
+    entry *entries_ = nullptr;
+    size_t max_frames_ = 0;
+    size_t first_ = 0;
+    size_t count_ = 0;
+};
@@ -0,0 +1,718 @@
+#include "http_server.h"
+
+constexpr auto HTTP_MAX_CONNECTIONS = 8;
+// Maximum size of the request header and body
+constexpr auto HTTP_BUFFER_SIZE = 8192;
+// Incomplete requests are closed after this time
+constexpr auto HTTP_REQUEST_TIMEOUT = 5000UL; // 5 seconds
+// Timeout for (blocking) writes of a response
+constexpr auto HTTP_SEND_TIMEOUT = 5; // seconds
+
+constexpr auto SERVER_TASK_STACK_SIZE = 4096;
+constexpr auto SERVER_TASK_PRIORITY = 2;
+constexpr auto WORKER_TASK_STACK_SIZE = 12288;
+constexpr auto WORKER_TASK_PRIORITY = 1;
+
+static const char *status_text(int code)
+{
+    switch (code)
+    {
+    case 100:
+        return "Continue";
+    case 101:
+        return "Switching Protocols";
+    case 200:
+        return "OK";
+    case 202:
+        return "Accepted";
+    case 204:
+        return "No Content";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 408:
+        return "Request Timeout";
+    case 413:
+        return "Payload Too Large";
+    case 500:
+        return "Internal Server Error";
+    case 501:
+        return "Not Implemented";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "";
+    }
+}
+
+static String url_decode(const char *begin, const char *end)
+{
+    String decoded;
+    decoded.reserve(end - begin);
+    for (auto p = begin; p < end; p++)
+    {
+        if (*p == '+')
+            decoded += ' ';
+        else if (*p == '%' && end - p > 2 && isxdigit(p[1]) && isxdigit(p[2]))
+        {
+            char hex[] = {p[1], p[2], 0};
+            decoded += static_cast<char>(strtol(hex, nullptr, 16));
+            p += 2;
+        }
+        else
+            decoded += *p;
+    }
+
+    return decoded;
+}
+
+// Parses a Content-Length value: decimal digits, optionally followed by spaces. Returns false if invalid or too large
+static bool parse_content_length(const String &value, size_t &length)
+{
+    auto p = value.c_str();
+    if (!isdigit(*p))
+        return false;
+
+    length = 0;
+    for (; isdigit(*p); p++)
+    {
+        size_t digit = *p - '0';
+        if (length > (SIZE_MAX - digit) / 10)
+            return false;
+
+        length = length * 10 + digit;
+    }
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    return *p == '\0';
+}
+
+void http_request::clear()
+{
+    method_ = http_method::other;
+    path_ = String();
+    http11_ = false;
+    args_.clear();
+    headers_.clear();
+    body_ = nullptr;
+    body_length_ = 0;
+}
+
+bool http_request::has_arg(const char *name) const
+{
+    for (const auto &arg : args_)
+        if (arg.first == name)
+            return true;
+
+    return false;
+}
+
+String http_request::arg(const char *name) const
+{
+    for (const auto &arg : args_)
+        if (arg.first == name)
+            return arg.second;
+
+    return String();
+}
+
+bool http_request::has_header(const char *name) const
+{
+    for (const auto &header : headers_)
+        if (header.first.equalsIgnoreCase(name))
+            return true;
+
+    return false;
+}
+
+String http_request::header(const char *name) const
+{
+    for (const auto &header : headers_)
+        if (header.first.equalsIgnoreCase(name))
+            return header.second;
+
+    return String();
+}
+
+bool http_request::accepts_encoding(const char *encoding) const
+{
+    // Comma separated codings with an optional weight: gzip;q=0.8, deflate, *;q=0
+    auto accept = header("Accept-Encoding");
+    auto wildcard = false;
+    auto p = accept.c_str();
+    while (*p)
+    {
+        while (*p == ' ' || *p == ',')
+            p++;
+
+        auto name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ')
+            p++;
+
+        auto name_length = p - name;
+        auto weight = 1.0;
+        auto end = strchr(p, ',');
+        if (!end)
+            end = p + strlen(p);
+
+        // Parameters; only q is used
+        while (p < end)
+        {
+            if (*p == ';')
+            {
+                p++;
+                while (*p == ' ')
+                    p++;
+
+                if ((*p == 'q' || *p == 'Q') && p[1] == '=')
+                    weight = strtod(p + 2, nullptr);
+            }
+            else
+                p++;
+        }
+
+        if (name_length == static_cast<ptrdiff_t>(strlen(encoding)) && strncasecmp(name, encoding, name_length) == 0)
+            return weight > 0;
+
+        if (name_length == 1 && *name == '*')
+            wildcard = weight > 0;
+    }
+
+    // The wildcard matches the codings that are not listed
+    return wildcard;
+}
+
+bool http_request::keep_alive() const
+{
+    auto connection = header("Connection");
+    connection.toLowerCase();
+    if (http11_)
+        return connection.indexOf("close") < 0;
+
+    return connection.indexOf("keep-alive") >= 0;
+}
+
+http_response::http_response(WiFiClient &client, const http_request &request, bool keep_alive /*= false*/)
+    : client_(client), request_(request), keep_alive_(keep_alive)
+{
+}
+
+void http_response::add_header(const char *name, const String &value)
+{
+    headers_ += name;
+    headers_ += ": ";
+    headers_ += value;
+    headers_ += "\r\n";
+}
+
+void http_response::add_headers(const char *headers)
+{
+    headers_ += headers;
+}
+
+void http_response::begin(int code, const char *content_type, int64_t length /*= unknown_length*/)
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    auto header = String("HTTP/1.1 ") + code + " " + status_text(code) + "\r\n";
+    if (content_type && *content_type)
+        header += String("Content-Type: ") + content_type + "\r\n";
+
+    // Informational, 204 and 304 responses have no body and no length (RFC 9110, 8.6)
+    if (code < 200 || code == 204 || code == 304)
+        length = 0;
+    else if (length >= 0)
+        header += "Content-Length: " + String(static_cast<unsigned long>(length)) + "\r\n";
+    else if (length == unknown_length && request_.http11())
+    {
+        chunked_ = true;
+        header += "Transfer-Encoding: chunked\r\n";
+    }
+
+    // Without length or chunked encoding the body ends with the connection
+    if (length == until_close || (length == unknown_length && !chunked_))
+        keep_alive_ = false;
+
+    header += keep_alive_ ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    header += headers_;
+    header += "\r\n";
+    headers_ = String();
+    client_.write(reinterpret_cast<const uint8_t *>(header.c_str()), header.length());
+}
+
+void http_response::switch_protocols(const char *protocol)
+{
+    if (started_)
+        return;
+
+    started_ = true;
+    ended_ = true;
+    keep_alive_ = false;
+    auto header = String("HTTP/1.1 101 Switching Protocols\r\nUpgrade: ") + protocol + "\r\nConnection: Upgrade\r\n";
+    header += headers_;
+    header += "\r\n";
+    headers_ = String();
+    client_.write(reinterpret_cast<const uint8_t *>(header.c_str()), header.length());
+}
+
+void http_response::end()
+{
+    if (!started_)
+        begin(204, nullptr, 0);
+
+    if (ended_)
+        return;
+
+    flush();
+    if (chunked_)
+        client_.write(reinterpret_cast<const uint8_t *>("0\r\n\r\n"), 5);
+
+    ended_ = true;
+}
+
+void http_response::send(int code, const char *content_type, const String &body)
+{
+    send(code, content_type, reinterpret_cast<const uint8_t *>(body.c_str()), body.length());
+}
+
+void http_response::send(int code, const char *content_type, const uint8_t *data, size_t length)
+{
+    begin(code, content_type, length);
+    // Large bodies are written directly; no need to copy them into the buffer
+    flush();
+    if (length > 0)
+        client_.write(data, length);
+
+    end();
+}
+
+size_t http_response::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t http_response::write(const uint8_t *buffer, size_t size)
+{
+    if (!started_)
+        begin(200, "text/plain");
+
+    auto remaining = size;
+    while (remaining > 0)
+    {
+        auto chunk = std::min(remaining, sizeof(buffer_) - length_);
+        memcpy(buffer_ + length_, buffer, chunk);
+        length_ += chunk;
+        buffer += chunk;
+        remaining -= chunk;
+        if (length_ == sizeof(buffer_))
+            send_buffer();
+    }
+
+    return size;
+}
+
+void http_response::flush()
+{
+    if (length_ > 0)
+        send_buffer();
+}
+
+void http_response::send_buffer()
+{
+    if (chunked_)
+    {
+        char size[12];
+        auto size_length = snprintf(size, sizeof(size), "%x\r\n", static_cast<unsigned>(length_));
+        client_.write(reinterpret_cast<const uint8_t *>(size), size_length);
+        client_.write(buffer_, length_);
+        client_.write(reinterpret_cast<const uint8_t *>("\r\n"), 2);
+    }
+    else
+        client_.write(buffer_, length_);
+
+    length_ = 0;
+}
+
+WiFiClient http_response::detach()
+{
+    flush();
+    detached_ = true;
+    return client_;
+}
+
+http_server::http_server(uint16_t port)
+    : listener_(port, HTTP_MAX_CONNECTIONS)
+{
+}
+
+void http_server::on(const char *path, handler handler)
+{
+    handlers_.emplace_back(path, handler);
+}
+
+void http_server::keep_alive(unsigned long timeout, uint16_t max_requests)
+{
+    keep_alive_timeout_ = timeout;
+    keep_alive_requests_ = max_requests;
+}
+
+bool http_server::begin(size_t workers, BaseType_t core)
+{
+    connections_ = new connection[HTTP_MAX_CONNECTIONS];
+    for (auto i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+    {
+        connections_[i].buffer = static_cast<char *>(ps_malloc(HTTP_BUFFER_SIZE + 1));
+        if (!connections_[i].buffer)
+        {
+            log_e("Unable to allocate the connection buffers");
+            return false;
+        }
+    }
+
+    queue_ = xQueueCreate(HTTP_MAX_CONNECTIONS, sizeof(connection *));
+    if (!queue_)
+        return false;
+
+    listener_.begin();
+    listener_.setNoDelay(true);
+
+    if (xTaskCreatePinnedToCore(server_task, "http", SERVER_TASK_STACK_SIZE, this, SERVER_TASK_PRIORITY, nullptr, core) != pdPASS)
+    {
+        log_e("Unable to create the http server task");
+        return false;
+    }
+
+    for (size_t i = 0; i < workers; i++)
+    {
+        if (xTaskCreatePinnedToCore(worker_task, "http_worker", WORKER_TASK_STACK_SIZE, this, WORKER_TASK_PRIORITY, nullptr, core) != pdPASS)
+        {
+            log_e("Unable to create http worker %u", static_cast<unsigned>(i));
+            return false;
+        }
+    }
+
+    log_i("HTTP server started with %u workers on core %d", static_cast<unsigned>(workers), core);
+    return true;
+}
+
+void http_server::server_task(void *parameter)
+{
+    auto server = static_cast<http_server *>(parameter);
+    for (;;)
+    {
+        server->accept();
+
+        auto activity = false;
+        auto now = millis();
+        for (auto i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+        {
+            auto &connection = server->connections_[i];
+            if (connection.state != connection_state::reading)
+                continue;
+
+            // Between requests the keep-alive timeout applies
+            auto idle = connection.length == 0 && connection.requests > 0;
+            if (server->read(connection))
+                activity = true;
+            else if (now - connection.last_activity > (idle ? server->keep_alive_timeout_ : HTTP_REQUEST_TIMEOUT))
+            {
+                if (idle)
+                    log_v("Closing idle connection");
+                else
+                    log_d("Request timeout");
+
+                server->close(connection);
+            }
+        }
+
+        // Do not spin when idle
+        if (!activity)
+            vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+void http_server::worker_task(void *parameter)
+{
+    auto server = static_cast<http_server *>(parameter);
+    for (;;)
+    {
+        connection *connection;
+        if (xQueueReceive(server->queue_, &connection, portMAX_DELAY) == pdTRUE)
+            server->handle(*connection);
+    }
+}
+
+void http_server::accept()
+{
+    // Leave new connections in the backlog while all slots are in use
+    for (auto i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+    {
+        auto &connection = connections_[i];
+        if (connection.state != connection_state::free)
+            continue;
+
+        auto client = listener_.available();
+        if (!client)
+            return;
+
+        client.setTimeout(HTTP_SEND_TIMEOUT);
+        connection.client = client;
+        connection.length = 0;
+        connection.header_length = 0;
+        connection.content_length = 0;
+        connection.last_activity = millis();
+        connection.requests = 0;
+        connection.request.clear();
+        connection.state = connection_state::reading;
+    }
+}
+
+bool http_server::read(connection &connection)
+{
+    if (!connection.client.connected())
+    {
+        close(connection);
+        return false;
+    }
+
+    auto available = connection.client.available();
+    if (available <= 0)
+        return false;
+
+    if (connection.length == HTTP_BUFFER_SIZE)
+    {
+        reject(connection, 413, "Request too large");
+        return true;
+    }
+
+    auto received = connection.client.read(reinterpret_cast<uint8_t *>(connection.buffer) + connection.length, std::min<size_t>(available, HTTP_BUFFER_SIZE - connection.length));
+    if (received <= 0)
+        return false;
+
+    connection.length += received;
+    connection.buffer[connection.length] = '\0';
+    connection.last_activity = millis();
+    process(connection);
+    return true;
+}
+
+void http_server::process(connection &connection)
+{
+    if (connection.header_length == 0)
+    {
+        auto end = strstr(connection.buffer, "\r\n\r\n");
+        if (!end)
+        {
+            connection.state = connection_state::reading;
+            return;
+        }
+
+        connection.header_length = end - connection.buffer + 4;
+        if (!parse_header(connection))
+            return;
+
+        if (connection.content_length > HTTP_BUFFER_SIZE - connection.header_length)
+        {
+            reject(connection, 413, "Request too large");
+            return;
+        }
+
+        // Clients (curl) may wait for permission to send the body
+        if (connection.content_length > 0 && connection.request.header("Expect").equalsIgnoreCase("100-continue"))
+            connection.client.write(reinterpret_cast<const uint8_t *>("HTTP/1.1 100 Continue\r\n\r\n"), 25);
+    }
+
+    if (connection.length < connection.header_length + connection.content_length)
+    {
+        connection.state = connection_state::reading;
+        return;
+    }
+
+    auto &request = connection.request;
+    request.body_ = connection.buffer + connection.header_length;
+    request.body_length_ = connection.content_length;
+    connection.state = connection_state::processing;
+    auto pointer = &connection;
+    xQueueSend(queue_, &pointer, portMAX_DELAY);
+}
+
+bool http_server::parse_header(connection &connection)
+{
+    auto &request = connection.request;
+    auto header = connection.buffer;
+    auto header_end = connection.buffer + connection.header_length - 2;
+
+    // Request line: method target version
+    auto line_end = strstr(header, "\r\n");
+    auto method_end = static_cast<const char *>(memchr(header, ' ', line_end - header));
+    if (!method_end)
+    {
+        reject(connection, 400, "Invalid request line");
+        return false;
+    }
+
+    auto target = method_end + 1;
+    auto target_end = static_cast<const char *>(memchr(target, ' ', line_end - target));
+    if (!target_end)
+    {
+        reject(connection, 400, "Invalid request line");
+        return false;
+    }
+
+    auto method = String(header, method_end - header);
+    if (method == "GET")
+        request.method_ = http_method::get;
+    else if (method == "HEAD")
+        request.method_ = http_method::head;
+    else if (method == "POST")
+        request.method_ = http_method::post;
+    else if (method == "PUT")
+        request.method_ = http_method::put;
+    else if (method == "DELETE")
+        request.method_ = http_method::delete_;
+    else if (method == "OPTIONS")
+        request.method_ = http_method::options;
+
+    request.http11_ = strncmp(target_end + 1, "HTTP/1.1", 8) == 0;
+
+    auto query = static_cast<const char *>(memchr(target, '?', target_end - target));
+    request.path_ = url_decode(target, query ? query : target_end);
+    if (query)
+    {
+        // name=value&name=value
+        auto p = query + 1;
+        while (p < target_end)
+        {
+            auto end = static_cast<const char *>(memchr(p, '&', target_end - p));
+            if (!end)
+                end = target_end;
+
+            auto equals = static_cast<const char *>(memchr(p, '=', end - p));
+            if (equals)
+                request.args_.emplace_back(url_decode(p, equals), url_decode(equals + 1, end));
+            else if (end > p)
+                request.args_.emplace_back(url_decode(p, end), String());
+
+            p = end + 1;
+        }
+    }
+
+    // Header lines: name: value
+    auto line = line_end + 2;
+    while (line < header_end)
+    {
+        line_end = strstr(line, "\r\n");
+        auto colon = static_cast<const char *>(memchr(line, ':', line_end - line));
+        if (colon)
+        {
+            auto value = colon + 1;
+            while (value < line_end && *value == ' ')
+                value++;
+
+            request.headers_.emplace_back(String(line, colon - line), String(value, line_end - value));
+        }
+
+        line = line_end + 2;
+    }
+
+    if (request.has_header("Transfer-Encoding"))
+    {
+        reject(connection, 501, "Chunked requests are not supported");
+        return false;
+    }
+
+    // Digits only; repeated headers must agree (RFC 9110, 8.6). Anything else could desynchronize pipelined requests
+    auto content_length_found = false;
+    for (const auto &header : request.headers_)
+    {
+        if (!header.first.equalsIgnoreCase("Content-Length"))
+            continue;
+
+        size_t length;
+        if (!parse_content_length(header.second, length) || (content_length_found && length != connection.content_length))
+        {
+            reject(connection, 400, "Invalid Content-Length");
+            return false;
+        }
+
+        connection.content_length = length;
+        content_length_found = true;
+    }
+
+    return true;
+}
+
+void http_server::reject(connection &connection, int code, const char *message)
+{
+    log_w("Rejecting request: %d %s", code, message);
+    http_response response(connection.client, connection.request);
+    response.send(code, "text/plain", message);
+    close(connection);
+}
+
+void http_server::handle(connection &connection)
+{
+    auto &request = connection.request;
+    auto keep_alive = keep_alive_timeout_ > 0 && connection.requests + 1 < keep_alive_requests_ && request.keep_alive();
+    http_response response(connection.client, request, keep_alive);
+
+    auto handled = false;
+    for (const auto &handler : handlers_)
+    {
+        if (request.path() == handler.first)
+        {
+            handler.second(request, response);
+            handled = true;
+            break;
+        }
+    }
+
+    if (!handled)
+        response.send(404, "text/plain", "Not found: " + request.path());
+
+    if (response.detached())
+    {
+        // The connection is owned by the handler now
+        connection.client = WiFiClient();
+        connection.state = connection_state::free;
+        return;
+    }
+
+    response.end();
+    if (response.keep_alive() && connection.client.connected())
+        next_request(connection);
+    else
+        close(connection);
+}
+
+void http_server::next_request(connection &connection)
+{
+    // Pipelined requests follow the body
+    auto consumed = connection.header_length + connection.content_length;
+    connection.length -= consumed;
+    memmove(connection.buffer, connection.buffer + consumed, connection.length);
+    connection.buffer[connection.length] = '\0';
+    connection.header_length = 0;
+    connection.content_length = 0;
+    connection.requests++;
+    connection.last_activity = millis();
+    connection.request.clear();
+    // A pipelined request is queued right away; otherwise the server task continues reading
+    process(connection);
+}
+
+void http_server::close(connection &connection)
+{
+    connection.client.stop();
+    connection.request.clear();
+    connection.state = connection_state::free;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiServer.h>
+#include <WiFiClient.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+enum class http_method
+{
+    get,
+    head,
+    post,
+    put,
+    delete_,
+    options,
+    other
+};
+
+class http_request
+{
+public:
+    http_method method() const
+    {
+        return method_;
+    }
+    // Path without the query string
+    const String &path() const
+    {
+        return path_;
+    }
+    // True for HTTP/1.1 and later
+    bool http11() const
+    {
+        return http11_;
+    }
+
+    // Query string arguments (url decoded)
+    bool has_arg(const char *name) const;
+    String arg(const char *name) const;
+
+    // Header names are case insensitive
+    bool has_header(const char *name) const;
+    String header(const char *name) const;
+    // True if the Accept-Encoding header lists encoding (or *) with a weight above 0
+    bool accepts_encoding(const char *encoding) const;
+    // True if the client wants to keep the connection open (default for HTTP/1.1)
+    bool keep_alive() const;
+
+    // The body is not copied; it is valid while the request is handled
+    const char *body() const
+    {
+        return body_;
+    }
+    size_t body_length() const
+    {
+        return body_length_;
+    }
+
+private:
+    friend class http_server;
+
+    void clear();
+
+    http_method method_ = http_method::other;
+    String path_;
+    bool http11_ = false;
+    std::vector<std::pair<String, String>> args_;
+    std::vector<std::pair<String, String>> headers_;
+    const char *body_ = nullptr;
+    size_t body_length_ = 0;
+};
+
+// Response writer. The body can be written as a whole using send() or streamed using begin(), print/write and end().
+// When the length is unknown, the body is sent using chunked transfer encoding.
+class http_response : public Print
+{
+public:
+    // Length unknown: use chunked transfer encoding (HTTP/1.1)
+    static constexpr int64_t unknown_length = -1;
+    // Body ends when the connection is closed (for example for streaming)
+    static constexpr int64_t until_close = -2;
+
+    // The connection is kept open after the response if keep_alive and the end of the body is known to the client
+    http_response(WiFiClient &client, const http_request &request, bool keep_alive = false);
+    http_response(const http_response &) = delete;
+    http_response &operator=(const http_response &) = delete;
+
+    // Adds a header to the response; must be called before begin() or send()
+    void add_header(const char *name, const String &value);
+    // Adds preformatted header lines ("Name: value\r\n" each); must be called before begin() or send()
+    void add_headers(const char *headers);
+
+    // Sends the status line and headers
+    void begin(int code, const char *content_type, int64_t length = unknown_length);
+    // Sends 101 Switching Protocols to protocol (with the added headers). The connection should be detached afterwards
+    void switch_protocols(const char *protocol);
+    // Flushes the body and terminates a chunked body
+    void end();
+
+    void send(int code, const char *content_type, const String &body);
+    void send(int code, const char *content_type, const uint8_t *data, size_t length);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    void flush() override;
+
+    // True if the status line has been sent
+    bool started() const
+    {
+        return started_;
+    }
+
+    // Takes over the connection (for example for streaming). The server will not close it
+    WiFiClient detach();
+    bool detached() const
+    {
+        return detached_;
+    }
+    // True if the connection stays open for the next request
+    bool keep_alive() const
+    {
+        return keep_alive_;
+    }
+
+private:
+    void send_buffer();
+
+    WiFiClient &client_;
+    const http_request &request_;
+    String headers_;
+    bool started_ = false;
+    bool ended_ = false;
+    bool chunked_ = false;
+    bool detached_ = false;
+    bool keep_alive_;
+    // One TCP segment
+    uint8_t buffer_[1436];
+    size_t length_ = 0;
+};
+
+// Event driven HTTP server. A server task accepts connections and reads requests from all connections without blocking.
+// Complete requests are handled by a pool of worker tasks, so a slow request or client does not block the others.
+// Connections are kept open (HTTP/1.1 persistent connections); requests pipelined on a connection are handled one
+// after the other, so the responses are sent in order.
+class http_server
+{
+public:
+    using handler = std::function<void(http_request &request, http_response &response)>;
+
+    explicit http_server(uint16_t port);
+
+    // Registers the handler for an (exact) path
+    void on(const char *path, handler handler);
+
+    // Idle connections are closed after timeout milliseconds, and after max_requests requests. 0 disables keep-alive.
+    // Must be called before begin()
+    void keep_alive(unsigned long timeout, uint16_t max_requests);
+
+    // Starts the server task and workers pinned to core
+    bool begin(size_t workers, BaseType_t core);
+
+private:
+    enum class connection_state
+    {
+        free,
+        reading,
+        processing
+    };
+
+    struct connection
+    {
+        WiFiClient client;
+        std::atomic<connection_state> state{connection_state::free};
+        char *buffer = nullptr;
+        size_t length = 0;
+        // Position after the header (0 while incomplete)
+        size_t header_length = 0;
+        size_t content_length = 0;
+        unsigned long last_activity = 0;
+        // Requests handled on the connection
+        uint16_t requests = 0;
+        http_request request;
+    };
+
+    static void server_task(void *parameter);
+    static void worker_task(void *parameter);
+
+    void accept();
+    // Reads available data. Returns true if data was received
+    bool read(connection &connection);
+    // Queues the request if it is complete in the buffer, otherwise continues reading
+    void process(connection &connection);
+    // Parses the request line and headers. Returns false if invalid
+    bool parse_header(connection &connection);
+    void reject(connection &connection, int code, const char *message);
+    void handle(connection &connection);
+    // Prepares the connection for the next request; pipelined data is kept
+    void next_request(connection &connection);
+    void close(connection &connection);
+
+    WiFiServer listener_;
+    std::vector<std::pair<String, handler>> handlers_;
+    connection *connections_ = nullptr;
+    QueueHandle_t queue_ = nullptr;
+    unsigned long keep_alive_timeout_ = 0;
+    uint16_t keep_alive_requests_ = 0;
+};
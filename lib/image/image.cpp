@@ -0,0 +1,109 @@
+#include "image.h"
+
+#include <algorithm>
+
+jpeg_image::jpeg_image(uint8_t *data, size_t length, uint16_t width, uint16_t height, uint32_t sequence)
+    : data(data), length(length), width(width), height(height), sequence(sequence)
+{
+}
+
+jpeg_image::~jpeg_image()
+{
+    free(data);
+}
+
+jpeg_ptr copy_jpeg(const camera_fb_t *fb, uint32_t sequence)
+{
+    auto data = static_cast<uint8_t *>(ps_malloc(fb->len));
+    if (!data)
+        return nullptr;
+
+    memcpy(data, fb->buf, fb->len);
+    return std::make_shared<const jpeg_image>(data, fb->len, fb->width, fb->height, sequence);
+}
+
+jpeg_ptr scale_jpeg(const uint8_t *data, size_t length, uint16_t width, uint16_t height, jpg_scale_t scale, uint8_t quality, uint32_t sequence)
+{
+    return crop_jpeg(data, length, width, height, {0, 0, width, height}, scale, quality, sequence);
+}
+
+jpeg_ptr crop_jpeg(const uint8_t *data, size_t length, uint16_t width, uint16_t height, const image_rect &crop, jpg_scale_t scale, uint8_t quality, uint32_t sequence)
+{
+    uint16_t scaled_width = width >> scale;
+    uint16_t scaled_height = height >> scale;
+    // Region in scaled pixels
+    uint16_t x = std::min<uint16_t>(crop.x >> scale, scaled_width);
+    uint16_t y = std::min<uint16_t>(crop.y >> scale, scaled_height);
+    uint16_t crop_width = std::min<uint16_t>(crop.width >> scale, scaled_width - x);
+    uint16_t crop_height = std::min<uint16_t>(crop.height >> scale, scaled_height - y);
+    if (crop_width == 0 || crop_height == 0)
+        return nullptr;
+
+    std::unique_ptr<uint8_t, decltype(&free)> rgb565(static_cast<uint8_t *>(ps_malloc(scaled_width * scaled_height * 2)), &free);
+    if (!rgb565)
+        return nullptr;
+
+    // The scaling is done by the decoder
+    if (!jpg2rgb565(data, length, rgb565.get(), scale))
+        return nullptr;
+
+    // Move the rows of the region to the start of the buffer. A row never moves forward, so this can be done in place
+    if (crop_width != scaled_width || crop_height != scaled_height)
+        for (auto row = 0; row < crop_height; row++)
+            memmove(rgb565.get() + row * crop_width * 2, rgb565.get() + ((y + row) * scaled_width + x) * 2, crop_width * 2);
+
+    uint8_t *jpeg = nullptr;
+    size_t jpeg_length = 0;
+    if (!fmt2jpg(rgb565.get(), crop_width * crop_height * 2, crop_width, crop_height, PIXFORMAT_RGB565, quality, &jpeg, &jpeg_length))
+        return nullptr;
+
+    return std::make_shared<const jpeg_image>(jpeg, jpeg_length, crop_width, crop_height, sequence);
+}
+
+bool average_hash(const uint8_t *data, size_t length, uint16_t width, uint16_t height, uint64_t &hash)
+{
+    // Smallest decode that still has at least 4x4 pixels per cell
+    uint8_t scale = 3;
+    while (scale > 0 && ((width >> scale) < 32 || (height >> scale) < 32))
+        scale--;
+
+    uint16_t scaled_width = width >> scale;
+    uint16_t scaled_height = height >> scale;
+    if (scaled_width < 8 || scaled_height < 8)
+        return false;
+
+    std::unique_ptr<uint8_t, decltype(&free)> rgb565(static_cast<uint8_t *>(ps_malloc(scaled_width * scaled_height * 2)), &free);
+    if (!rgb565 || !jpg2rgb565(data, length, rgb565.get(), static_cast<jpg_scale_t>(scale)))
+        return false;
+
+    uint32_t sums[64] = {};
+    uint16_t counts[64] = {};
+    auto pixel = rgb565.get();
+    for (auto y = 0; y < scaled_height; y++)
+    {
+        auto row = (y * 8 / scaled_height) * 8;
+        for (auto x = 0; x < scaled_width; x++, pixel += 2)
+        {
+            // Luma of the RGB565 pixel (big endian)
+            uint16_t value = pixel[0] << 8 | pixel[1];
+            auto cell = row + x * 8 / scaled_width;
+            sums[cell] += 77 * ((value >> 8) & 0xf8) + 150 * ((value >> 3) & 0xfc) + 29 * ((value << 3) & 0xf8);
+            counts[cell]++;
+        }
+    }
+
+    uint32_t means[64];
+    uint64_t total = 0;
+    for (auto cell = 0; cell < 64; cell++)
+    {
+        means[cell] = sums[cell] / counts[cell];
+        total += means[cell];
+    }
+
+    hash = 0;
+    for (auto cell = 0; cell < 64; cell++)
+        if (means[cell] * 64 > total)
+            hash |= 1ULL << cell;
+
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_camera.h>
+#include <img_converters.h>
+
+#include <memory>
+
+// JPEG image owned by the application (allocated with malloc, preferably in PSRAM)
+struct jpeg_image
+{
+    // Takes ownership of data
+    jpeg_image(uint8_t *data, size_t length, uint16_t width, uint16_t height, uint32_t sequence);
+    jpeg_image(const jpeg_image &) = delete;
+    jpeg_image &operator=(const jpeg_image &) = delete;
+    ~jpeg_image();
+
+    uint8_t *const data;
+    const size_t length;
+    const uint16_t width;
+    const uint16_t height;
+    // Sequence number of the frame the image was made from
+    const uint32_t sequence;
+};
+
+using jpeg_ptr = std::shared_ptr<const jpeg_image>;
+
+// Region of an image in pixels
+struct image_rect
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+// Copies the JPEG data of a frame buffer into PSRAM. Returns nullptr when out of memory
+jpeg_ptr copy_jpeg(const camera_fb_t *fb, uint32_t sequence);
+// Downscales a JPEG by 2, 4 or 8. The scaling is done while decoding so only the needed DCT coefficients are used. Returns nullptr on failure
+jpeg_ptr scale_jpeg(const uint8_t *data, size_t length, uint16_t width, uint16_t height, jpg_scale_t scale, uint8_t quality, uint32_t sequence);
+// Crops a region (in pixels of the original image, clipped to the image) and downscales it by 1, 2, 4 or 8. Returns nullptr on failure
+jpeg_ptr crop_jpeg(const uint8_t *data, size_t length, uint16_t width, uint16_t height, const image_rect &crop, jpg_scale_t scale, uint8_t quality, uint32_t sequence);
+
+// Perceptual (average) hash of a JPEG. The image is decoded at reduced scale (at 1/8 scale only the DC coefficients
+// are used) and reduced to 8x8 cells; a bit is set for every cell brighter than the mean. Returns false on failure
+bool average_hash(const uint8_t *data, size_t length, uint16_t width, uint16_t height, uint64_t &hash);
+// Number of differing bits of two hashes: small for similar images
+inline uint8_t hash_distance(uint64_t a, uint64_t b)
+{
+    return __builtin_popcountll(a ^ b);
+}
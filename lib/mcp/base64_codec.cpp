@@ -0,0 +1,142 @@
+#include "base64_codec.h"
+
+#include <algorithm>
+
+// Input bytes encoded per chunk when writing to a Print (multiple of 3, so only the last chunk is padded)
+constexpr size_t BASE64_CHUNK_SIZE = 768;
+
+constexpr char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr uint8_t BASE64_INVALID = 0xff;
+
+// Characters of 12 bits: the first in the low byte
+#define BASE64_PAIR(i) static_cast<uint16_t>(base64_alphabet[(i) >> 6] | base64_alphabet[(i) & 63] << 8)
+#define BASE64_PAIRS_4(i) BASE64_PAIR(i), BASE64_PAIR(i + 1), BASE64_PAIR(i + 2), BASE64_PAIR(i + 3)
+#define BASE64_PAIRS_16(i) BASE64_PAIRS_4(i), BASE64_PAIRS_4(i + 4), BASE64_PAIRS_4(i + 8), BASE64_PAIRS_4(i + 12)
+#define BASE64_PAIRS_64(i) BASE64_PAIRS_16(i), BASE64_PAIRS_16(i + 16), BASE64_PAIRS_16(i + 32), BASE64_PAIRS_16(i + 48)
+#define BASE64_PAIRS_256(i) BASE64_PAIRS_64(i), BASE64_PAIRS_64(i + 64), BASE64_PAIRS_64(i + 128), BASE64_PAIRS_64(i + 192)
+#define BASE64_PAIRS_1024(i) BASE64_PAIRS_256(i), BASE64_PAIRS_256(i + 256), BASE64_PAIRS_256(i + 512), BASE64_PAIRS_256(i + 768)
+
+// 8 KB, in flash
+static const uint16_t base64_pairs[4096] = {BASE64_PAIRS_1024(0), BASE64_PAIRS_1024(1024), BASE64_PAIRS_1024(2048), BASE64_PAIRS_1024(3072)};
+
+constexpr uint8_t base64_value(int c)
+{
+    return c >= 'A' && c <= 'Z'   ? c - 'A'
+           : c >= 'a' && c <= 'z' ? c - 'a' + 26
+           : c >= '0' && c <= '9' ? c - '0' + 52
+           : c == '+'             ? 62
+           : c == '/'             ? 63
+                                  : BASE64_INVALID;
+}
+
+#define BASE64_VALUES_4(i) base64_value(i), base64_value(i + 1), base64_value(i + 2), base64_value(i + 3)
+#define BASE64_VALUES_16(i) BASE64_VALUES_4(i), BASE64_VALUES_4(i + 4), BASE64_VALUES_4(i + 8), BASE64_VALUES_4(i + 12)
+#define BASE64_VALUES_64(i) BASE64_VALUES_16(i), BASE64_VALUES_16(i + 16), BASE64_VALUES_16(i + 32), BASE64_VALUES_16(i + 48)
+
+static const uint8_t base64_values[256] = {BASE64_VALUES_64(0), BASE64_VALUES_64(64), BASE64_VALUES_64(128), BASE64_VALUES_64(192)};
+
+size_t base64_encode(const uint8_t *data, size_t length, char *output)
+{
+    auto out = output;
+    auto end = data + length / 3 * 3;
+    for (; data < end; data += 3)
+    {
+        uint32_t bits = data[0] << 16 | data[1] << 8 | data[2];
+        auto high = base64_pairs[bits >> 12];
+        auto low = base64_pairs[bits & 0xfff];
+        out[0] = high;
+        out[1] = high >> 8;
+        out[2] = low;
+        out[3] = low >> 8;
+        out += 4;
+    }
+
+    switch (length % 3)
+    {
+    case 1:
+        out[0] = base64_alphabet[data[0] >> 2];
+        out[1] = base64_alphabet[(data[0] & 0x03) << 4];
+        out[2] = '=';
+        out[3] = '=';
+        out += 4;
+        break;
+    case 2:
+        out[0] = base64_alphabet[data[0] >> 2];
+        out[1] = base64_alphabet[(data[0] & 0x03) << 4 | data[1] >> 4];
+        out[2] = base64_alphabet[(data[1] & 0x0f) << 2];
+        out[3] = '=';
+        out += 4;
+        break;
+    }
+
+    return out - output;
+}
+
+size_t base64_encode(const uint8_t *data, size_t length, Print &output, unsigned long *encode_time /*= nullptr*/)
+{
+    size_t written = 0;
+    char encoded[BASE64_CHUNK_SIZE / 3 * 4];
+    while (length > 0)
+    {
+        auto chunk = std::min(length, BASE64_CHUNK_SIZE);
+        auto start = micros();
+        auto encoded_length = base64_encode(data, chunk, encoded);
+        if (encode_time)
+            *encode_time += micros() - start;
+
+        written += output.write(reinterpret_cast<const uint8_t *>(encoded), encoded_length);
+        data += chunk;
+        length -= chunk;
+    }
+
+    return written;
+}
+
+bool base64_decode(const char *input, size_t length, uint8_t *output, size_t &decoded_length)
+{
+    auto in = reinterpret_cast<const uint8_t *>(input);
+    if (length % 4 == 0 && length > 0 && in[length - 1] == '=')
+        length -= in[length - 2] == '=' ? 2 : 1;
+
+    if (length % 4 == 1)
+        return false;
+
+    auto out = output;
+    auto end = in + length / 4 * 4;
+    for (; in < end; in += 4)
+    {
+        auto a = base64_values[in[0]];
+        auto b = base64_values[in[1]];
+        auto c = base64_values[in[2]];
+        auto d = base64_values[in[3]];
+        // Valid values have 6 bits
+        if ((a | b | c | d) & 0xc0)
+            return false;
+
+        uint32_t bits = a << 18 | b << 12 | c << 6 | d;
+        out[0] = bits >> 16;
+        out[1] = bits >> 8;
+        out[2] = bits;
+        out += 3;
+    }
+
+    // Unpadded end: 2 or 3 characters for 1 or 2 bytes
+    auto remaining = length % 4;
+    if (remaining > 0)
+    {
+        auto a = base64_values[in[0]];
+        auto b = base64_values[in[1]];
+        auto c = remaining == 3 ? base64_values[in[2]] : 0;
+        if ((a | b | c) & 0xc0)
+            return false;
+
+        out[0] = a << 2 | b >> 4;
+        if (remaining == 3)
+            out[1] = b << 4 | c >> 2;
+
+        out += remaining - 1;
+    }
+
+    decoded_length = out - output;
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Table driven base64 (RFC 4648, with padding). Three input bytes are encoded with two lookups in a table of 4096
+// character pairs (12 bits each) in flash, instead of four 6-bit lookups; decoding uses a 256-entry table.
+
+// Length of the base64 encoding of length bytes (including padding)
+inline size_t base64_encoded_length(size_t length)
+{
+    return (length + 2) / 3 * 4;
+}
+
+// Upper bound of the decoded length of length characters (padded or not)
+inline size_t base64_decoded_max_length(size_t length)
+{
+    return (length + 3) / 4 * 3;
+}
+
+// Encodes data into output (base64_encoded_length(length) characters, not zero terminated). Returns the characters written
+size_t base64_encode(const uint8_t *data, size_t length, char *output);
+// Encodes data in chunks straight into output. Returns the bytes written.
+// If encode_time is set, the microseconds spent encoding (without writing) are added to it
+size_t base64_encode(const uint8_t *data, size_t length, Print &output, unsigned long *encode_time = nullptr);
+
+// Decodes input (padding optional, no whitespace) into output (base64_decoded_max_length(length) bytes).
+// Returns false if input is not valid base64
+bool base64_decode(const char *input, size_t length, uint8_t *output, size_t &decoded_length);
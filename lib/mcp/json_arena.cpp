@@ -0,0 +1,209 @@
+#include "json_arena.h"
+
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+
+// Alignment of the allocations (and of the size header in front of them)
+constexpr size_t ARENA_ALIGNMENT = 8;
+
+static size_t align(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+json_arena::json_arena(size_t size, uint32_t caps)
+    : size_(align(size)), caps_(caps)
+{
+    block_ = static_cast<uint8_t *>(heap_caps_malloc(size_, caps));
+    if (!block_)
+    {
+        log_e("Unable to allocate a JSON arena of %u bytes", static_cast<unsigned>(size_));
+        size_ = 0;
+    }
+}
+
+json_arena::~json_arena()
+{
+    heap_caps_free(block_);
+}
+
+void *json_arena::allocate(size_t size)
+{
+    auto needed = ARENA_ALIGNMENT + align(size);
+    if (used_ + needed > size_)
+    {
+        // Does not fit: use the heap (preferably in the same memory)
+        overflows_++;
+        auto pointer = heap_caps_malloc(size, caps_);
+        return pointer ? pointer : malloc(size);
+    }
+
+    // Size header in front of the allocation
+    *reinterpret_cast<size_t *>(block_ + used_) = size;
+    last_ = used_;
+    used_ += needed;
+    if (used_ > high_water_mark_)
+        high_water_mark_ = used_;
+
+    return block_ + last_ + ARENA_ALIGNMENT;
+}
+
+void json_arena::deallocate(void *pointer)
+{
+    if (!pointer)
+        return;
+
+    if (!contains(pointer))
+    {
+        heap_caps_free(pointer);
+        return;
+    }
+
+    // Only the last allocation can be given back
+    if (static_cast<uint8_t *>(pointer) == block_ + last_ + ARENA_ALIGNMENT)
+    {
+        used_ = last_;
+        last_ = SIZE_MAX;
+    }
+}
+
+void *json_arena::reallocate(void *pointer, size_t new_size)
+{
+    if (!pointer)
+        return allocate(new_size);
+
+    if (!contains(pointer))
+        return heap_caps_realloc(pointer, new_size, caps_);
+
+    auto header = reinterpret_cast<size_t *>(static_cast<uint8_t *>(pointer) - ARENA_ALIGNMENT);
+    if (new_size <= *header)
+    {
+        // Shrink in place; only the last allocation actually gives the bytes back
+        if (static_cast<uint8_t *>(pointer) == block_ + last_ + ARENA_ALIGNMENT)
+            used_ = last_ + ARENA_ALIGNMENT + align(new_size);
+
+        *header = new_size;
+        return pointer;
+    }
+
+    // Grow the last allocation in place
+    if (static_cast<uint8_t *>(pointer) == block_ + last_ + ARENA_ALIGNMENT && last_ + ARENA_ALIGNMENT + align(new_size) <= size_)
+    {
+        used_ = last_ + ARENA_ALIGNMENT + align(new_size);
+        if (used_ > high_water_mark_)
+            high_water_mark_ = used_;
+
+        *header = new_size;
+        return pointer;
+    }
+
+    auto moved = allocate(new_size);
+    if (moved)
+        memcpy(moved, pointer, *header);
+
+    return moved;
+}
+
+void json_arena::reset()
+{
+    used_ = 0;
+    last_ = SIZE_MAX;
+}
+
+void json_arena::rewind(size_t mark)
+{
+    if (mark >= used_)
+        return;
+
+    used_ = mark;
+    last_ = SIZE_MAX;
+}
+
+json_arena_pool::json_arena_pool(size_t count, size_t size, uint32_t caps)
+    : count_(count), size_(size), caps_(caps)
+{
+}
+
+json_arena *json_arena_pool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (available_.empty() && arenas_.size() < count_)
+    {
+        arenas_.emplace_back(new json_arena(size_, caps_));
+        available_.push_back(arenas_.back().get());
+    }
+
+    if (available_.empty())
+        return nullptr;
+
+    auto arena = available_.back();
+    available_.pop_back();
+    return arena;
+}
+
+void json_arena_pool::release(json_arena *arena)
+{
+    arena->reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    available_.push_back(arena);
+}
+
+size_t json_arena_pool::high_water_mark()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t high_water_mark = 0;
+    for (const auto &arena : arenas_)
+        high_water_mark = std::max(high_water_mark, arena->high_water_mark());
+
+    return high_water_mark;
+}
+
+size_t json_arena_pool::overflows()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t overflows = 0;
+    for (const auto &arena : arenas_)
+        overflows += arena->overflows();
+
+    return overflows;
+}
+
+json_arena_pool::lease::lease(json_arena_pool &pool)
+    : pool_(pool), arena_(pool.acquire())
+{
+}
+
+json_arena_pool::lease::~lease()
+{
+    if (arena_)
+        pool_.release(arena_);
+}
+
+ArduinoJson::Allocator *json_arena_pool::lease::allocator() const
+{
+    return arena_ ? static_cast<ArduinoJson::Allocator *>(arena_) : json_heap_allocator();
+}
+
+ArduinoJson::Allocator *json_heap_allocator()
+{
+    class heap_allocator : public ArduinoJson::Allocator
+    {
+    public:
+        void *allocate(size_t size) override
+        {
+            return malloc(size);
+        }
+        void deallocate(void *pointer) override
+        {
+            free(pointer);
+        }
+        void *reallocate(void *pointer, size_t new_size) override
+        {
+            return realloc(pointer, new_size);
+        }
+    };
+
+    static heap_allocator allocator;
+    return &allocator;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bump allocator for the JSON documents of a request. Allocations take the next free bytes of a fixed block, freeing is
+// a no-op (except for the last allocation) and reset() releases everything at once. When the block is full, the heap is used.
+// The block is allocated with heap_caps_malloc, so it can be placed in internal RAM or PSRAM.
+class json_arena : public ArduinoJson::Allocator
+{
+public:
+    json_arena(size_t size, uint32_t caps);
+    json_arena(const json_arena &) = delete;
+    json_arena &operator=(const json_arena &) = delete;
+    ~json_arena();
+
+    void *allocate(size_t size) override;
+    void deallocate(void *pointer) override;
+    void *reallocate(void *pointer, size_t new_size) override;
+
+    // Releases all allocations in the block. The documents using the arena must have been destroyed
+    void reset();
+    // Position in the block; rewind() releases the allocations made after it (the documents holding them must have
+    // been cleared), so a document can be reused in a loop without using up the block
+    size_t mark() const
+    {
+        return used_;
+    }
+    void rewind(size_t mark);
+
+    // Maximum number of bytes used in the block and number of allocations that did not fit
+    size_t high_water_mark() const
+    {
+        return high_water_mark_;
+    }
+    size_t overflows() const
+    {
+        return overflows_;
+    }
+
+private:
+    bool contains(const void *pointer) const
+    {
+        return pointer >= block_ && pointer < block_ + size_;
+    }
+
+    size_t size_;
+    uint32_t caps_;
+    uint8_t *block_ = nullptr;
+    size_t used_ = 0;
+    // Start of the last allocation (header), for freeing or growing it in place
+    size_t last_ = SIZE_MAX;
+    size_t high_water_mark_ = 0;
+    size_t overflows_ = 0;
+};
+
+// Arenas for the requests that are handled concurrently
+class json_arena_pool
+{
+public:
+    json_arena_pool(size_t count, size_t size, uint32_t caps);
+
+    // Arena of a request. Returns the arena to the pool and resets it when destroyed
+    class lease
+    {
+    public:
+        lease(json_arena_pool &pool);
+        lease(const lease &) = delete;
+        lease &operator=(const lease &) = delete;
+        ~lease();
+
+        // Allocator for the documents of the request: the arena or the heap when none is available
+        ArduinoJson::Allocator *allocator() const;
+        // The arena or nullptr when none is available
+        json_arena *arena() const
+        {
+            return arena_;
+        }
+
+    private:
+        json_arena_pool &pool_;
+        json_arena *arena_;
+    };
+
+    // Maximum of the high water marks and total number of overflows of the arenas
+    size_t high_water_mark();
+    size_t overflows();
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    json_arena *acquire();
+    void release(json_arena *arena);
+
+    size_t count_;
+    size_t size_;
+    uint32_t caps_;
+    std::mutex mutex_;
+    // Created at first use (PSRAM is not available while global objects are constructed)
+    std::vector<std::unique_ptr<json_arena>> arenas_;
+    std::vector<json_arena *> available_;
+};
+
+// Allocator that uses the heap (malloc)
+ArduinoJson::Allocator *json_heap_allocator();
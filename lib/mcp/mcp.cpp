@@ -1,40 +1,81 @@
 #include "mcp.h"
 
+#include <algorithm>
+#include <StreamString.h>
+#include <metrics.h>
+
+#ifdef ENABLE_GZIP
+#include <miniz.h>
+#endif
+
 mcp_exception::mcp_exception(error_code code, const String &message)
     : std::runtime_error(message.c_str()), code_(code)
 {
 }
 
-mcp_request::mcp_request(const String &request)
+mcp_request::mcp_request(JsonVariant request)
     : jsonrpc_("2.0")
 {
-    auto error = deserializeJson(doc_, request);
+    if (!request.is<JsonObject>())
+        throw mcp_exception(error_code::invalid_request, "Invalid request");
+
+    auto object = request.as<JsonObject>();
+    if (object["jsonrpc"].is<String>())
+        jsonrpc_ = object["jsonrpc"].as<JsonString>();
+
+    if (object["id"].is<JsonVariant>())
+    {
+        id_ = object["id"];
+        notification_ = false;
+    }
+
+    if (object["method"].is<String>())
+        method_ = object["method"].as<JsonString>();
+
+    if (object["params"].is<JsonObject>())
+        params_ = object["params"].as<JsonObject>();
+}
+
+mcp_message::mcp_message(const char *message, size_t length, ArduinoJson::Allocator *allocator /*= json_heap_allocator()*/)
+    : doc_(allocator)
+{
+    auto error = deserializeJson(doc_, message, length);
     if (error)
         throw mcp_exception(error_code::parse_error, "Failed to parse JSON request: " + String(error.c_str()));
 
-    if (doc_.is<JsonObject>())
-    {
-        auto request = doc_.as<JsonObject>();
-        if (request["jsonrpc"].is<String>())
-            jsonrpc_ = request["jsonrpc"].as<String>();
+    if (is_batch() && doc_.size() == 0)
+        throw mcp_exception(error_code::invalid_request, "Empty batch");
+}
 
-        if (request["id"].is<JsonVariant>())
-            id_ = request["id"];
+size_t mcp_message::size() const
+{
+    return is_batch() ? doc_.size() : 1;
+}
 
-        if (request["method"].is<String>())
-            method_ = request["method"].as<String>();
+mcp_request mcp_message::operator[](size_t index)
+{
+    return mcp_request(is_batch() ? doc_[index] : doc_.as<JsonVariant>());
+}
 
-        if (request["params"].is<JsonObject>())
-            params_ = request["params"].as<JsonObject>();
-    }
+mcp_response::mcp_response(ArduinoJson::Allocator *allocator /*= json_heap_allocator()*/, const String &jsonrpc /*= "2.0"*/)
+    : doc_(allocator)
+{
+    root_ = doc_.to<JsonObject>();
+    root_["jsonrpc"] = jsonrpc;
 }
 
-mcp_response::mcp_response(const String &jsonrpc /*= "2.0"*/)
+mcp_response::mcp_response(json_arena *arena, const String &jsonrpc /*= "2.0"*/)
+    : doc_(arena ? static_cast<ArduinoJson::Allocator *>(arena) : json_heap_allocator()), arena_(arena), mark_(arena ? arena->mark() : 0)
 {
     root_ = doc_.to<JsonObject>();
     root_["jsonrpc"] = jsonrpc;
 }
 
+mcp_response::~mcp_response()
+{
+    release_attachments();
+}
+
 mcp_response &mcp_response::set_id(const JsonVariant &id)
 {
     root_["id"] = id;
@@ -43,6 +84,10 @@ mcp_response &mcp_response::set_id(const JsonVariant &id)
 
 JsonObject mcp_response::create_error()
 {
+    // The id of a request that could not be read is null
+    if (root_["id"].isNull())
+        root_["id"] = nullptr;
+
     return root_["error"].to<JsonObject>();
 }
 
@@ -51,18 +96,261 @@ JsonObject mcp_response::create_result()
     return root_["result"].to<JsonObject>();
 }
 
-std::tuple<int, const char *, String> mcp_response::get_http_response() const
+void mcp_response::attach_base64(JsonObject object, const char *key, const uint8_t *data, size_t length, std::function<void()> release /*= nullptr*/)
+{
+    // Placeholder is replaced by the encoded data when writing
+    auto placeholder = "@mcp-attachment-" + String(attachments_.size()) + "@";
+    object[key] = placeholder;
+    attachments_.push_back({placeholder, data, length, release, nullptr});
+}
+
+void mcp_response::attach_base64(JsonObject object, const char *key, const uint8_t *data, size_t length, const char *encoded, std::function<void()> release)
+{
+    attach_base64(object, key, data, length, release);
+    attachments_.back().encoded = encoded;
+}
+
+void mcp_response::reset()
+{
+    release_attachments();
+    auto jsonrpc = root_["jsonrpc"].as<String>();
+    doc_.clear();
+    // The document holds nothing in the arena any more
+    if (arena_)
+        arena_->rewind(mark_);
+
+    root_ = doc_.to<JsonObject>();
+    root_["jsonrpc"] = jsonrpc;
+}
+
+void mcp_response::release_attachments()
+{
+    for (auto &attachment : attachments_)
+        if (attachment.release)
+            attachment.release();
+
+    attachments_.clear();
+}
+
+size_t mcp_response::length() const
+{
+    auto length = measureJson(doc_);
+    for (const auto &attachment : attachments_)
+        length -= attachment.placeholder.length();
+
+    return length + attachments_length();
+}
+
+size_t mcp_response::attachments_length() const
+{
+    size_t length = 0;
+    for (const auto &attachment : attachments_)
+        length += base64_encoded_length(attachment.length);
+
+    return length;
+}
+
+int mcp_response::http_code() const
+{
+    return root_["error"].is<JsonObject>() ? 400 : 200; // If error is present, return 400 Bad Request, else 200 OK
+}
+
+size_t mcp_response::write_to(Print &output)
+{
+    return write_to(output, nullptr);
+}
+
+size_t mcp_response::write_to(Print &output, const binary_writer &binary)
 {
+    if (attachments_.empty())
+    {
+        // Includes writing to the output
+        stage_timer timer(metric_stage::serialize);
+        return serializeJson(doc_, output);
+    }
+
+    // Serialize the envelope with the (short) placeholders and locate them
+    stage_timer serialize_timer(metric_stage::serialize);
     String json;
+    serializeJson(doc_, json);
+
+    std::vector<std::pair<int, const attachment *>> positions;
+    for (const auto &attachment : attachments_)
+    {
+        auto position = json.indexOf(attachment.placeholder);
+        if (position >= 0)
+            positions.emplace_back(position, &attachment);
+    }
+
+    std::sort(positions.begin(), positions.end(), [](const std::pair<int, const attachment *> &a, const std::pair<int, const attachment *> &b)
+              { return a.first < b.first; });
+    serialize_timer.stop();
+
+    size_t written = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        const auto &position = positions[i];
+        written += output.write(reinterpret_cast<const uint8_t *>(json.c_str()) + offset, position.first - offset);
+        offset = position.first + position.second->placeholder.length();
+        if (binary)
+        {
+            // Reference to the binary message sent after the response
+            written += output.print("binary:" + String(i));
+            continue;
+        }
+
+        if (position.second->encoded)
+        {
+            written += output.write(reinterpret_cast<const uint8_t *>(position.second->encoded), base64_encoded_length(position.second->length));
+            continue;
+        }
+
+        // Encode the data in chunks straight into the output; the time spent encoding excludes writing
+        unsigned long encode_time = 0;
+        written += base64_encode(position.second->data, position.second->length, output, &encode_time);
+        metric_histogram(metric_stage::encode).record(encode_time);
+    }
+
+    written += output.write(reinterpret_cast<const uint8_t *>(json.c_str()) + offset, json.length() - offset);
+    if (binary)
+        for (const auto &position : positions)
+            binary(position.second->data, position.second->length);
+
+    // The data is no longer needed
+    release_attachments();
+    return written;
+}
+
+std::tuple<int, const char *, String> mcp_response::get_http_response()
+{
+    StreamString json;
     try
     {
-        serializeJson(doc_, json);
+        write_to(json);
     }
     catch (const std::exception &e)
     {
         return {500, "text/plain", String("Internal Server Error: ") + String(e.what())}; // Internal Server Error
     }
 
-    auto http_code = root_["error"].is<JsonObject>() ? 400 : 200; // If error is present, return 400 Bad Request, else 200 OK
-    return {http_code, "application/json", json};                 // OK
+    return {http_code(), "application/json", json}; // OK
+}
+
+// Response suffix after the result
+static const char cached_result_suffix[] = "}";
+
+mcp_cached_result::mcp_cached_result(std::function<void(JsonObject result)> build)
+    : build_(build)
+{
+}
+
+void mcp_cached_result::prepare()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (prepared_)
+        return;
+
+    JsonDocument doc;
+    build_(doc.to<JsonObject>());
+    serializeJson(doc, json_);
+
+#ifdef ENABLE_GZIP
+    // Compress without zlib header or final block, so the blocks can be embedded between the blocks of the response
+    std::unique_ptr<tdefl_compressor, decltype(&free)> compressor(static_cast<tdefl_compressor *>(malloc(sizeof(tdefl_compressor))), &free);
+    if (compressor)
+    {
+        auto flags = tdefl_create_comp_flags_from_zip_params(MZ_DEFAULT_LEVEL, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+        tdefl_init(compressor.get(), [](const void *buffer, int length, void *user) -> mz_bool
+                   {
+                       auto output = static_cast<std::vector<uint8_t> *>(user);
+                       output->insert(output->end(), static_cast<const uint8_t *>(buffer), static_cast<const uint8_t *>(buffer) + length);
+                       return MZ_TRUE; }, &deflated_, flags);
+        if (tdefl_compress_buffer(compressor.get(), json_.c_str(), json_.length(), TDEFL_SYNC_FLUSH) != TDEFL_STATUS_OKAY)
+            deflated_.clear();
+    }
+#endif
+
+    prepared_ = true;
+}
+
+String mcp_cached_result::prefix(const String &id) const
+{
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"result\":";
+}
+
+bool mcp_cached_result::can_deflate()
+{
+    prepare();
+#ifdef ENABLE_GZIP
+    return !deflated_.empty();
+#else
+    return false;
+#endif
 }
+
+#ifdef ENABLE_GZIP
+// Largest length of a stored deflate block
+constexpr size_t STORED_BLOCK_MAX_LENGTH = 65535;
+
+// Length of data written as stored blocks: a 5 byte header per block (at least one block)
+static size_t stored_blocks_length(size_t length)
+{
+    return length + 5 * std::max<size_t>(1, (length + STORED_BLOCK_MAX_LENGTH - 1) / STORED_BLOCK_MAX_LENGTH);
+}
+
+// Writes data as stored (uncompressed) deflate blocks of at most STORED_BLOCK_MAX_LENGTH bytes. If final, the last
+// block is the final block of the stream
+static size_t write_stored_blocks(Print &output, const char *data, size_t length, bool final)
+{
+    size_t written = 0;
+    do
+    {
+        auto block_length = static_cast<uint16_t>(std::min(length, STORED_BLOCK_MAX_LENGTH));
+        length -= block_length;
+        uint8_t header[] = {static_cast<uint8_t>(final && !length ? 1 : 0), static_cast<uint8_t>(block_length), static_cast<uint8_t>(block_length >> 8), static_cast<uint8_t>(~block_length), static_cast<uint8_t>(~block_length >> 8)};
+        written += output.write(header, sizeof(header)) + output.write(reinterpret_cast<const uint8_t *>(data), block_length);
+        data += block_length;
+    } while (length);
+
+    return written;
+}
+#endif
+
+size_t mcp_cached_result::length(const String &id, bool deflated)
+{
+    prepare();
+    auto prefix_length = prefix(id).length();
+#ifdef ENABLE_GZIP
+    if (deflated && !deflated_.empty())
+        // zlib header, stored blocks with the prefix, the deflated result, final stored block with the suffix and the adler32 checksum
+        return 2 + stored_blocks_length(prefix_length) + deflated_.size() + stored_blocks_length(sizeof(cached_result_suffix) - 1) + 4;
+#endif
+    return prefix_length + json_.length() + sizeof(cached_result_suffix) - 1;
+}
+
+size_t mcp_cached_result::write_to(Print &output, const String &id, bool deflated)
+{
+    prepare();
+    auto response_prefix = prefix(id);
+#ifdef ENABLE_GZIP
+    if (deflated && !deflated_.empty())
+    {
+        const uint8_t zlib_header[] = {0x78, 0x9c};
+        auto written = output.write(zlib_header, sizeof(zlib_header));
+        // The id is part of the prefix, so it can be longer than a stored block
+        written += write_stored_blocks(output, response_prefix.c_str(), response_prefix.length(), false);
+        written += output.write(deflated_.data(), deflated_.size());
+        written += write_stored_blocks(output, cached_result_suffix, sizeof(cached_result_suffix) - 1, true);
+
+        auto adler = mz_adler32(MZ_ADLER32_INIT, reinterpret_cast<const uint8_t *>(response_prefix.c_str()), response_prefix.length());
+        adler = mz_adler32(adler, reinterpret_cast<const uint8_t *>(json_.c_str()), json_.length());
+        adler = mz_adler32(adler, reinterpret_cast<const uint8_t *>(cached_result_suffix), sizeof(cached_result_suffix) - 1);
+        const uint8_t zlib_trailer[] = {static_cast<uint8_t>(adler >> 24), static_cast<uint8_t>(adler >> 16), static_cast<uint8_t>(adler >> 8), static_cast<uint8_t>(adler)};
+        written += output.write(zlib_trailer, sizeof(zlib_trailer));
+        return written;
+    }
+#endif
+
+    return output.print(response_prefix) + output.print(json_) + output.print(cached_result_suffix);
+}
\ No newline at end of file
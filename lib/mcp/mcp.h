@@ -3,6 +3,13 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "base64_codec.h"
+#include "json_arena.h"
+
 enum error_code
 {
     parse_error = -32700,        // Invalid JSON
@@ -27,12 +34,14 @@ private:
     error_code code_;
 };
 
+// Single JSON-RPC request. The members are views on the parsed mcp_message; valid as long as the message exists
 class mcp_request
 {
 public:
-    mcp_request(const String &request);
+    // Throws an mcp_exception if the request is not an object
+    explicit mcp_request(JsonVariant request);
 
-    const String &jsonrpc() const
+    JsonString jsonrpc() const
     {
         return jsonrpc_;
     }
@@ -40,7 +49,7 @@ public:
     {
         return id_;
     }
-    const String &method() const
+    JsonString method() const
     {
         return method_;
     }
@@ -48,26 +57,129 @@ public:
     {
         return params_;
     }
+    // Notifications have no id and receive no response
+    bool is_notification() const
+    {
+        return notification_;
+    }
 
 private:
-    JsonDocument doc_;
-    String jsonrpc_;
+    JsonString jsonrpc_;
     JsonVariant id_;
-    String method_;
+    JsonString method_;
     JsonObject params_;
+    bool notification_ = true;
+};
+
+// Parsed JSON-RPC message: a single request or a batch (array) of requests
+class mcp_message
+{
+public:
+    // Parses the message straight from the (request) buffer. Throws an mcp_exception if the message is not valid JSON or an empty batch
+    mcp_message(const char *message, size_t length, ArduinoJson::Allocator *allocator = json_heap_allocator());
+
+    bool is_batch() const
+    {
+        return doc_.is<JsonArray>();
+    }
+    // Number of requests (1 if not a batch)
+    size_t size() const;
+    // Throws an mcp_exception if the request is invalid
+    mcp_request operator[](size_t index);
+
+private:
+    JsonDocument doc_;
 };
 
 struct mcp_response
 {
-    mcp_response(const String &jsonrpc = "2.0");
+    explicit mcp_response(ArduinoJson::Allocator *allocator = json_heap_allocator(), const String &jsonrpc = "2.0");
+    // Response in arena (the heap if nullptr) that reset() rewinds to where it started, so reusing it for many
+    // requests does not fill the arena. Nothing else may allocate from the arena while the response exists
+    explicit mcp_response(json_arena *arena, const String &jsonrpc = "2.0");
+    mcp_response(const mcp_response &) = delete;
+    mcp_response &operator=(const mcp_response &) = delete;
+    ~mcp_response();
 
     mcp_response &set_id(const JsonVariant &id);
+    // Without an id set, the error response has id null (JSON-RPC: the id of the request could not be determined)
     JsonObject create_error();
     JsonObject create_result();
 
-    std::tuple<int, const char*, String> get_http_response() const;
+    // Sets object[key] to the base64 encoding of data without encoding it in memory.
+    // The data is encoded in chunks while the response is written; release is called once the data is no longer used.
+    void attach_base64(JsonObject object, const char *key, const uint8_t *data, size_t length, std::function<void()> release = nullptr);
+    // Same, with the base64 encoding of data already available: encoded is written as is
+    void attach_base64(JsonObject object, const char *key, const uint8_t *data, size_t length, const char *encoded, std::function<void()> release);
+    bool has_attachments() const
+    {
+        return !attachments_.empty();
+    }
+
+    // Clears the response so the document can be reused for the next request (of a batch). The memory of the
+    // document is reused as well when it is in its own arena
+    void reset();
+
+    // Length of the JSON response including the encoded attachments, and of the encoded attachments only
+    size_t length() const;
+    size_t attachments_length() const;
+
+    int http_code() const;
+    // Writes the JSON response to output, encoding the attachments on the fly. Returns the number of bytes written
+    size_t write_to(Print &output);
+
+    using binary_writer = std::function<void(const uint8_t *data, size_t length)>;
+    // Writes the JSON response with the attachments replaced by the references "binary:0", "binary:1", ... (in the
+    // order of the response) and then passes the raw attachments to binary in that order. Returns the JSON bytes written
+    size_t write_to(Print &output, const binary_writer &binary);
+
+    std::tuple<int, const char*, String> get_http_response();
 
 private:
+    struct attachment
+    {
+        String placeholder;
+        const uint8_t *data;
+        size_t length;
+        std::function<void()> release;
+        // Encoding of data (base64_encoded_length(length) characters) or nullptr
+        const char *encoded;
+    };
+
+    void release_attachments();
+
     JsonDocument doc_;
     JsonObject root_;
+    std::vector<attachment> attachments_;
+    // Arena rewound to mark_ by reset() (or nullptr)
+    json_arena *arena_ = nullptr;
+    size_t mark_ = 0;
+};
+
+// Result that never changes. It is built and serialized once (at first use) and sent with the request id spliced in.
+// With ENABLE_GZIP, a deflated copy is kept as well, so compressed responses need no compression at request time.
+class mcp_cached_result
+{
+public:
+    explicit mcp_cached_result(std::function<void(JsonObject result)> build);
+
+    // True if a deflated copy is available
+    bool can_deflate();
+
+    // Length and contents of the complete JSON-RPC response; id is the serialized request id
+    size_t length(const String &id, bool deflated);
+    size_t write_to(Print &output, const String &id, bool deflated);
+
+private:
+    void prepare();
+    String prefix(const String &id) const;
+
+    std::function<void(JsonObject result)> build_;
+    std::mutex mutex_;
+    bool prepared_ = false;
+    String json_;
+#ifdef ENABLE_GZIP
+    // Raw deflate blocks of json_, ending on a byte boundary (sync flush)
+    std::vector<uint8_t> deflated_;
+#endif
 };
\ No newline at end of file
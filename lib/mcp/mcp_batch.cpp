@@ -0,0 +1,83 @@
+#include "mcp_batch.h"
+
+#include <metrics.h>
+
+mcp_batch::mcp_batch(mcp_handler handler, work_queue &handlers, mcp_cached_result *tools_list /*= nullptr*/)
+    : handler_(handler), handlers_(handlers), tools_list_(tools_list)
+{
+}
+
+size_t mcp_batch::write(mcp_message &message, json_arena *first, json_arena *second, Print &output, std::function<void()> begin)
+{
+    // Two responses in turn: one is sent while the next one is made
+    entry first_entry(first), second_entry(second);
+    entry *entries[] = {&first_entry, &second_entry};
+
+    size_t count = 0;
+    auto handled = handlers_.submit([&]()
+                                    { handle(message, 0, first_entry); });
+    for (size_t i = 0; i < message.size(); i++)
+    {
+        handled->wait();
+        auto &current = *entries[i % 2];
+        if (i + 1 < message.size())
+            handled = handlers_.submit([this, &message, &entries, i]()
+                                       { handle(message, i + 1, *entries[(i + 1) % 2]); });
+
+        // Notifications are not answered
+        if (!current.answered)
+            continue;
+
+        if (count++ == 0)
+        {
+            begin();
+            output.print('[');
+        }
+        else
+            output.print(',');
+
+        if (!current.tools_list_id.isEmpty())
+        {
+            metric_increment(metric_counter::response_bytes, tools_list_->write_to(output, current.tools_list_id, false));
+            continue;
+        }
+
+        if (current.response.http_code() != 200)
+            metric_increment(metric_counter::errors);
+
+        metric_increment(metric_counter::response_bytes, current.response.write_to(output));
+    }
+
+    if (count > 0)
+        output.print(']');
+
+    log_d("Sent batch response: %u of %u requests answered", static_cast<unsigned>(count), static_cast<unsigned>(message.size()));
+    return count;
+}
+
+void mcp_batch::handle(mcp_message &message, size_t index, entry &result)
+{
+    result.response.reset();
+    result.answered = true;
+    result.tools_list_id = "";
+    try
+    {
+        // Throws for an entry that is not a request object; the error has id null
+        auto request = message[index];
+        result.answered = !request.is_notification();
+        result.response.set_id(request.id());
+        if (tools_list_ && request.method() == "tools/list" && result.answered)
+        {
+            serializeJson(request.id(), result.tools_list_id);
+            return;
+        }
+
+        handler_(request, result.response);
+    }
+    catch (const mcp_exception &e)
+    {
+        auto error = result.response.create_error();
+        error["code"] = e.code();
+        error["message"] = e.what();
+    }
+}
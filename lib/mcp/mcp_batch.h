@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <work_queue.h>
+
+#include <functional>
+
+#include "json_arena.h"
+#include "mcp.h"
+
+// Answers one request: the result or error is written to response. May throw an mcp_exception
+using mcp_handler = std::function<void(const mcp_request &request, mcp_response &response)>;
+
+// JSON-RPC batches: the requests are handled one ahead of sending on a work queue (the other core), so the next request
+// is handled while the response to the previous one is sent
+class mcp_batch
+{
+public:
+    // tools/list is answered with the precomputed tools_list (if set) instead of calling handler
+    mcp_batch(mcp_handler handler, work_queue &handlers, mcp_cached_result *tools_list = nullptr);
+
+    // Streams the responses as one array to output; begin is called before the first response. Notifications are not
+    // answered; invalid requests get an error with id null. The two responses that are made and sent in turn are
+    // allocated from first and second (the heap if nullptr), which are rewound for every request, so nothing else may
+    // allocate from them meanwhile. Returns the number of responses
+    size_t write(mcp_message &message, json_arena *first, json_arena *second, Print &output, std::function<void()> begin);
+
+private:
+    // Request handled ahead of sending: the response, or the id for the precomputed tools/list result
+    struct entry
+    {
+        explicit entry(json_arena *arena)
+            : response(arena)
+        {
+        }
+
+        mcp_response response;
+        bool answered = true;
+        String tools_list_id;
+    };
+
+    void handle(mcp_message &message, size_t index, entry &result);
+
+    mcp_handler handler_;
+    work_queue &handlers_;
+    mcp_cached_result *tools_list_;
+};
@@ -0,0 +1,176 @@
+#include "mcp_tools.h"
+
+#include <cmath>
+
+static const char *type_name(mcp_param_type type)
+{
+    switch (type)
+    {
+    case mcp_param_type::string:
+        return "string";
+    case mcp_param_type::integer:
+        return "integer";
+    case mcp_param_type::number:
+        return "number";
+    case mcp_param_type::boolean:
+        return "boolean";
+    case mcp_param_type::object:
+        return "object";
+    }
+
+    return "";
+}
+
+static bool has_type(JsonVariant value, mcp_param_type type)
+{
+    switch (type)
+    {
+    case mcp_param_type::string:
+        return value.is<const char *>();
+    case mcp_param_type::integer:
+        return value.is<long>();
+    case mcp_param_type::number:
+        return value.is<double>();
+    case mcp_param_type::boolean:
+        return value.is<bool>();
+    case mcp_param_type::object:
+        return value.is<JsonObject>();
+    }
+
+    return false;
+}
+
+const mcp_tool *mcp_tool_registry::find(const char *name) const
+{
+    size_t low = 0;
+    size_t high = count_;
+    while (low < high)
+    {
+        auto middle = (low + high) / 2;
+        auto compare = strcmp(name, tools_[middle].name);
+        if (compare == 0)
+            return &tools_[middle];
+
+        if (compare < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return nullptr;
+}
+
+void mcp_tool_registry::call(const char *name, JsonObject arguments, mcp_response &response) const
+{
+    if (!name || *name == '\0')
+        throw mcp_exception(error_code::invalid_request, "Tool name is required");
+
+    auto tool = find(name);
+    if (!tool)
+        throw mcp_exception(error_code::method_not_found, "Unknown tool: " + String(name));
+
+    validate(tool->params, tool->param_count, arguments);
+    tool->handler(arguments, response);
+}
+
+void mcp_tool_registry::validate(const mcp_param *params, size_t count, JsonObject arguments)
+{
+    // No additional properties
+    for (auto argument : arguments)
+    {
+        auto known = false;
+        for (size_t i = 0; i < count && !known; i++)
+            known = argument.key() == params[i].name;
+
+        if (!known)
+            throw mcp_exception(error_code::invalid_params, "Unknown argument: " + String(argument.key().c_str()));
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto &param = params[i];
+        auto value = arguments[param.name];
+        if (value.isNull())
+        {
+            if (param.required)
+                throw mcp_exception(error_code::invalid_params, "Missing argument: " + String(param.name));
+
+            continue;
+        }
+
+        if (!has_type(value, param.type))
+            throw mcp_exception(error_code::invalid_params, "Argument " + String(param.name) + " must be of type " + type_name(param.type));
+
+        if (param.allowed)
+        {
+            auto allowed = false;
+            for (auto option = param.allowed; *option && !allowed; option++)
+                allowed = strcmp(value.as<const char *>(), *option) == 0;
+
+            if (!allowed)
+                throw mcp_exception(error_code::invalid_params, "Invalid value for argument " + String(param.name));
+        }
+
+        if ((!std::isnan(param.minimum) && value.as<double>() < param.minimum) || (!std::isnan(param.maximum) && value.as<double>() > param.maximum))
+            throw mcp_exception(error_code::invalid_params, "Argument " + String(param.name) + " is out of range");
+
+        if (param.properties)
+            validate(param.properties, param.property_count, value.as<JsonObject>());
+    }
+}
+
+// Adds the properties and required list of an object schema
+static void add_properties(JsonObject schema, const mcp_param *params, size_t count)
+{
+    schema["type"] = "object";
+    auto properties = schema["properties"].to<JsonObject>();
+    JsonArray required;
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto &param = params[i];
+        auto property = properties[param.name].to<JsonObject>();
+        property["type"] = type_name(param.type);
+        property["description"] = param.description;
+        if (param.allowed)
+        {
+            auto values = property["enum"].to<JsonArray>();
+            for (auto option = param.allowed; *option; option++)
+                values.add(*option);
+        }
+
+        if (!std::isnan(param.minimum))
+            property["minimum"] = param.minimum;
+        if (!std::isnan(param.maximum))
+            property["maximum"] = param.maximum;
+        if (param.default_string)
+            property["default"] = param.default_string;
+        else if (!std::isnan(param.default_number))
+            property["default"] = param.default_number;
+
+        if (param.properties)
+            add_properties(property, param.properties, param.property_count);
+
+        if (param.required)
+        {
+            if (required.isNull())
+                required = schema["required"].to<JsonArray>();
+
+            required.add(param.name);
+        }
+    }
+
+    schema["additionalProperties"] = false;
+}
+
+void mcp_tool_registry::build_list(JsonObject result) const
+{
+    auto tools = result["tools"].to<JsonArray>();
+    for (size_t i = 0; i < count_; i++)
+    {
+        const auto &tool = tools_[i];
+        auto tool_object = tools.add<JsonObject>();
+        tool_object["name"] = tool.name;
+        tool_object["description"] = tool.description;
+        add_properties(tool_object["inputSchema"].to<JsonObject>(), tool.params, tool.param_count);
+    }
+}
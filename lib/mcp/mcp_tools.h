@@ -0,0 +1,124 @@
+#pragma once
+
+#include <limits>
+
+#include "mcp.h"
+
+// Declarative tool definitions. A tool is declared once (in flash) with its typed parameters; the JSON schema for
+// tools/list is generated from the declaration and arguments are validated before the handler is called.
+
+enum class mcp_param_type
+{
+    string,
+    integer,
+    number,
+    boolean,
+    object
+};
+
+// Marks an unset number (minimum, maximum or default)
+constexpr double mcp_unset = std::numeric_limits<double>::quiet_NaN();
+
+struct mcp_param
+{
+    const char *name;
+    mcp_param_type type;
+    const char *description;
+    bool required;
+    // Strings: allowed values (nullptr terminated, nullptr = any) and the default (nullptr = none)
+    const char *const *allowed;
+    const char *default_string;
+    // Numbers: range and default (mcp_unset = none)
+    double minimum;
+    double maximum;
+    double default_number;
+    // Objects: properties
+    const mcp_param *properties;
+    size_t property_count;
+};
+
+constexpr mcp_param mcp_string(const char *name, const char *description, const char *const *allowed = nullptr, const char *default_value = nullptr, bool required = false)
+{
+    return {name, mcp_param_type::string, description, required, allowed, default_value, mcp_unset, mcp_unset, mcp_unset, nullptr, 0};
+}
+
+constexpr mcp_param mcp_number(const char *name, const char *description, double minimum = mcp_unset, double maximum = mcp_unset, double default_value = mcp_unset, bool required = false)
+{
+    return {name, mcp_param_type::number, description, required, nullptr, nullptr, minimum, maximum, default_value, nullptr, 0};
+}
+
+constexpr mcp_param mcp_integer(const char *name, const char *description, double minimum = mcp_unset, double maximum = mcp_unset, double default_value = mcp_unset, bool required = false)
+{
+    return {name, mcp_param_type::integer, description, required, nullptr, nullptr, minimum, maximum, default_value, nullptr, 0};
+}
+
+constexpr mcp_param mcp_boolean(const char *name, const char *description, bool required = false)
+{
+    return {name, mcp_param_type::boolean, description, required, nullptr, nullptr, mcp_unset, mcp_unset, mcp_unset, nullptr, 0};
+}
+
+template <size_t N>
+constexpr mcp_param mcp_object(const char *name, const char *description, const mcp_param (&properties)[N], bool required = false)
+{
+    return {name, mcp_param_type::object, description, required, nullptr, nullptr, mcp_unset, mcp_unset, mcp_unset, properties, N};
+}
+
+using mcp_tool_handler = void (*)(JsonObject arguments, mcp_response &response);
+
+struct mcp_tool
+{
+    const char *name;
+    const char *description;
+    const mcp_param *params;
+    size_t param_count;
+    mcp_tool_handler handler;
+};
+
+template <size_t N>
+constexpr mcp_tool mcp_define_tool(const char *name, const char *description, mcp_tool_handler handler, const mcp_param (&params)[N])
+{
+    return {name, description, params, N, handler};
+}
+
+constexpr mcp_tool mcp_define_tool(const char *name, const char *description, mcp_tool_handler handler)
+{
+    return {name, description, nullptr, 0, handler};
+}
+
+constexpr int mcp_compare(const char *a, const char *b)
+{
+    return *a != *b || *a == '\0' ? static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b) : mcp_compare(a + 1, b + 1);
+}
+
+// True if the tools are sorted by name (required for the lookup)
+template <size_t N>
+constexpr bool mcp_sorted(const mcp_tool (&tools)[N], size_t index = 1)
+{
+    return index >= N || (mcp_compare(tools[index - 1].name, tools[index].name) < 0 && mcp_sorted(tools, index + 1));
+}
+
+// Table of tools sorted by name; lookup is a binary search
+class mcp_tool_registry
+{
+public:
+    template <size_t N>
+    constexpr mcp_tool_registry(const mcp_tool (&tools)[N])
+        : tools_(tools), count_(N)
+    {
+    }
+
+    // Returns nullptr if not found
+    const mcp_tool *find(const char *name) const;
+
+    // Validates the arguments and calls the tool. Throws an mcp_exception if the tool is unknown or the arguments are invalid
+    void call(const char *name, JsonObject arguments, mcp_response &response) const;
+
+    // Builds the tools/list result
+    void build_list(JsonObject result) const;
+
+private:
+    static void validate(const mcp_param *params, size_t count, JsonObject arguments);
+
+    const mcp_tool *tools_;
+    size_t count_;
+};
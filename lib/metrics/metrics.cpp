@@ -0,0 +1,117 @@
+#include "metrics.h"
+
+const uint32_t latency_histogram::bounds[bucket_count - 1] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000};
+
+static const char *const stage_names[metric_stage_count] = {"parse", "dispatch", "grab", "encode", "serialize", "compress", "send"};
+
+static latency_histogram histograms[metric_stage_count];
+static std::atomic<uint32_t> counters[metric_counter_count] = {};
+
+void latency_histogram::record(uint32_t microseconds)
+{
+    size_t bucket = 0;
+    while (bucket < bucket_count - 1 && microseconds > bounds[bucket])
+        bucket++;
+
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(microseconds, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (microseconds > max && !max_.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+        ;
+}
+
+latency_histogram::snapshot latency_histogram::read() const
+{
+    // Not an atomic snapshot; the count is the sum of the buckets read so the percentiles are consistent
+    snapshot snapshot = {};
+    for (size_t i = 0; i < bucket_count; i++)
+    {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint32_t latency_histogram::snapshot::percentile(float percent) const
+{
+    if (count == 0)
+        return 0;
+
+    auto rank = percent / 100 * count;
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < bucket_count; i++)
+    {
+        if (buckets[i] > 0 && cumulative + buckets[i] >= rank)
+        {
+            // The maximum bounds the last bucket (and is a better estimate for any bucket it falls in)
+            auto lower = i > 0 ? bounds[i - 1] : 0;
+            auto upper = i < bucket_count - 1 ? std::min(bounds[i], max) : max;
+            if (upper <= lower)
+                return upper;
+
+            return lower + static_cast<uint32_t>((upper - lower) * ((rank - cumulative) / buckets[i]));
+        }
+
+        cumulative += buckets[i];
+    }
+
+    return max;
+}
+
+const char *metric_stage_name(metric_stage stage)
+{
+    return stage_names[static_cast<size_t>(stage)];
+}
+
+latency_histogram &metric_histogram(metric_stage stage)
+{
+    return histograms[static_cast<size_t>(stage)];
+}
+
+void metric_increment(metric_counter counter, uint32_t value /*= 1*/)
+{
+    counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+uint32_t metric_value(metric_counter counter)
+{
+    return counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+void write_metrics(Print &output)
+{
+    output.print("# HELP esp32cam_stage_duration_seconds Duration of the stages of handling a request\n"
+                 "# TYPE esp32cam_stage_duration_seconds histogram\n");
+    char line[128];
+    for (size_t stage = 0; stage < metric_stage_count; stage++)
+    {
+        auto snapshot = histograms[stage].read();
+        uint32_t cumulative = 0;
+        for (size_t i = 0; i < latency_histogram::bucket_count; i++)
+        {
+            cumulative += snapshot.buckets[i];
+            if (i < latency_histogram::bucket_count - 1)
+                snprintf(line, sizeof(line), "esp32cam_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %u\n", stage_names[stage], latency_histogram::bounds[i] / 1e6, static_cast<unsigned>(cumulative));
+            else
+                snprintf(line, sizeof(line), "esp32cam_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %u\n", stage_names[stage], static_cast<unsigned>(cumulative));
+
+            output.print(line);
+        }
+
+        snprintf(line, sizeof(line), "esp32cam_stage_duration_seconds_sum{stage=\"%s\"} %.6f\n", stage_names[stage], snapshot.sum / 1e6);
+        output.print(line);
+        snprintf(line, sizeof(line), "esp32cam_stage_duration_seconds_count{stage=\"%s\"} %u\n", stage_names[stage], static_cast<unsigned>(snapshot.count));
+        output.print(line);
+    }
+
+    snprintf(line, sizeof(line), "# TYPE esp32cam_requests_total counter\nesp32cam_requests_total %u\n", static_cast<unsigned>(metric_value(metric_counter::requests)));
+    output.print(line);
+    snprintf(line, sizeof(line), "# TYPE esp32cam_errors_total counter\nesp32cam_errors_total %u\n", static_cast<unsigned>(metric_value(metric_counter::errors)));
+    output.print(line);
+    snprintf(line, sizeof(line), "# TYPE esp32cam_response_bytes_total counter\nesp32cam_response_bytes_total %u\n", static_cast<unsigned>(metric_value(metric_counter::response_bytes)));
+    output.print(line);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+// Stages of handling a request. Stages may nest: send includes serialize, encode and compress, dispatch includes grab
+enum class metric_stage : uint8_t
+{
+    parse,     // Parsing the JSON-RPC request
+    dispatch,  // Running the method or tool
+    grab,      // Getting a frame from the camera (or the grab task)
+    encode,    // Base64 encoding of images
+    serialize, // Serializing the JSON response
+    compress,  // Deflate/gzip compression (without writing the compressed data)
+    send       // Writing the response
+};
+
+constexpr size_t metric_stage_count = 7;
+
+enum class metric_counter : uint8_t
+{
+    requests,      // MCP requests (a batch counts once)
+    errors,        // MCP responses with an error
+    response_bytes // Bytes of the MCP responses (before compression)
+};
+
+constexpr size_t metric_counter_count = 3;
+
+// Latency histogram with fixed buckets. Recording is lock free and does not allocate
+class latency_histogram
+{
+public:
+    static constexpr size_t bucket_count = 16;
+    // Upper bounds of the buckets in microseconds; the last bucket is unbounded
+    static const uint32_t bounds[bucket_count - 1];
+
+    struct snapshot
+    {
+        uint32_t buckets[bucket_count];
+        uint32_t count;
+        uint64_t sum;
+        uint32_t max;
+
+        // Estimated percentile (0-100) in microseconds, interpolated within the bucket
+        uint32_t percentile(float percent) const;
+    };
+
+    void record(uint32_t microseconds);
+    snapshot read() const;
+
+private:
+    std::atomic<uint32_t> buckets_[bucket_count] = {};
+    std::atomic<uint32_t> count_{0};
+    // Not lock free on the ESP32 (a short critical section), but without allocation
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint32_t> max_{0};
+};
+
+const char *metric_stage_name(metric_stage stage);
+latency_histogram &metric_histogram(metric_stage stage);
+
+void metric_increment(metric_counter counter, uint32_t value = 1);
+uint32_t metric_value(metric_counter counter);
+
+// Writes the histograms and counters in the Prometheus text format
+void write_metrics(Print &output);
+
+// Records the time from construction to stop() or destruction in the histogram of the stage
+class stage_timer
+{
+public:
+    explicit stage_timer(metric_stage stage)
+        : stage_(stage), start_(micros())
+    {
+    }
+    stage_timer(const stage_timer &) = delete;
+    stage_timer &operator=(const stage_timer &) = delete;
+    ~stage_timer()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (running_)
+            metric_histogram(stage_).record(micros() - start_);
+
+        running_ = false;
+    }
+
+private:
+    metric_stage stage_;
+    unsigned long start_;
+    bool running_ = true;
+};
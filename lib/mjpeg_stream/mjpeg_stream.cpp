@@ -0,0 +1,238 @@
+#include "mjpeg_stream.h"
+
+#include <lwip/sockets.h>
+
+// Decoding and encoding JPEG needs the larger stack
+constexpr auto ENCODE_TASK_STACK_SIZE = 8192;
+constexpr auto SEND_TASK_STACK_SIZE = 4096;
+constexpr auto STREAM_TASK_PRIORITY = 1;
+// Quality of downscaled frames (0-100)
+constexpr auto SCALED_QUALITY = 80;
+// Wait time when no client could send, or no new frame is available
+constexpr auto STREAM_IDLE_DELAY = 5; // ms
+
+bool mjpeg_stream::begin(frame_source source, BaseType_t encode_core, BaseType_t send_core)
+{
+    source_ = source;
+    if (xTaskCreatePinnedToCore(send_task, "mjpeg_send", SEND_TASK_STACK_SIZE, this, STREAM_TASK_PRIORITY, &send_task_, send_core) != pdPASS ||
+        xTaskCreatePinnedToCore(encode_task, "mjpeg_encode", ENCODE_TASK_STACK_SIZE, this, STREAM_TASK_PRIORITY, &encode_task_, encode_core) != pdPASS)
+    {
+        send_task_ = nullptr;
+        log_e("Unable to create the stream tasks");
+        return false;
+    }
+
+    return true;
+}
+
+bool mjpeg_stream::add_client(const WiFiClient &client, float max_fps, uint16_t max_width)
+{
+    if (!send_task_)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (client_count_ + pending_.size() >= max_clients)
+            return false;
+
+        client_state state = {};
+        state.client = client;
+        state.interval = max_fps > 0 ? static_cast<unsigned long>(1000 / max_fps) : 0;
+        state.max_width = max_width;
+        pending_.push_back(state);
+    }
+
+    xTaskNotifyGive(send_task_);
+    return true;
+}
+
+size_t mjpeg_stream::client_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return client_count_ + pending_.size();
+}
+
+uint8_t mjpeg_stream::scale_for(const client_state &state, uint16_t width)
+{
+    uint8_t scale = 0;
+    while (scale < 3 && state.max_width > 0 && (width >> scale) > state.max_width)
+        scale++;
+
+    return scale;
+}
+
+bool mjpeg_stream::send(client_state &state, bool &progress)
+{
+    auto fd = state.client.fd();
+    if (fd < 0)
+        return false;
+
+    const auto image_end = state.header_length + state.image->length;
+    const auto total = image_end + 2;
+    while (state.position < total)
+    {
+        const uint8_t *data;
+        size_t length;
+        if (state.position < state.header_length)
+        {
+            data = reinterpret_cast<const uint8_t *>(state.header) + state.position;
+            length = state.header_length - state.position;
+        }
+        else if (state.position < image_end)
+        {
+            data = state.image->data + state.position - state.header_length;
+            length = image_end - state.position;
+        }
+        else
+        {
+            data = reinterpret_cast<const uint8_t *>("\r\n") + state.position - image_end;
+            length = total - state.position;
+        }
+
+        auto sent = ::send(fd, data, length, MSG_DONTWAIT);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        state.position += sent;
+        progress = true;
+    }
+
+    // Frame complete
+    state.image.reset();
+    return true;
+}
+
+void mjpeg_stream::encode_task(void *parameter)
+{
+    auto stream = static_cast<mjpeg_stream *>(parameter);
+    uint32_t sequence = 0;
+    unsigned long last_frame = 0;
+    for (;;)
+    {
+        auto scales = stream->scales_.load();
+        if (!scales)
+        {
+            // Wait for a client
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // Not faster than the fastest client
+        auto elapsed = millis() - last_frame;
+        auto interval = stream->interval_.load();
+        if (elapsed < interval)
+        {
+            vTaskDelay(pdMS_TO_TICKS(interval - elapsed));
+            continue;
+        }
+
+        auto frame = stream->source_();
+        if (!frame || frame->sequence == sequence)
+        {
+            vTaskDelay(pdMS_TO_TICKS(STREAM_IDLE_DELAY));
+            continue;
+        }
+
+        sequence = frame->sequence;
+        last_frame = millis();
+        // Copy the frame so the frame buffer does not have to be held while sending
+        frame_set set = {sequence};
+        set.images[0] = copy_jpeg(frame->fb, sequence);
+        frame.reset();
+        if (!set.images[0])
+            continue;
+
+        const auto &image = *set.images[0];
+        for (uint8_t scale = 1; scale < 4; scale++)
+            if (scales & (1 << scale))
+                set.images[scale] = scale_jpeg(image.data, image.length, image.width, image.height, static_cast<jpg_scale_t>(scale), SCALED_QUALITY, sequence);
+
+        // When the queue is full, the send task is behind and still has newer frames than it can send
+        if (stream->encoded_.push(std::move(set)))
+            xTaskNotifyGive(stream->send_task_);
+    }
+}
+
+void mjpeg_stream::send_task(void *parameter)
+{
+    auto stream = static_cast<mjpeg_stream *>(parameter);
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex_);
+            for (auto &state : stream->pending_)
+                stream->clients_.push_back(state);
+
+            stream->pending_.clear();
+            stream->client_count_ = stream->clients_.size();
+        }
+
+        if (stream->clients_.empty())
+        {
+            // Stop encoding, release the images and wait for a client
+            stream->scales_ = 0;
+            stream->latest_ = {};
+            frame_set set;
+            while (stream->encoded_.pop(set))
+                ;
+
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // Only the newest encoded frame is of interest
+        frame_set set;
+        while (stream->encoded_.pop(set))
+            stream->latest_ = std::move(set);
+
+        // Tell the encode task what the clients need; before the first frame the width is unknown, so all scales are requested
+        auto width = stream->latest_.images[0] ? stream->latest_.images[0]->width : UINT16_MAX;
+        uint8_t scales = 0;
+        auto interval = ULONG_MAX;
+        for (const auto &state : stream->clients_)
+        {
+            scales |= width == UINT16_MAX && state.max_width > 0 ? 0x0f : 1 << scale_for(state, width);
+            interval = std::min(interval, state.interval);
+        }
+
+        stream->interval_ = interval;
+        if (stream->scales_.exchange(scales) == 0)
+            xTaskNotifyGive(stream->encode_task_);
+
+        auto progress = false;
+        auto now = millis();
+        for (auto it = stream->clients_.begin(); it != stream->clients_.end();)
+        {
+            auto &state = *it;
+            if (!state.image && now - state.last_frame >= state.interval && stream->latest_.images[0])
+            {
+                // Client is ready for the next frame. Without the requested scale (yet), send the full frame
+                auto image = stream->latest_.images[scale_for(state, width)];
+                if (!image)
+                    image = stream->latest_.images[0];
+
+                if (image->sequence != state.sequence)
+                {
+                    state.image = image;
+                    state.sequence = image->sequence;
+                    state.last_frame = now;
+                    state.position = 0;
+                    state.header_length = snprintf(state.header, sizeof(state.header), "--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", boundary, static_cast<unsigned>(image->length));
+                }
+            }
+
+            if (state.image && !stream->send(state, progress))
+            {
+                log_i("Stream client disconnected");
+                it = stream->clients_.erase(it);
+                continue;
+            }
+
+            ++it;
+        }
+
+        // Wait for a new frame, or retry the blocked sockets
+        if (!progress)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_IDLE_DELAY));
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <frame_cache.h>
+#include <image.h>
+#include <spsc_queue.h>
+
+// Streams frames as multipart/x-mixed-replace to multiple clients.
+// Sockets are written without blocking; every client has its own send position and a client that is still sending
+// a frame when newer frames arrive simply skips them. A slow client never stalls the camera or the other clients.
+// Frames are copied and downscaled by an encode task and passed to the send task through a lock-free queue, so the
+// next frame is encoded on one core while the previous one is sent on the other.
+class mjpeg_stream
+{
+public:
+    static constexpr const char *boundary = "mjpeg-frame-boundary";
+    static constexpr size_t max_clients = 4;
+
+    // Returns the latest frame (or nullptr)
+    using frame_source = std::function<frame_ptr()>;
+
+    // Starts the encode task pinned to encode_core and the send task pinned to send_core
+    bool begin(frame_source source, BaseType_t encode_core, BaseType_t send_core);
+
+    // Takes over the client (the HTTP response header must have been sent already).
+    // max_fps limits the frame rate (0 = unlimited), frames wider than max_width (0 = unlimited) are downscaled.
+    bool add_client(const WiFiClient &client, float max_fps, uint16_t max_width);
+    size_t client_count();
+
+private:
+    struct client_state
+    {
+        WiFiClient client;
+        unsigned long interval;
+        uint16_t max_width;
+        // Frame being sent; sent are the header, the image and a CRLF
+        jpeg_ptr image;
+        char header[128];
+        size_t header_length;
+        size_t position;
+        uint32_t sequence;
+        unsigned long last_frame;
+    };
+
+    // Images of one frame at 1/1, 1/2, 1/4 and 1/8 scale (only the scales requested by the clients). Shared by all clients
+    struct frame_set
+    {
+        uint32_t sequence;
+        jpeg_ptr images[4];
+    };
+
+    static void encode_task(void *parameter);
+    static void send_task(void *parameter);
+    // Scale (0-3) for a client: downscale as much as needed to fit max_width
+    static uint8_t scale_for(const client_state &state, uint16_t width);
+    // Sends as much as possible without blocking. Returns false if the client has disconnected
+    bool send(client_state &state, bool &progress);
+
+    frame_source source_;
+    TaskHandle_t encode_task_ = nullptr;
+    TaskHandle_t send_task_ = nullptr;
+
+    std::mutex mutex_;
+    std::vector<client_state> pending_;
+    size_t client_count_ = 0;
+
+    // Published by the send task: scales requested by the clients (bit per scale) and the shortest client interval
+    std::atomic<uint8_t> scales_{0};
+    std::atomic<unsigned long> interval_{0};
+    // Encoded frames, from the encode task to the send task
+    spsc_queue<frame_set, 2> encoded_;
+
+    // Send task only
+    std::vector<client_state> clients_;
+    frame_set latest_ = {};
+};
@@ -0,0 +1,169 @@
+#include "motion_detector.h"
+
+#include <img_converters.h>
+
+#include <algorithm>
+
+#include "motion_kernels.h"
+
+constexpr auto MOTION_TASK_STACK_SIZE = 6144;
+constexpr auto MOTION_TASK_PRIORITY = 1;
+// Frames are decoded at 1/8 scale (80x60 for VGA)
+constexpr auto MOTION_SCALE = JPG_SCALE_8X;
+// Block size in (scaled) pixels
+constexpr uint8_t MOTION_BLOCK_SIZE = 8;
+// A block has changed when the mean absolute difference of its pixels exceeds this
+constexpr uint32_t MOTION_BLOCK_THRESHOLD = 12;
+// Motion when at least this number of blocks changed
+constexpr uint16_t MOTION_MIN_BLOCKS = 2;
+// Background adaption rate: 1/2^shift of the difference per frame
+constexpr uint8_t MOTION_BACKGROUND_SHIFT = 4;
+// An event ends after this time without motion
+constexpr auto MOTION_EVENT_HOLD = 2000UL; // ms
+
+bool motion_detector::begin(frame_source source, unsigned long interval, BaseType_t core)
+{
+    source_ = source;
+    interval_ = interval;
+    if (xTaskCreatePinnedToCore(motion_task, "motion", MOTION_TASK_STACK_SIZE, this, MOTION_TASK_PRIORITY, &task_, core) != pdPASS)
+    {
+        task_ = nullptr;
+        log_e("Unable to create the motion task");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_.running = true;
+    return true;
+}
+
+motion_status motion_detector::status()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return status_;
+}
+
+std::vector<motion_event> motion_detector::events(uint32_t since)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<motion_event> events;
+    auto last = status_.last_event;
+    // Oldest available event first
+    auto first = std::max<uint32_t>(since + 1, last >= max_events ? last - max_events + 1 : 1);
+    for (auto id = first; id <= last; id++)
+        events.push_back(events_[id % max_events]);
+
+    return events;
+}
+
+bool motion_detector::decode(const frame &frame)
+{
+    uint16_t width = frame.fb->width >> MOTION_SCALE;
+    uint16_t height = frame.fb->height >> MOTION_SCALE;
+    if (width != width_ || height != height_)
+    {
+        // (Re)allocate for the new frame size and start a new background
+        size_t pixels = width * height;
+        rgb565_.reset(static_cast<uint8_t *>(ps_malloc(pixels * 2)));
+        gray_.reset(static_cast<uint8_t *>(malloc(pixels)));
+        background_.reset(static_cast<uint8_t *>(malloc(pixels)));
+        average_.reset(static_cast<uint16_t *>(malloc(pixels * sizeof(uint16_t))));
+        sums_.assign((width / MOTION_BLOCK_SIZE) * (height / MOTION_BLOCK_SIZE), 0);
+        background_valid_ = false;
+        width_ = height_ = 0;
+        if (!rgb565_ || !gray_ || !background_ || !average_)
+        {
+            log_e("Not enough memory for motion detection at %ux%u", width, height);
+            return false;
+        }
+
+        width_ = width;
+        height_ = height;
+    }
+
+    if (!jpg2rgb565(frame.fb->buf, frame.fb->len, rgb565_.get(), MOTION_SCALE))
+        return false;
+
+    rgb565_to_gray(rgb565_.get(), gray_.get(), width_ * height_);
+    return true;
+}
+
+void motion_detector::analyse(uint32_t sequence)
+{
+    size_t pixels = width_ * height_;
+    if (!background_valid_)
+    {
+        // First frame: the frame is the background
+        for (size_t i = 0; i < pixels; i++)
+        {
+            average_.get()[i] = gray_.get()[i] << 8;
+            background_.get()[i] = gray_.get()[i];
+        }
+
+        background_valid_ = true;
+    }
+
+    block_sad(gray_.get(), background_.get(), width_, height_, MOTION_BLOCK_SIZE, sums_.data());
+    update_background(gray_.get(), average_.get(), background_.get(), pixels, MOTION_BACKGROUND_SHIFT);
+
+    uint16_t changed = 0;
+    for (auto sum : sums_)
+        if (sum > MOTION_BLOCK_THRESHOLD * MOTION_BLOCK_SIZE * MOTION_BLOCK_SIZE)
+            changed++;
+
+    auto now = millis();
+    auto motion = changed >= MOTION_MIN_BLOCKS;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_.motion = motion;
+    status_.changed_blocks = changed;
+    status_.blocks = sums_.size();
+    status_.width = width_;
+    status_.height = height_;
+    status_.frames++;
+    status_.sequence = sequence;
+
+    auto &event = events_[status_.last_event % max_events];
+    auto in_event = status_.last_event > 0 && event.end == 0;
+    if (motion)
+    {
+        status_.last_motion = now;
+        if (!in_event)
+        {
+            auto &next = events_[++status_.last_event % max_events];
+            next = {status_.last_event, now, 0, changed, sequence};
+            log_i("Motion event %u started (%u blocks)", status_.last_event, changed);
+        }
+        else if (changed > event.peak_blocks)
+            event.peak_blocks = changed;
+    }
+    else if (in_event && now - status_.last_motion >= MOTION_EVENT_HOLD)
+    {
+        event.end = status_.last_motion;
+        log_i("Motion event %u ended", event.id);
+    }
+}
+
+void motion_detector::motion_task(void *parameter)
+{
+    auto detector = static_cast<motion_detector *>(parameter);
+    uint32_t sequence = 0;
+    for (;;)
+    {
+        auto start = millis();
+        auto image = detector->source_();
+        if (image && image->sequence != sequence)
+        {
+            sequence = image->sequence;
+            auto decoded = detector->decode(*image);
+            // Release the frame buffer before analysing
+            image.reset();
+            if (decoded)
+                detector->analyse(sequence);
+        }
+
+        image.reset();
+        auto elapsed = millis() - start;
+        vTaskDelay(pdMS_TO_TICKS(elapsed < detector->interval_ ? detector->interval_ - elapsed : 1));
+    }
+}
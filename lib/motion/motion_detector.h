@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <frame_cache.h>
+
+// Motion event: a period with motion. Events end when there was no motion for a while
+struct motion_event
+{
+    // Increments for every event (starting at 1)
+    uint32_t id;
+    // millis() of the start and end (0 while in progress)
+    unsigned long start;
+    unsigned long end;
+    // Maximum number of changed blocks
+    uint16_t peak_blocks;
+    // Sequence number of the first frame with motion
+    uint32_t sequence;
+};
+
+struct motion_status
+{
+    bool running;
+    bool motion;
+    // Changed blocks in the last analysed frame and the total number of blocks
+    uint16_t changed_blocks;
+    uint16_t blocks;
+    // Resolution of the analysis
+    uint16_t width;
+    uint16_t height;
+    uint32_t frames;
+    // Sequence number of the last analysed frame
+    uint32_t sequence;
+    // millis() of the last frame with motion (0 if none)
+    unsigned long last_motion;
+    // Id of the last event (0 if none)
+    uint32_t last_event;
+};
+
+// Detects motion on low resolution grayscale frames. A task decodes the frames at 1/8 scale, compares them in blocks
+// to a running average background and keeps a log of the motion events.
+class motion_detector
+{
+public:
+    static constexpr size_t max_events = 16;
+
+    // Returns the latest frame (or nullptr)
+    using frame_source = std::function<frame_ptr()>;
+
+    // Starts the motion task pinned to core. A frame is analysed at most every interval milliseconds
+    bool begin(frame_source source, unsigned long interval, BaseType_t core);
+
+    motion_status status();
+    // Events with an id larger than since, oldest first
+    std::vector<motion_event> events(uint32_t since);
+
+private:
+    static void motion_task(void *parameter);
+    // Decodes the frame to grayscale. Returns false on failure
+    bool decode(const frame &frame);
+    void analyse(uint32_t sequence);
+
+    frame_source source_;
+    unsigned long interval_ = 0;
+    TaskHandle_t task_ = nullptr;
+
+    // Used by the motion task only
+    uint16_t width_ = 0;
+    uint16_t height_ = 0;
+    std::unique_ptr<uint8_t, decltype(&free)> rgb565_{nullptr, &free};
+    std::unique_ptr<uint8_t, decltype(&free)> gray_{nullptr, &free};
+    std::unique_ptr<uint8_t, decltype(&free)> background_{nullptr, &free};
+    std::unique_ptr<uint16_t, decltype(&free)> average_{nullptr, &free};
+    std::vector<uint32_t> sums_;
+    bool background_valid_ = false;
+
+    std::mutex mutex_;
+    motion_status status_ = {};
+    // Ring buffer of the last events
+    motion_event events_[max_events] = {};
+};
@@ -0,0 +1,84 @@
+#include "motion_kernels.h"
+
+#include <cstring>
+
+void rgb565_to_gray(const uint8_t *rgb565, uint8_t *gray, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++)
+    {
+        uint16_t pixel = rgb565[0] << 8 | rgb565[1];
+        // Expand to 8 bits per channel; Y = (77 R + 150 G + 29 B) / 256
+        uint32_t r = (pixel >> 8) & 0xf8;
+        uint32_t g = (pixel >> 3) & 0xfc;
+        uint32_t b = (pixel << 3) & 0xf8;
+        gray[i] = (77 * r + 150 * g + 29 * b) >> 8;
+        rgb565 += 2;
+    }
+}
+
+// Absolute differences of the bytes in the low half of each 16 bit lane of a and b (values 0-255 in 0x00ff00ff)
+static inline uint32_t absdiff_lanes(uint32_t a, uint32_t b)
+{
+    // 0x100 + a - b per lane: no borrow between the lanes. Bit 8 is set if a >= b
+    auto difference = (a | 0x01000100) - b;
+    auto negative = ((difference >> 8) & 0x00010001) ^ 0x00010001;
+    // Negate the lanes where a < b (two's complement of the low byte)
+    auto low = difference & 0x00ff00ff;
+    return (low ^ (negative * 0xff)) + negative;
+}
+
+uint32_t sad_u8(const uint8_t *a, const uint8_t *b, size_t length)
+{
+    uint32_t sum = 0;
+    size_t i = 0;
+    // Lanes hold at most 2 * 255 per word; flush the lane sums before they can overflow 16 bits
+    constexpr size_t words_per_flush = 128;
+    while (length - i >= 4)
+    {
+        uint32_t lanes = 0;
+        for (size_t word = 0; word < words_per_flush && length - i >= 4; word++, i += 4)
+        {
+            uint32_t x, y;
+            memcpy(&x, a + i, 4);
+            memcpy(&y, b + i, 4);
+            lanes += absdiff_lanes(x & 0x00ff00ff, y & 0x00ff00ff);
+            lanes += absdiff_lanes((x >> 8) & 0x00ff00ff, (y >> 8) & 0x00ff00ff);
+        }
+
+        sum += (lanes & 0xffff) + (lanes >> 16);
+    }
+
+    for (; i < length; i++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+    return sum;
+}
+
+void block_sad(const uint8_t *image, const uint8_t *background, uint16_t width, uint16_t height, uint8_t block, uint32_t *sums)
+{
+    auto columns = width / block;
+    auto rows = height / block;
+    for (auto row = 0; row < rows; row++)
+    {
+        auto row_sums = sums + row * columns;
+        memset(row_sums, 0, columns * sizeof(uint32_t));
+        for (auto line = 0; line < block; line++)
+        {
+            auto offset = (row * block + line) * width;
+            for (auto column = 0; column < columns; column++)
+                row_sums[column] += sad_u8(image + offset + column * block, background + offset + column * block, block);
+        }
+    }
+}
+
+void update_background(const uint8_t *image, uint16_t *average, uint8_t *background, size_t pixels, uint8_t shift)
+{
+    for (size_t i = 0; i < pixels; i++)
+    {
+        int32_t value = average[i];
+        value += ((image[i] << 8) - value) >> shift;
+        average[i] = value;
+        // Rounded: the average stops up to 2^shift - 1 short of the image value
+        background[i] = (value + 128) >> 8;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable image kernels of the motion detector. They only depend on the standard library, so they can be built and
+// tested on the host. Images are 8 bit grayscale, rows are contiguous.
+
+// Converts RGB565 (as produced by the JPEG decoder, big endian) to 8 bit luma
+void rgb565_to_gray(const uint8_t *rgb565, uint8_t *gray, size_t pixels);
+
+// Sum of absolute differences of two byte arrays. Processes 4 bytes at a time as packed 32 bit words
+uint32_t sad_u8(const uint8_t *a, const uint8_t *b, size_t length);
+
+// SAD per block of block x block pixels between the image and the background. Partial blocks at the right and bottom
+// edges are ignored. sums receives (width / block) * (height / block) values, row by row
+void block_sad(const uint8_t *image, const uint8_t *background, uint16_t width, uint16_t height, uint8_t block, uint32_t *sums);
+
+// Running average background: background += (image - background) / 2^shift. The average is kept in 8.8 fixed point
+// (average) for precision; background receives the integer part that is used for the SAD
+void update_background(const uint8_t *image, uint16_t *average, uint8_t *background, size_t pixels, uint8_t shift);
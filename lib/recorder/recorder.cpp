@@ -0,0 +1,470 @@
+#include "recorder.h"
+
+#include <algorithm>
+
+constexpr auto SAMPLE_TASK_STACK_SIZE = 4096;
+constexpr auto WRITE_TASK_STACK_SIZE = 4096;
+constexpr auto RECORDER_TASK_PRIORITY = 1;
+// Frames waiting to be written; when full, frames are dropped instead of stalling the sampling
+constexpr size_t WRITE_QUEUE_LENGTH = 4;
+
+// RIFF header, hdrl list (avih, strl list with strh and strf) and the start of the movi list
+constexpr size_t AVI_HEADER_LENGTH = 224;
+// File position of the movi fourcc; the idx1 offsets are relative to it
+constexpr uint32_t AVI_MOVI_POSITION = 220;
+constexpr uint32_t AVIF_HASINDEX = 0x10;
+constexpr uint32_t AVIIF_KEYFRAME = 0x10;
+// Entries of idx1 written at once
+constexpr size_t INDEX_BLOCK_ENTRIES = 32;
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    *p++ = value;
+    *p++ = value >> 8;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    return put16(put16(p, value), value >> 16);
+}
+
+static uint8_t *fourcc(uint8_t *p, const char *code)
+{
+    memcpy(p, code, 4);
+    return p + 4;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// Builds the header of an MJPEG AVI with frames frames (one every interval milliseconds)
+static void avi_header(uint8_t *header, uint16_t width, uint16_t height, unsigned long interval, uint32_t frames, uint32_t movi_length)
+{
+    // The file: this header up to the movi fourcc, the movi list and the idx1 chunk
+    auto file_length = AVI_MOVI_POSITION + movi_length + 8 + frames * 16;
+    auto p = header;
+    p = fourcc(p, "RIFF");
+    // Excludes the RIFF fourcc and size
+    p = put32(p, file_length - 8);
+    p = fourcc(p, "AVI ");
+
+    p = fourcc(p, "LIST");
+    p = put32(p, 192);
+    p = fourcc(p, "hdrl");
+    p = fourcc(p, "avih");
+    p = put32(p, 56);
+    p = put32(p, interval * 1000); // Microseconds per frame
+    p = put32(p, 0);               // Maximum bytes per second
+    p = put32(p, 0);               // Padding granularity
+    p = put32(p, AVIF_HASINDEX);
+    p = put32(p, frames);
+    p = put32(p, 0); // Initial frames
+    p = put32(p, 1); // Streams
+    p = put32(p, 0); // Suggested buffer size
+    p = put32(p, width);
+    p = put32(p, height);
+    for (auto i = 0; i < 4; i++)
+        p = put32(p, 0);
+
+    p = fourcc(p, "LIST");
+    p = put32(p, 116);
+    p = fourcc(p, "strl");
+    p = fourcc(p, "strh");
+    p = put32(p, 56);
+    p = fourcc(p, "vids");
+    p = fourcc(p, "MJPG");
+    p = put32(p, 0);        // Flags
+    p = put32(p, 0);        // Priority and language
+    p = put32(p, 0);        // Initial frames
+    p = put32(p, interval); // Scale: rate / scale is frames per second
+    p = put32(p, 1000);     // Rate
+    p = put32(p, 0);        // Start
+    p = put32(p, frames);
+    p = put32(p, 0);          // Suggested buffer size
+    p = put32(p, UINT32_MAX); // Quality (default)
+    p = put32(p, 0);          // Sample size
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, width);
+    p = put16(p, height);
+    p = fourcc(p, "strf");
+    p = put32(p, 40);
+    p = put32(p, 40); // BITMAPINFOHEADER
+    p = put32(p, width);
+    p = put32(p, height);
+    p = put16(p, 1);  // Planes
+    p = put16(p, 24); // Bits per pixel
+    p = fourcc(p, "MJPG");
+    p = put32(p, width * height * 3);
+    for (auto i = 0; i < 4; i++)
+        p = put32(p, 0);
+
+    p = fourcc(p, "LIST");
+    p = put32(p, movi_length);
+    fourcc(p, "movi");
+}
+
+bool recorder::begin(fs::FS &fs, const char *directory, frame_source source, BaseType_t core)
+{
+    fs_ = &fs;
+    directory_ = directory;
+    source_ = source;
+    if (!fs.exists(directory_))
+        fs.mkdir(directory_);
+
+    // Continue the numbering of the existing recordings
+    for (const auto &file : list())
+        recording_number_ = std::max<uint32_t>(recording_number_, strtoul(file.name.c_str() + 3, nullptr, 10));
+
+    if (xTaskCreatePinnedToCore(write_task, "recorder_write", WRITE_TASK_STACK_SIZE, this, RECORDER_TASK_PRIORITY, &write_task_, core) != pdPASS ||
+        xTaskCreatePinnedToCore(sample_task, "recorder", SAMPLE_TASK_STACK_SIZE, this, RECORDER_TASK_PRIORITY, &sample_task_, core) != pdPASS)
+    {
+        sample_task_ = nullptr;
+        log_e("Unable to create the recorder tasks");
+        return false;
+    }
+
+    return true;
+}
+
+bool recorder::start(unsigned long interval, uint32_t segment_frames)
+{
+    if (!running())
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // The writer is idle once the previous recording has been written, so the index can be replaced
+        if (recording_ || written_.recording || !queue_.empty())
+            return false;
+
+        free(index_);
+        index_ = static_cast<uint32_t *>(ps_malloc(segment_frames * 2 * sizeof(uint32_t)));
+        if (!index_)
+            return false;
+
+        recording_ = true;
+        interval_ = interval;
+        segment_frames_ = segment_frames;
+        recording_number_++;
+        dropped_ = 0;
+        written_ = {};
+        written_.recording = true;
+        written_.interval = interval;
+    }
+
+    xTaskNotifyGive(sample_task_);
+    return true;
+}
+
+void recorder::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!recording_)
+        return;
+
+    recording_ = false;
+    queue_.push_back({nullptr, 0, true});
+    queue_changed_.notify_one();
+    xTaskNotifyGive(sample_task_);
+}
+
+recorder_status recorder::status()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto status = written_;
+    status.recording = recording_;
+    status.dropped = dropped_;
+    status.queued = queue_.size();
+    return status;
+}
+
+std::vector<recording_file> recorder::list()
+{
+    std::vector<recording_file> files;
+    auto directory = fs_->open(directory_);
+    if (!directory || !directory.isDirectory())
+        return files;
+
+    for (auto file = directory.openNextFile(); file; file = directory.openNextFile())
+    {
+        String name = file.name();
+        // name() is the full path on older cores
+        name = name.substring(name.lastIndexOf('/') + 1);
+        if (valid_name(name))
+            files.push_back({name, file.size()});
+    }
+
+    std::sort(files.begin(), files.end(), [](const recording_file &a, const recording_file &b)
+              { return a.name < b.name; });
+    return files;
+}
+
+bool recorder::valid_name(const String &name) const
+{
+    // rec0001_000.avi
+    if (name.length() != 15 || !name.startsWith("rec") || !name.endsWith(".avi") || name[7] != '_')
+        return false;
+
+    for (auto i = 3; i < 11; i++)
+        if (i != 7 && !isdigit(name[i]))
+            return false;
+
+    return true;
+}
+
+fs::File recorder::open(const String &name)
+{
+    if (!fs_ || !valid_name(name))
+        return fs::File();
+
+    return fs_->open(directory_ + "/" + name, FILE_READ);
+}
+
+jpeg_ptr recorder::frame_at(const String &name, float seconds)
+{
+    auto file = open(name);
+    if (!file)
+        return nullptr;
+
+    uint8_t header[AVI_HEADER_LENGTH];
+    if (file.read(header, sizeof(header)) != sizeof(header) || memcmp(header, "RIFF", 4) || memcmp(header + 8, "AVI ", 4))
+        return nullptr;
+
+    // The header is completed when the segment is closed
+    auto frame_time = get32(header + 32); // Microseconds
+    auto frames = get32(header + 48);
+    if (frame_time == 0 || frames == 0 || seconds < 0)
+        return nullptr;
+
+    // Constant frame rate: the idx1 entry of the frame is at a fixed position
+    auto number = std::min<uint32_t>(seconds * 1000000 / frame_time, frames - 1);
+    uint8_t entry[16];
+    if (!file.seek(AVI_MOVI_POSITION + get32(header + 216) + 8 + number * 16) || file.read(entry, sizeof(entry)) != sizeof(entry))
+        return nullptr;
+
+    auto length = get32(entry + 12);
+    auto data = static_cast<uint8_t *>(ps_malloc(length));
+    if (!data)
+        return nullptr;
+
+    if (!file.seek(AVI_MOVI_POSITION + get32(entry + 8) + 8) || file.read(data, length) != length)
+    {
+        free(data);
+        return nullptr;
+    }
+
+    return std::make_shared<const jpeg_image>(data, length, get32(header + 64), get32(header + 68), number);
+}
+
+bool recorder::open_segment(const jpeg_image &image)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "rec%04u_%03u.avi", static_cast<unsigned>(recording_number_ % 10000), static_cast<unsigned>(segment_number_ % 1000));
+    file_ = fs_->open(directory_ + "/" + name, FILE_WRITE);
+    if (!file_)
+    {
+        log_e("Unable to create recording %s", name);
+        return false;
+    }
+
+    width_ = image.width;
+    height_ = image.height;
+    index_count_ = 0;
+    movi_length_ = 4;
+    // Completed when the segment is closed
+    uint8_t header[AVI_HEADER_LENGTH];
+    avi_header(header, width_, height_, interval_, 0, movi_length_);
+    if (file_.write(header, sizeof(header)) != sizeof(header))
+    {
+        log_e("Unable to write recording %s", name);
+        file_.close();
+        fs_->remove(directory_ + "/" + name);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_.segment = name;
+    return true;
+}
+
+void recorder::close_segment()
+{
+    if (!file_)
+        return;
+
+    uint8_t block[INDEX_BLOCK_ENTRIES * 16 + 8];
+    auto p = fourcc(block, "idx1");
+    p = put32(p, index_count_ * 16);
+    size_t expected = 8 + index_count_ * 16;
+    size_t written = 0;
+    for (uint32_t i = 0; i < index_count_; i++)
+    {
+        p = fourcc(p, "00dc");
+        p = put32(p, AVIIF_KEYFRAME);
+        p = put32(p, index_[i * 2]);
+        p = put32(p, index_[i * 2 + 1]);
+        if (p == block + sizeof(block) || i == index_count_ - 1)
+        {
+            written += file_.write(block, p - block);
+            p = block;
+        }
+    }
+
+    if (index_count_ == 0)
+        written += file_.write(block, p - block);
+
+    if (written != expected)
+        log_e("Unable to write the index of the recording (%u of %u bytes)", static_cast<unsigned>(written), static_cast<unsigned>(expected));
+
+    uint8_t header[AVI_HEADER_LENGTH];
+    avi_header(header, width_, height_, interval_, index_count_, movi_length_);
+    file_.seek(0);
+    file_.write(header, sizeof(header));
+    file_.close();
+
+    segment_number_++;
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_.segments++;
+}
+
+void recorder::add_index(uint32_t offset, uint32_t length)
+{
+    index_[index_count_ * 2] = offset;
+    index_[index_count_ * 2 + 1] = length;
+    index_count_++;
+}
+
+void recorder::write(const queued_frame &item)
+{
+    if (item.end)
+    {
+        close_segment();
+        segment_number_ = 0;
+        segment_slot_ = 0;
+        next_slot_ = 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_.recording = false;
+        return;
+    }
+
+    const auto &image = *item.image;
+    // New segment when the slot is past the slots of the segment or the frame size changed
+    auto size_changed = file_ && (image.width != width_ || image.height != height_);
+    if (file_ && (size_changed || item.slot >= segment_slot_ + segment_frames_))
+        close_segment();
+
+    if (!file_)
+    {
+        // The segment starts at the frame after a frame size change, otherwise where the previous one ended (or at a
+        // later multiple of segment_frames slots, when all frames of a segment were dropped)
+        segment_slot_ = size_changed ? item.slot : segment_slot_ + (item.slot - segment_slot_) / segment_frames_ * segment_frames_;
+        next_slot_ = segment_slot_;
+        if (!open_segment(image))
+            return;
+    }
+
+    // Repeat the previous frame for the dropped frames, so the frame rate stays constant
+    while (next_slot_ < item.slot && index_count_ > 0)
+    {
+        add_index(index_[index_count_ * 2 - 2], index_[index_count_ * 2 - 1]);
+        next_slot_++;
+    }
+
+    auto start = millis();
+    uint8_t chunk[8];
+    put32(fourcc(chunk, "00dc"), image.length);
+    const uint8_t padding = 0;
+    auto padded = image.length & 1;
+    auto length = file_.write(chunk, sizeof(chunk)) + file_.write(image.data, image.length) + (padded ? file_.write(&padding, 1) : 0);
+    if (length != sizeof(chunk) + image.length + padded)
+    {
+        // File system full: go back to the end of the last complete chunk, so the partial chunk is overwritten by the
+        // next frame or the index (the RIFF size excludes what remains of it). The slot is filled by the next frame
+        log_e("Unable to write to the recording (%u of %u bytes)", static_cast<unsigned>(length), static_cast<unsigned>(sizeof(chunk) + image.length + padded));
+        file_.seek(AVI_MOVI_POSITION + movi_length_);
+        return;
+    }
+
+    // Dropped frames at the start of the segment repeat this frame
+    for (; next_slot_ <= item.slot; next_slot_++)
+        add_index(movi_length_, image.length);
+
+    movi_length_ += length;
+    auto elapsed = millis() - start;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_.frames++;
+    written_.bytes += length;
+    written_.max_write_time = std::max(written_.max_write_time, elapsed);
+}
+
+void recorder::write_task(void *parameter)
+{
+    auto self = static_cast<recorder *>(parameter);
+    for (;;)
+    {
+        queued_frame item;
+        {
+            std::unique_lock<std::mutex> lock(self->mutex_);
+            self->queue_changed_.wait(lock, [self]()
+                                          { return !self->queue_.empty(); });
+            item = self->queue_.front();
+            self->queue_.pop_front();
+        }
+
+        self->write(item);
+    }
+}
+
+void recorder::sample_task(void *parameter)
+{
+    auto self = static_cast<recorder *>(parameter);
+    for (;;)
+    {
+        unsigned long interval;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            interval = self->recording_ ? self->interval_ : 0;
+        }
+
+        if (!interval)
+        {
+            // Wait for start()
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // Slots are counted from the start of the recording
+        auto started = millis();
+        for (uint32_t slot = 0;; slot++)
+        {
+            auto frame = self->source_();
+            auto image = frame ? copy_jpeg(frame->fb, frame->sequence) : nullptr;
+            frame.reset();
+            {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                if (!self->recording_)
+                    break;
+
+                if (!image || self->queue_.size() >= WRITE_QUEUE_LENGTH)
+                    self->dropped_++;
+                else
+                {
+                    self->queue_.push_back({image, slot, false});
+                    self->queue_changed_.notify_one();
+                }
+            }
+
+            // Skip the slots that have passed already
+            auto elapsed = millis() - started;
+            slot = std::max<uint32_t>(slot, elapsed / interval);
+            auto next = (slot + 1) * interval;
+            // Wake up early on stop()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(next - elapsed));
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <frame_cache.h>
+#include <image.h>
+
+struct recorder_status
+{
+    bool recording;
+    // Name of the segment being written
+    String segment;
+    unsigned long interval;
+    uint32_t frames;
+    // Frames that did not fit in the write queue (repeated in the file to keep the frame rate constant)
+    uint32_t dropped;
+    uint32_t segments;
+    size_t queued;
+    uint32_t bytes;
+    // Longest write of a frame to the file system (milliseconds)
+    unsigned long max_write_time;
+};
+
+struct recording_file
+{
+    String name;
+    size_t size;
+};
+
+// Records frames to segmented MJPEG AVI files. A sampling task copies a frame every interval into a short write queue;
+// a writer task appends them to the file, so a slow file system never stalls the camera or the web server.
+// The frame rate of the files is constant: a frame that was dropped repeats the previous frame in the index (the next
+// one at the start of a segment) and every segment covers segment_frames slots, so the frame at a point in time is found
+// in the index without searching.
+class recorder
+{
+public:
+    // Returns the latest frame (or nullptr)
+    using frame_source = std::function<frame_ptr()>;
+
+    // Starts the sampling and writer tasks pinned to core. Recordings are stored in directory on fs
+    bool begin(fs::FS &fs, const char *directory, frame_source source, BaseType_t core);
+    bool running() const
+    {
+        return sample_task_ != nullptr;
+    }
+
+    // Starts recording a frame every interval milliseconds; a new file is started every segment_frames frames.
+    // Returns false if already recording or out of memory
+    bool start(unsigned long interval, uint32_t segment_frames);
+    // Stops recording; queued frames are still written
+    void stop();
+
+    recorder_status status();
+    std::vector<recording_file> list();
+
+    // Opens a recording for reading. Returns a closed file if the name is invalid or unknown
+    fs::File open(const String &name);
+    // Reads the frame at seconds from the start of a (completed) recording. Returns nullptr if not available
+    jpeg_ptr frame_at(const String &name, float seconds);
+
+private:
+    struct queued_frame
+    {
+        jpeg_ptr image;
+        // Frame number since the start of the recording; gaps are dropped frames
+        uint32_t slot;
+        // Last item of the recording
+        bool end;
+    };
+
+    static void sample_task(void *parameter);
+    static void write_task(void *parameter);
+
+    bool valid_name(const String &name) const;
+    void write(const queued_frame &item);
+    bool open_segment(const jpeg_image &image);
+    void close_segment();
+    void add_index(uint32_t offset, uint32_t length);
+
+    fs::FS *fs_ = nullptr;
+    String directory_;
+    frame_source source_;
+    TaskHandle_t sample_task_ = nullptr;
+    TaskHandle_t write_task_ = nullptr;
+
+    std::mutex mutex_;
+    std::condition_variable queue_changed_;
+    std::deque<queued_frame> queue_;
+    bool recording_ = false;
+    unsigned long interval_ = 0;
+    uint32_t segment_frames_ = 0;
+    uint32_t recording_number_ = 0;
+    uint32_t dropped_ = 0;
+    recorder_status written_ = {};
+
+    // Writer state; only used by the write task
+    fs::File file_;
+    uint32_t segment_number_ = 0;
+    // idx1 entries of the segment: offset and length of the frame chunks (relative to the movi list)
+    uint32_t *index_ = nullptr;
+    uint32_t index_count_ = 0;
+    uint32_t movi_length_ = 0;
+    // First slot of the segment and the slot of the next idx1 entry
+    uint32_t segment_slot_ = 0;
+    uint32_t next_slot_ = 0;
+    uint16_t width_ = 0;
+    uint16_t height_ = 0;
+};
@@ -0,0 +1,48 @@
+#include "sensor_state.h"
+
+#include <algorithm>
+
+// Frames to skip after a change: the window and DSP are reconfigured, so the frame being read and the next one are invalid
+constexpr uint8_t FRAME_SIZE_SETTLE_FRAMES = 2;
+// Frames to skip after a change: the frame being read is still compressed with the previous quality
+constexpr uint8_t QUALITY_SETTLE_FRAMES = 1;
+
+bool sensor_state::begin()
+{
+    sensor_ = esp_camera_sensor_get();
+    if (!sensor_)
+        return false;
+
+    configured_ = {sensor_->status.framesize, sensor_->status.quality};
+    applied_ = configured_;
+    return true;
+}
+
+uint8_t sensor_state::apply(const sensor_settings &settings)
+{
+    if (!sensor_)
+        return 0;
+
+    uint8_t settle = 0;
+    if (settings.frame_size != applied_.frame_size)
+    {
+        if (sensor_->set_framesize(sensor_, settings.frame_size) == 0)
+            applied_.frame_size = settings.frame_size;
+        else
+            log_e("Unable to set the frame size to %d", settings.frame_size);
+
+        settle = std::max(settle, FRAME_SIZE_SETTLE_FRAMES);
+    }
+
+    if (settings.quality != applied_.quality)
+    {
+        if (sensor_->set_quality(sensor_, settings.quality) == 0)
+            applied_.quality = settings.quality;
+        else
+            log_e("Unable to set the quality to %d", settings.quality);
+
+        settle = std::max(settle, QUALITY_SETTLE_FRAMES);
+    }
+
+    return settle;
+}
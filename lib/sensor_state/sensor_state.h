@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+// Sensor settings that can differ per capture
+struct sensor_settings
+{
+    framesize_t frame_size;
+    // JPEG quality (0-63, lower is better)
+    int quality;
+};
+
+// Keeps track of the settings applied to the sensor, so only the settings that changed are written and frames are
+// only discarded when needed. Not thread safe: calls must be serialized by the caller (camera mutex).
+class sensor_state
+{
+public:
+    // Reads the current (configured) settings of the sensor
+    bool begin();
+
+    // Settings at begin()
+    const sensor_settings &configured() const
+    {
+        return configured_;
+    }
+    const sensor_settings &applied() const
+    {
+        return applied_;
+    }
+
+    // Writes the settings that differ from the applied settings. Returns the number of frames that may still have
+    // (partially) the previous settings and must be skipped; 0 if nothing changed
+    uint8_t apply(const sensor_settings &settings);
+
+private:
+    sensor_t *sensor_ = nullptr;
+    sensor_settings configured_ = {};
+    sensor_settings applied_ = {};
+};
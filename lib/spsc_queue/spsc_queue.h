@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer task and one consumer task (for example on different cores).
+// Holds up to Capacity items; push() fails when full instead of blocking
+template <typename T, size_t Capacity>
+class spsc_queue
+{
+public:
+    // Producer only
+    bool push(T item)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto next = (tail + 1) % slots;
+        if (next == head_.load(std::memory_order_acquire))
+            return false;
+
+        items_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool pop(T &item)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(items_[head]);
+        // Do not keep a reference to the item in the slot
+        items_[head] = T();
+        head_.store((head + 1) % slots, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    // One slot is kept free to tell a full queue from an empty one
+    static constexpr size_t slots = Capacity + 1;
+
+    T items_[slots];
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,495 @@
+#include "websocket.h"
+
+#include <lwip/sockets.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/version.h>
+
+#include <base64_codec.h>
+
+// Frame header: 2 bytes, 8 bytes extended length and 4 bytes mask
+constexpr size_t WEBSOCKET_MAX_HEADER_LENGTH = 14;
+// Messages waiting for a worker
+constexpr auto WEBSOCKET_QUEUE_LENGTH = 8;
+// Wait time of the reader when all workers are busy
+constexpr auto WEBSOCKET_QUEUE_TIMEOUT = 1000; // ms
+// Wait time when no connection received data
+constexpr auto WEBSOCKET_IDLE_DELAY = 2; // ms
+
+constexpr auto READER_TASK_STACK_SIZE = 4096;
+constexpr auto READER_TASK_PRIORITY = 2;
+// Workers handle MCP requests: same stack as the HTTP workers
+constexpr auto WORKER_TASK_STACK_SIZE = 12288;
+constexpr auto WORKER_TASK_PRIORITY = 1;
+
+enum websocket_opcode : uint8_t
+{
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close_frame = 0x8,
+    ping = 0x9,
+    pong = 0xa
+};
+
+// Close status codes
+constexpr uint16_t CLOSE_NORMAL = 1000;
+constexpr uint16_t CLOSE_PROTOCOL_ERROR = 1002;
+constexpr uint16_t CLOSE_TOO_BIG = 1009;
+
+// Writes a complete frame (server frames are not masked)
+static void send_frame(WiFiClient &client, uint8_t opcode, bool final, const uint8_t *data, size_t length)
+{
+    uint8_t header[10];
+    size_t header_length = 2;
+    header[0] = (final ? 0x80 : 0) | opcode;
+    if (length < 126)
+        header[1] = length;
+    else if (length <= UINT16_MAX)
+    {
+        header[1] = 126;
+        header[2] = length >> 8;
+        header[3] = length;
+        header_length = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for (auto i = 0; i < 8; i++)
+            header[2 + i] = i < 4 ? 0 : static_cast<uint8_t>(length >> (8 * (7 - i)));
+
+        header_length = 10;
+    }
+
+    client.write(header, header_length);
+    if (length > 0)
+        client.write(data, length);
+}
+
+void websocket_channel::send_pending_pong()
+{
+    std::lock_guard<std::mutex> lock(pong_mutex);
+    if (!pong_pending)
+        return;
+
+    send_frame(client, websocket_opcode::pong, true, pong, pong_length);
+    pong_pending = false;
+}
+
+websocket_writer::websocket_writer(const websocket_message &message)
+    : channel_(message.channel()), lock_(channel_->send_mutex, std::defer_lock)
+{
+}
+
+websocket_writer::~websocket_writer()
+{
+    end();
+}
+
+size_t websocket_writer::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t websocket_writer::write(const uint8_t *buffer, size_t size)
+{
+    if (ended_)
+        return 0;
+
+    auto remaining = size;
+    while (remaining > 0)
+    {
+        auto chunk = std::min(remaining, sizeof(buffer_) - length_);
+        memcpy(buffer_ + length_, buffer, chunk);
+        length_ += chunk;
+        buffer += chunk;
+        remaining -= chunk;
+        if (length_ == sizeof(buffer_))
+            send_fragment(false);
+    }
+
+    return size;
+}
+
+void websocket_writer::send_fragment(bool final)
+{
+    if (!lock_.owns_lock())
+        lock_.lock();
+
+    send_frame(channel_->client, started_ ? continuation : text, final, buffer_, length_);
+    started_ = true;
+    length_ = 0;
+    channel_->send_pending_pong();
+}
+
+void websocket_writer::end()
+{
+    if (ended_)
+        return;
+
+    if (started_ || length_ > 0)
+        send_fragment(true);
+
+    ended_ = true;
+}
+
+void websocket_writer::send_binary(const uint8_t *data, size_t length)
+{
+    end();
+    if (!lock_.owns_lock())
+        lock_.lock();
+
+    send_frame(channel_->client, binary, true, data, length);
+    channel_->send_pending_pong();
+}
+
+// Sends the owed pong unless a reply is being written (its writer sends it then)
+static void send_pong(websocket_channel &channel)
+{
+    if (!channel.send_mutex.try_lock())
+        return;
+
+    channel.send_pending_pong();
+    channel.send_mutex.unlock();
+}
+
+bool websocket_server::begin(handler handler, size_t workers, BaseType_t core)
+{
+    handler_ = handler;
+    queue_ = xQueueCreate(WEBSOCKET_QUEUE_LENGTH, sizeof(pending_message *));
+    if (!queue_)
+        return false;
+
+    if (xTaskCreatePinnedToCore(reader_task, "websocket", READER_TASK_STACK_SIZE, this, READER_TASK_PRIORITY, &reader_task_, core) != pdPASS)
+    {
+        reader_task_ = nullptr;
+        log_e("Unable to create the websocket task");
+        return false;
+    }
+
+    for (size_t i = 0; i < workers; i++)
+    {
+        if (xTaskCreatePinnedToCore(worker_task, "websocket_worker", WORKER_TASK_STACK_SIZE, this, WORKER_TASK_PRIORITY, nullptr, core) != pdPASS)
+        {
+            log_e("Unable to create websocket worker %u", static_cast<unsigned>(i));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool websocket_server::accept(http_request &request, http_response &response)
+{
+    auto key = request.header("Sec-WebSocket-Key");
+    auto upgrade = request.header("Upgrade");
+    upgrade.toLowerCase();
+    if (request.method() != http_method::get || upgrade != "websocket" || key.isEmpty())
+    {
+        response.send(400, "text/plain", "WebSocket upgrade expected");
+        return false;
+    }
+
+    if (request.header("Sec-WebSocket-Version") != "13")
+    {
+        response.add_header("Sec-WebSocket-Version", "13");
+        response.send(426, "text/plain", "Unsupported WebSocket version");
+        return false;
+    }
+
+    if (!reader_task_ || connection_count() >= max_connections)
+    {
+        response.send(503, "text/plain", "Maximum number of WebSocket connections reached");
+        return false;
+    }
+
+    // Accept key: base64 of the SHA-1 of the key and the protocol GUID
+    auto accept_key = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t hash[20];
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_sha1(reinterpret_cast<const uint8_t *>(accept_key.c_str()), accept_key.length(), hash);
+#else
+    mbedtls_sha1_ret(reinterpret_cast<const uint8_t *>(accept_key.c_str()), accept_key.length(), hash);
+#endif
+    char encoded[28];
+    auto encoded_length = base64_encode(hash, sizeof(hash), encoded);
+
+    auto channel = std::make_shared<websocket_channel>();
+    channel->binary = request.arg("binary") == "1";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &connection : connections_)
+    {
+        if (connection.channel)
+            continue;
+
+        // Buffers are allocated once and kept for the next connections
+        if (!connection.buffer)
+            connection.buffer = static_cast<uint8_t *>(ps_malloc(max_message_length + WEBSOCKET_MAX_HEADER_LENGTH));
+        if (!connection.message)
+            connection.message = static_cast<char *>(ps_malloc(max_message_length + 1));
+
+        if (!connection.buffer || !connection.message)
+        {
+            response.send(503, "text/plain", "Not enough memory");
+            return false;
+        }
+
+        response.add_header("Sec-WebSocket-Accept", String(encoded, encoded_length));
+        response.switch_protocols("websocket");
+        // The reader task takes over the connection; the worker continues with the next request
+        channel->client = response.detach();
+        connection.channel = channel;
+        connection.length = 0;
+        connection.message_length = 0;
+        connection.in_message = false;
+        xTaskNotifyGive(reader_task_);
+        return true;
+    }
+
+    response.send(503, "text/plain", "Maximum number of WebSocket connections reached");
+    return false;
+}
+
+size_t websocket_server::connection_count()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto &connection : connections_)
+        if (connection.channel)
+            count++;
+
+    return count;
+}
+
+void websocket_server::close(connection &connection, uint16_t status)
+{
+    {
+        // Do not interrupt a reply being written
+        std::lock_guard<std::mutex> lock(connection.channel->send_mutex);
+        const uint8_t payload[] = {static_cast<uint8_t>(status >> 8), static_cast<uint8_t>(status)};
+        if (connection.channel->open)
+            send_frame(connection.channel->client, close_frame, true, payload, sizeof(payload));
+
+        connection.channel->open = false;
+        connection.channel->client.stop();
+    }
+
+    // Workers may still hold the channel; writes to it fail
+    std::lock_guard<std::mutex> lock(mutex_);
+    connection.channel.reset();
+}
+
+bool websocket_server::handle_frame(connection &connection, uint8_t opcode, bool final, uint8_t *payload, size_t length)
+{
+    switch (opcode)
+    {
+    case close_frame:
+        close(connection, CLOSE_NORMAL);
+        return false;
+
+    case ping:
+    {
+        // Control frames are not fragmented and carry at most 125 bytes
+        if (!final || length > sizeof(connection.channel->pong))
+        {
+            close(connection, CLOSE_PROTOCOL_ERROR);
+            return false;
+        }
+
+        // Only the latest ping needs a pong (RFC 6455, 5.5.3). The reader does not wait for a reply being written:
+        // the writer sends the pong after its next fragment, or the reader once the connection is free
+        auto &channel = *connection.channel;
+        {
+            std::lock_guard<std::mutex> lock(channel.pong_mutex);
+            memcpy(channel.pong, payload, length);
+            channel.pong_length = length;
+            channel.pong_pending = true;
+        }
+
+        send_pong(channel);
+        return true;
+    }
+
+    case pong:
+        return true;
+
+    case text:
+    case binary:
+    case continuation:
+        if ((opcode == continuation) != connection.in_message)
+        {
+            close(connection, CLOSE_PROTOCOL_ERROR);
+            return false;
+        }
+
+        if (connection.message_length + length > max_message_length)
+        {
+            close(connection, CLOSE_TOO_BIG);
+            return false;
+        }
+
+        memcpy(connection.message + connection.message_length, payload, length);
+        connection.message_length += length;
+        connection.in_message = !final;
+        if (final)
+        {
+            // Workers get a copy, so the next message can be received while it is handled
+            auto data = static_cast<char *>(malloc(connection.message_length + 1));
+            if (!data)
+            {
+                log_e("Not enough memory for a websocket message");
+                connection.message_length = 0;
+                return true;
+            }
+
+            memcpy(data, connection.message, connection.message_length);
+            data[connection.message_length] = '\0';
+            auto pending = new pending_message{connection.channel, data, connection.message_length};
+            connection.message_length = 0;
+            if (xQueueSend(queue_, &pending, pdMS_TO_TICKS(WEBSOCKET_QUEUE_TIMEOUT)) != pdTRUE)
+            {
+                log_w("Websocket workers busy; message dropped");
+                free(pending->data);
+                delete pending;
+            }
+        }
+
+        return true;
+
+    default:
+        close(connection, CLOSE_PROTOCOL_ERROR);
+        return false;
+    }
+}
+
+bool websocket_server::read(connection &connection, bool &progress)
+{
+    auto fd = connection.channel->client.fd();
+    if (fd < 0)
+        return false;
+
+    auto capacity = max_message_length + WEBSOCKET_MAX_HEADER_LENGTH;
+    auto received = ::recv(fd, connection.buffer + connection.length, capacity - connection.length, MSG_DONTWAIT);
+    if (received == 0)
+        return false;
+
+    if (received < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+
+    connection.length += received;
+    progress = true;
+
+    // Handle the complete frames
+    for (;;)
+    {
+        if (connection.length < 2)
+            break;
+
+        auto buffer = connection.buffer;
+        auto final = (buffer[0] & 0x80) != 0;
+        uint8_t opcode = buffer[0] & 0x0f;
+        uint64_t length = buffer[1] & 0x7f;
+        size_t position = 2;
+        if (length == 126)
+        {
+            if (connection.length < 4)
+                break;
+
+            length = buffer[2] << 8 | buffer[3];
+            position = 4;
+        }
+        else if (length == 127)
+        {
+            if (connection.length < 10)
+                break;
+
+            length = 0;
+            for (auto i = 0; i < 8; i++)
+                length = length << 8 | buffer[2 + i];
+
+            position = 10;
+        }
+
+        // Client frames must be masked
+        if (!(buffer[1] & 0x80))
+        {
+            close(connection, CLOSE_PROTOCOL_ERROR);
+            return false;
+        }
+
+        if (length > max_message_length)
+        {
+            close(connection, CLOSE_TOO_BIG);
+            return false;
+        }
+
+        if (connection.length < position + 4 + length)
+            break;
+
+        const auto mask = buffer + position;
+        auto payload = buffer + position + 4;
+        for (size_t i = 0; i < length; i++)
+            payload[i] ^= mask[i % 4];
+
+        if (!handle_frame(connection, opcode, final, payload, length))
+            return false;
+
+        auto frame_length = position + 4 + length;
+        connection.length -= frame_length;
+        memmove(buffer, buffer + frame_length, connection.length);
+    }
+
+    return true;
+}
+
+void websocket_server::reader_task(void *parameter)
+{
+    auto server = static_cast<websocket_server *>(parameter);
+    for (;;)
+    {
+        auto progress = false;
+        auto connected = false;
+        for (auto &connection : server->connections_)
+        {
+            {
+                // accept() fills free slots; only this task closes them
+                std::lock_guard<std::mutex> lock(server->mutex_);
+                if (!connection.channel)
+                    continue;
+            }
+
+            connected = true;
+            if (!server->read(connection, progress) && connection.channel)
+            {
+                log_i("Websocket client disconnected");
+                server->close(connection, CLOSE_NORMAL);
+            }
+            else if (connection.channel)
+                // A pong owed while a reply was being written
+                send_pong(*connection.channel);
+        }
+
+        if (!connected)
+            // Wait for a connection
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        else if (!progress)
+            vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_IDLE_DELAY));
+    }
+}
+
+void websocket_server::worker_task(void *parameter)
+{
+    auto server = static_cast<websocket_server *>(parameter);
+    for (;;)
+    {
+        pending_message *pending;
+        if (xQueueReceive(server->queue_, &pending, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        if (pending->channel->open)
+            server->handler_(websocket_message(pending->channel, pending->data, pending->length));
+
+        free(pending->data);
+        delete pending;
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <http_server.h>
+
+// Connection shared by the reader task and the workers writing replies
+struct websocket_channel
+{
+    WiFiClient client;
+    // Replies (and control frames) are written under this lock, so frames of different messages do not interleave
+    std::mutex send_mutex;
+    // Attachments are sent as binary messages (the client connected with ?binary=1)
+    bool binary = false;
+    std::atomic<bool> open{true};
+
+    // Pong owed for the latest ping. Sent by the reader when the connection is free, or by a writer between the
+    // fragments of its reply (control frames may be interleaved with fragments)
+    std::mutex pong_mutex;
+    uint8_t pong[125];
+    size_t pong_length = 0;
+    bool pong_pending = false;
+
+    // Sends the owed pong, if any. send_mutex must be held
+    void send_pending_pong();
+};
+
+// Complete (reassembled) message received from a client
+class websocket_message
+{
+public:
+    websocket_message(std::shared_ptr<websocket_channel> channel, const char *data, size_t length)
+        : channel_(channel), data_(data), length_(length)
+    {
+    }
+
+    // Zero terminated
+    const char *data() const
+    {
+        return data_;
+    }
+    size_t length() const
+    {
+        return length_;
+    }
+    bool binary_attachments() const
+    {
+        return channel_->binary;
+    }
+    const std::shared_ptr<websocket_channel> &channel() const
+    {
+        return channel_;
+    }
+
+private:
+    std::shared_ptr<websocket_channel> channel_;
+    const char *data_;
+    size_t length_;
+};
+
+// Writes a text message in fragments while it is produced, so the length does not need to be known.
+// The connection is locked for other replies from the first write until the writer is destroyed, so create the writer
+// when the reply is ready to be sent
+class websocket_writer : public Print
+{
+public:
+    explicit websocket_writer(const websocket_message &message);
+    websocket_writer(const websocket_writer &) = delete;
+    websocket_writer &operator=(const websocket_writer &) = delete;
+    ~websocket_writer();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    // Sends the last fragment. Nothing is sent if nothing was written
+    void end();
+    // Sends a binary message; the text message must have been ended
+    void send_binary(const uint8_t *data, size_t length);
+
+private:
+    void send_fragment(bool final);
+
+    std::shared_ptr<websocket_channel> channel_;
+    std::unique_lock<std::mutex> lock_;
+    bool started_ = false;
+    bool ended_ = false;
+    // One TCP segment
+    uint8_t buffer_[1436];
+    size_t length_ = 0;
+};
+
+// WebSocket (RFC 6455) server for connections upgraded by an http_server handler. A reader task reads all connections
+// without blocking and reassembles the messages; complete messages are handled by a pool of worker tasks, so several
+// requests of a connection can be in progress at the same time (replies may be sent in a different order).
+class websocket_server
+{
+public:
+    static constexpr size_t max_connections = 2;
+    static constexpr size_t max_message_length = 8192;
+
+    using handler = std::function<void(const websocket_message &message)>;
+
+    // Starts the reader task and workers pinned to core
+    bool begin(handler handler, size_t workers, BaseType_t core);
+
+    // Completes the handshake and takes over the connection. Sends an error response if the request is not a valid
+    // WebSocket upgrade or all connections are in use
+    bool accept(http_request &request, http_response &response);
+    size_t connection_count();
+
+private:
+    struct connection
+    {
+        std::shared_ptr<websocket_channel> channel;
+        // Received frame data, and the message being reassembled
+        uint8_t *buffer = nullptr;
+        size_t length = 0;
+        char *message = nullptr;
+        size_t message_length = 0;
+        bool in_message = false;
+    };
+
+    struct pending_message
+    {
+        std::shared_ptr<websocket_channel> channel;
+        char *data;
+        size_t length;
+    };
+
+    static void reader_task(void *parameter);
+    static void worker_task(void *parameter);
+
+    // Reads available data and handles the complete frames. Returns false if the connection is closed
+    bool read(connection &connection, bool &progress);
+    // Handles a complete frame. Returns false if the connection is to be closed
+    bool handle_frame(connection &connection, uint8_t opcode, bool final, uint8_t *payload, size_t length);
+    void close(connection &connection, uint16_t status);
+
+    handler handler_;
+    TaskHandle_t reader_task_ = nullptr;
+    QueueHandle_t queue_ = nullptr;
+
+    std::mutex mutex_;
+    connection connections_[max_connections];
+};
@@ -0,0 +1,96 @@
+#include "work_queue.h"
+
+constexpr auto WORKER_TASK_STACK_SIZE = 12288;
+constexpr auto WORKER_TASK_PRIORITY = 1;
+
+void work_queue::job::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_changed_.wait(lock, [this]()
+                       { return done_; });
+    if (exception_)
+        std::rethrow_exception(exception_);
+}
+
+void work_queue::job::run()
+{
+    try
+    {
+        work_();
+    }
+    catch (...)
+    {
+        exception_ = std::current_exception();
+    }
+
+    // The captures of the work are released before the caller continues
+    work_ = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    done_changed_.notify_all();
+}
+
+bool work_queue::begin(size_t workers, BaseType_t core, size_t capacity /*= 8*/)
+{
+    if (queue_)
+        return true;
+
+    // The queue holds references to the jobs (job_ptr *), deleted by the worker
+    queue_ = xQueueCreate(capacity, sizeof(job_ptr *));
+    if (!queue_)
+    {
+        log_e("Unable to create the work queue");
+        return false;
+    }
+
+    for (size_t i = 0; i < workers; i++)
+        if (xTaskCreatePinnedToCore(worker_task, "work", WORKER_TASK_STACK_SIZE, this, WORKER_TASK_PRIORITY, nullptr, core) != pdPASS)
+        {
+            log_e("Unable to create work task %u", static_cast<unsigned>(i));
+            if (i == 0)
+            {
+                vQueueDelete(queue_);
+                queue_ = nullptr;
+                return false;
+            }
+
+            break;
+        }
+
+    log_i("Work queue started with %u workers on core %d", static_cast<unsigned>(workers), core);
+    return true;
+}
+
+work_queue::job_ptr work_queue::submit(std::function<void()> work)
+{
+    auto queued = std::make_shared<job>();
+    queued->work_ = std::move(work);
+    if (queue_)
+    {
+        auto reference = new job_ptr(queued);
+        if (xQueueSend(queue_, &reference, 0) == pdTRUE)
+            return queued;
+
+        delete reference;
+        log_w("Work queue full: running the work in the calling task");
+    }
+
+    queued->run();
+    return queued;
+}
+
+void work_queue::worker_task(void *parameter)
+{
+    auto queue = static_cast<work_queue *>(parameter);
+    for (;;)
+    {
+        job_ptr *reference;
+        if (xQueueReceive(queue->queue_, &reference, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        (*reference)->run();
+        delete reference;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Pool of tasks pinned to one core that run submitted work. Moves work to the other core than the one of the caller,
+// which can do something else (for example send the previous reply) until it waits for the work
+class work_queue
+{
+public:
+    class job
+    {
+    public:
+        // Waits until the work has run and rethrows the exception it ended with, if any
+        void wait();
+
+    private:
+        friend class work_queue;
+
+        void run();
+
+        std::function<void()> work_;
+        std::exception_ptr exception_;
+        std::mutex mutex_;
+        std::condition_variable done_changed_;
+        bool done_ = false;
+    };
+
+    using job_ptr = std::shared_ptr<job>;
+
+    // Starts the worker tasks pinned to core. Up to capacity jobs wait for a worker
+    bool begin(size_t workers, BaseType_t core, size_t capacity = 8);
+    bool running() const
+    {
+        return queue_ != nullptr;
+    }
+
+    // Queues work. Without workers (not started) or with a full queue, the work is run by the caller
+    job_ptr submit(std::function<void()> work);
+    // Runs work on a worker and waits for it
+    void run(std::function<void()> work)
+    {
+        submit(std::move(work))->wait();
+    }
+
+private:
+    static void worker_task(void *parameter);
+
+    QueueHandle_t queue_ = nullptr;
+};
@@ -1,20 +1,30 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <ESPmDNS.h>
-#include <WebServer.h>
 #include <ArduinoOTA.h>
 #include <esp_camera.h>
 #include <esp_task_wdt.h>
 #include <soc/rtc_cntl_reg.h>
 
 #include <mcp.h>
-#include <base64.h>
+#include <mcp_batch.h>
+#include <http_server.h>
+#include <mjpeg_stream.h>
+#include <image.h>
+#include <metrics.h>
+#include <event_stream.h>
+#include <websocket.h>
+#include <work_queue.h>
+#include <camera_tools.h>
+#ifdef RECORDING
+#include <SD_MMC.h>
+#include <SPIFFS.h>
+#endif
 
 #include "camera_config.h"
 
 #ifdef ENABLE_GZIP
-// miniz is a small public-domain zlib/gzip alternative commonly available with ESP32 Arduino
-#include <miniz.h>
+#include <deflate_stream.h>
 #endif
 
 #ifndef WIFI_SSID
@@ -29,6 +39,53 @@
 #error "LED_GPIO is not defined. Please define it in your build flags."
 #endif
 
+// Minimal time between frames of the grab task (milliseconds)
+#ifndef CAMERA_GRAB_INTERVAL
+#define CAMERA_GRAB_INTERVAL 100
+#endif
+
+// Idle time after which a kept-alive connection is closed (milliseconds; 0 closes after every response) and the
+// maximum number of requests per connection
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT
+#define HTTP_KEEP_ALIVE_TIMEOUT 10000
+#endif
+#ifndef HTTP_KEEP_ALIVE_REQUESTS
+#define HTTP_KEEP_ALIVE_REQUESTS 100
+#endif
+
+// Size of the arena for the JSON documents of a request (one per HTTP worker) and the memory it is allocated in
+#ifndef JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE 16384
+#endif
+#ifndef JSON_ARENA_CAPS
+#ifdef BOARD_HAS_PSRAM
+#define JSON_ARENA_CAPS MALLOC_CAP_SPIRAM
+#else
+#define JSON_ARENA_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+#endif
+
+// Minimal time between frames analysed by the motion detector (milliseconds)
+#ifndef MOTION_INTERVAL
+#define MOTION_INTERVAL 200
+#endif
+
+// Memory (PSRAM) and maximal number of frames of the frame history, and the time between stored frames (milliseconds)
+#ifndef HISTORY_SIZE
+#define HISTORY_SIZE 1048576
+#endif
+#ifndef HISTORY_FRAMES
+#define HISTORY_FRAMES 128
+#endif
+#ifndef HISTORY_INTERVAL
+#define HISTORY_INTERVAL 500
+#endif
+
+// Directory of the recordings on the SD card (or SPIFFS without card)
+#ifndef RECORDING_DIRECTORY
+#define RECORDING_DIRECTORY "/recordings"
+#endif
+
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
@@ -40,57 +97,47 @@ constexpr auto MAX_RECONNECT_ATTEMPTS = 5;
 
 constexpr auto WATCHDOG_TIMEOUT = 30000UL; // 30 seconds
 
+// Number of tasks handling HTTP requests concurrently
+constexpr auto HTTP_WORKERS = 2;
+// Number of tasks handling the MCP messages of the WebSocket connections concurrently
+constexpr auto WEBSOCKET_WORKERS = 2;
+
+// The WiFi driver and lwIP run on core 0, so the web server and the stream send task run there as well.
+// Grabbing, encoding and analysing frames and the tool calls run on core 1, next to loop() (which only handles WiFi and OTA)
+constexpr BaseType_t NETWORK_CORE = 0;
+constexpr BaseType_t CAPTURE_CORE = 1;
+// Number of tasks on the capture core handling the MCP requests the workers of both servers received
+constexpr auto REQUEST_HANDLERS = 2;
+
+// Notifications pushed to the event streams: time between checks, minimal time between frame notifications
+// and the free heap below which a warning is sent (again after it recovered by LOW_HEAP_HYSTERESIS)
+constexpr auto EVENT_CHECK_INTERVAL = 100UL;  // 0.1 seconds
+constexpr auto EVENT_FRAME_INTERVAL = 5000UL; // 5 seconds
+constexpr auto LOW_HEAP_THRESHOLD = 30000U;
+constexpr auto LOW_HEAP_HYSTERESIS = 10000U;
+
+// Size of the reads when sending a recording
+constexpr auto RECORDING_READ_SIZE = 4096;
+
 // WiFi status tracking
 unsigned long lastWiFiCheck = 0;
 unsigned long lastReconnectAttempt = 0;
 int reconnectAttempts = 0;
 bool wifiConnected = false;
 
-// Result of camera initialization
-esp_err_t camera_init_result = ESP_OK;
-// Temperature export (funny; has a typo!)
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-  uint8_t temprature_sens_read();
-#ifdef __cplusplus
-}
-#endif
+// JSON documents of the requests; reset at the end of every request. A batch uses a second arena for its responses
+// (the arenas are only allocated when needed)
+json_arena_pool json_arenas(2 * (HTTP_WORKERS + WEBSOCKET_WORKERS), JSON_ARENA_SIZE, JSON_ARENA_CAPS);
+// Handles the MCP methods (tool calls) on the capture core, while the workers parse and send on the network core
+work_queue request_handlers;
+// Live view for browsers
+mjpeg_stream stream;
+// Server-Sent Events of the MCP sessions
+event_stream events;
+// MCP over WebSocket
+websocket_server websockets;
 
-WebServer server(80);
-
-// Generic Accept-Encoding check
-static bool client_accepts(const char *encoding)
-{
-  if (!server.hasHeader("Accept-Encoding"))
-    return false;
-  auto accept = server.header("Accept-Encoding");
-  accept.toLowerCase();
-  return accept.indexOf(encoding) >= 0;
-}
-
-#ifdef ENABLE_GZIP
-// Optional deflate (zlib) compression using miniz. Returns true on success and writes binary data to output.
-static bool deflate_compress(const String &input, String &output)
-{
-  auto src = reinterpret_cast<const unsigned char *>(input.c_str());
-  auto src_len = static_cast<mz_ulong>(input.length());
-  auto bound = mz_compressBound(src_len);
-  std::unique_ptr<unsigned char, decltype(&free)> buf(
-      static_cast<unsigned char *>(malloc(bound)), &free);
-  if (!buf)
-    return false;
-  auto out_len = bound;
-  auto st = mz_compress2(buf.get(), &out_len, src, src_len, MZ_DEFAULT_LEVEL);
-  if (st != MZ_OK)
-  {
-    return false;
-  }
-  output = String(reinterpret_cast<const char *>(buf.get()), static_cast<unsigned int>(out_len));
-  return true;
-}
-#endif
+http_server server(80);
 
 void handle_initialize(mcp_response &response)
 {
@@ -99,11 +146,31 @@ void handle_initialize(mcp_response &response)
   auto capabilities = result["capabilities"].to<JsonObject>();
   auto tools = capabilities["tools"].to<JsonObject>();
   tools["listChanged"] = false;
+  // Motion, frame, WiFi and memory notifications are pushed as log messages on the event stream (GET /)
+  capabilities["logging"].to<JsonObject>();
   auto server_info = result["serverInfo"].to<JsonObject>();
   server_info["name"] = "ESP32-CAM-AI MCP Server";
   server_info["version"] = "1.0.1";
 }
 
+// Pushes an MCP log message to the event streams of all sessions
+void push_notification(const char *level, const char *logger, std::function<void(JsonObject data)> build)
+{
+  if (events.session_count() == 0)
+    return;
+
+  JsonDocument doc;
+  doc["jsonrpc"] = "2.0";
+  doc["method"] = "notifications/message";
+  auto params = doc["params"].to<JsonObject>();
+  params["level"] = level;
+  params["logger"] = logger;
+  build(params["data"].to<JsonObject>());
+  String message;
+  serializeJson(doc, message);
+  events.publish(message);
+}
+
 void handle_notifications_initialized(mcp_response &response)
 {
   // For notifications, we don't need to send a response body
@@ -112,77 +179,6 @@ void handle_notifications_initialized(mcp_response &response)
   result["acknowledged"] = true;
 }
 
-void handle_tools_list(mcp_response &response)
-{
-  auto result = response.create_result();
-  auto tools = result["tools"].to<JsonArray>();
-
-  // Add LED control tool
-  auto led_tool = tools.add<JsonObject>();
-  led_tool["name"] = "led";
-  led_tool["description"] = "Controls the ESP32-CAM LED state";
-  auto led_tool_input_schema = led_tool["inputSchema"].to<JsonObject>();
-  led_tool_input_schema["type"] = "object";
-  auto led_tool_input_schema_properties = led_tool_input_schema["properties"].to<JsonObject>();
-  auto led_tool_input_schema_properties_state = led_tool_input_schema_properties["state"].to<JsonObject>();
-  led_tool_input_schema_properties_state["type"] = "string";
-  led_tool_input_schema_properties_state["description"] = "LED state";
-  auto led_tool_input_schema_properties_state_enum_array = led_tool_input_schema_properties_state["enum"].to<JsonArray>();
-  led_tool_input_schema_properties_state_enum_array.add("on");
-  led_tool_input_schema_properties_state_enum_array.add("off");
-  auto led_tool_input_schema_properties_state_required = led_tool_input_schema_properties_state["required"].to<JsonArray>();
-  led_tool_input_schema_properties_state_required.add("state");
-  led_tool_input_schema["additionalProperties"] = false;
-
-  // Add Flash control tool
-  auto flash_tool = tools.add<JsonObject>();
-  flash_tool["name"] = "flash";
-  flash_tool["description"] = "Controls the ESP32-CAM Flash";
-  auto flash_tool_input_schema = flash_tool["inputSchema"].to<JsonObject>();
-  flash_tool_input_schema["type"] = "object";
-  auto flash_tool_input_schema_properties = flash_tool_input_schema["properties"].to<JsonObject>();
-  auto flash_tool_input_schema_properties_duration = flash_tool_input_schema_properties["duration"].to<JsonObject>();
-  flash_tool_input_schema_properties_duration["description"] = "Flash duration in milliseconds";
-  flash_tool_input_schema_properties_duration["type"] = "number";
-  flash_tool_input_schema_properties_duration["minimum"] = 5;
-  flash_tool_input_schema_properties_duration["maximum"] = 100;
-  flash_tool_input_schema_properties_duration["default"] = 50;
-  flash_tool_input_schema["additionalProperties"] = false;
-
-  // Add camera capture tool
-  auto camera_tool = tools.add<JsonObject>();
-  camera_tool["name"] = "capture";
-  camera_tool["description"] = "Captures a photo from the ESP32-CAM";
-  auto camera_tool_input_schema = camera_tool["inputSchema"].to<JsonObject>();
-  camera_tool_input_schema["type"] = "object";
-  auto camera_tool_input_schema_properties = camera_tool_input_schema["properties"].to<JsonObject>();
-  auto camera_tool_input_schema_properties_flash = camera_tool_input_schema_properties["flash"].to<JsonObject>();
-  camera_tool_input_schema_properties_flash["type"] = "string";
-  camera_tool_input_schema_properties_flash["description"] = "Use flash when capturing";
-  auto camera_tool_input_schema_properties_flash_enum_array = camera_tool_input_schema_properties_flash["enum"].to<JsonArray>();
-  camera_tool_input_schema_properties_flash_enum_array.add("on");
-  camera_tool_input_schema_properties_flash_enum_array.add("off");
-  camera_tool_input_schema["additionalProperties"] = false;
-
-  // Add WiFi status tool
-  auto wifi_tool = tools.add<JsonObject>();
-  wifi_tool["name"] = "wifi_status";
-  wifi_tool["description"] = "Gets current WiFi connection status and network information";
-  auto wifi_tool_input_schema = wifi_tool["inputSchema"].to<JsonObject>();
-  wifi_tool_input_schema["type"] = "object";
-  auto wifi_tool_input_schema_properties = wifi_tool_input_schema["properties"].to<JsonObject>();
-  wifi_tool_input_schema["additionalProperties"] = false;
-
-  // Add system status tool
-  auto system_tool = tools.add<JsonObject>();
-  system_tool["name"] = "system_status";
-  system_tool["description"] = "Gets comprehensive system status including memory, uptime, and hardware info";
-  auto system_tool_input_schema = system_tool["inputSchema"].to<JsonObject>();
-  system_tool_input_schema["type"] = "object";
-  auto system_tool_input_schema_properties = system_tool_input_schema["properties"].to<JsonObject>();
-  system_tool_input_schema["additionalProperties"] = false;
-}
-
 void checkWiFiConnection()
 {
   auto now = millis();
@@ -250,226 +246,249 @@ void checkWiFiConnection()
   }
 }
 
-void tool_led(JsonObject arguments, mcp_response &response)
+// Handles the methods answered using the response document
+void handle_method(const mcp_request &request, mcp_response &response)
 {
-  auto state = arguments["state"].as<String>();
-  if (state == "on")
-  {
-    digitalWrite(LED_GPIO, LED_ON_LEVEL);
-    auto result = response.create_result();
-    auto result_content = result["content"].to<JsonArray>();
-    auto result_content_item = result_content.add<JsonObject>();
-    result_content_item["type"] = "text";
-    result_content_item["text"] = "LED turned on";
-  }
-  else if (state == "off")
-  {
-    digitalWrite(LED_GPIO, LED_ON_LEVEL == LOW ? HIGH : LOW);
-    auto result = response.create_result();
-    auto result_content = result["content"].to<JsonArray>();
-    auto result_content_item = result_content.add<JsonObject>();
-    result_content_item["type"] = "text";
-    result_content_item["text"] = "LED turned off";
-  }
+  stage_timer timer(metric_stage::dispatch);
+  if (request.method() == "initialize")
+    handle_initialize(response);
+  else if (request.method() == "notifications/initialized")
+    handle_notifications_initialized(response);
+  else if (request.method() == "tools/call")
+    handle_tools_call(request, response);
   else
   {
     auto error = response.create_error();
-    error["code"] = error_code::invalid_params;
-    error["message"] = "Invalid LED state. Use 'on' or 'off'.";
+    error["code"] = error_code::method_not_found;
+    error["message"] = "Method not found: " + String(request.method().c_str());
   }
 }
 
-void tool_flash(JsonObject arguments, mcp_response &response)
+// Batches: the methods are handled on the capture core one ahead of sending, tools/list with the precomputed result
+mcp_batch batches(handle_method, request_handlers, &tools_list_result);
+
+// JSON-RPC batch: the responses are streamed as one array to output; begin is called before the first response.
+// Returns the number of responses
+size_t write_batch(mcp_message &message, json_arena *arena, Print &output, std::function<void()> begin)
 {
-  auto duration = arguments["duration"].is<int>() ? arguments["duration"].as<int>() : 50; // Default to 50ms if not provided
-  digitalWrite(FLASH_GPIO, FLASH_ON_LEVEL);
-  delay(duration); // 5-100ms
-  digitalWrite(FLASH_GPIO, !FLASH_ON_LEVEL);
-  auto result = response.create_result();
-  auto result_content = result["content"].to<JsonArray>();
-  auto result_content_item = result_content.add<JsonObject>();
-  result_content_item["type"] = "text";
-  result_content_item["text"] = "Flash executed";
+  // The response being sent and the one being made each have an arena of their own: the rest of the arena of the
+  // message and a second one (or the heap)
+  json_arena_pool::lease second_arena(json_arenas);
+  return batches.write(message, arena, second_arena.arena(), output, begin);
 }
 
-void tool_capture(JsonObject arguments, mcp_response &response)
+void handle_batch(mcp_message &message, json_arena *arena, http_response &response)
 {
-  if (camera_init_result != ESP_OK)
+  if (write_batch(message, arena, response, [&]()
+                  { response.begin(200, "application/json"); }) == 0)
   {
-    auto error = response.create_error();
-    error["code"] = error_code::internal_error;
-    error["message"] = "Camera not initialized or failed to initialize";
+    // Only notifications
+    response.send(204, "text/plain", "");
     return;
   }
 
-  auto flash = arguments["flash"].as<String>();
-  if (flash == "on")
-  {
-    digitalWrite(FLASH_GPIO, FLASH_ON_LEVEL);
-    delay(20); // Allow flash to stabilize
-  }
+  response.end();
+}
 
-  // Discard 1-2 warm-up frames to ensure a fresh capture
-  auto fb  = esp_camera_fb_get();
-  if (fb)
-    esp_camera_fb_return(fb);
+// Handles a JSON-RPC message (or batch) received over a WebSocket connection. Messages of a connection are handled
+// concurrently by the workers; the client matches the replies to its requests by id
+void handle_websocket_message(const websocket_message &message)
+{
+  metric_increment(metric_counter::requests);
+  json_arena_pool::lease arena(json_arenas);
+  mcp_response mcp_response(arena.allocator());
+  try
+  {
+    stage_timer parse_timer(metric_stage::parse);
+    mcp_message request_message(message.data(), message.length(), arena.allocator());
+    parse_timer.stop();
+    if (request_message.is_batch())
+    {
+      // The writer locks the connection from the first reply of the batch on. Attachments of batch responses are
+      // always base64 encoded
+      websocket_writer writer(message);
+      write_batch(request_message, arena.arena(), writer, []() {});
+      return;
+    }
 
-  fb = esp_camera_fb_get();
-  if (fb)
-    esp_camera_fb_return(fb);
+    auto mcp_request = request_message[0];
+    // Notifications are not answered
+    if (mcp_request.is_notification())
+    {
+      request_handlers.run([&]()
+                           { handle_method(mcp_request, mcp_response); });
+      return;
+    }
 
-  // Take the actual frame
-  fb = esp_camera_fb_get();
-  // Turn flash off immediately after capture attempt
-  digitalWrite(FLASH_GPIO, !FLASH_ON_LEVEL);
+    mcp_response.set_id(mcp_request.id());
+    if (mcp_request.method() == "tools/list")
+    {
+      String id;
+      serializeJson(mcp_request.id(), id);
+      stage_timer send_timer(metric_stage::send);
+      websocket_writer writer(message);
+      metric_increment(metric_counter::response_bytes, tools_list_result.write_to(writer, id, false));
+      return;
+    }
 
-  if (!fb)
+    request_handlers.run([&]()
+                         { handle_method(mcp_request, mcp_response); });
+  }
+  catch (const mcp_exception &e)
   {
-    auto error = response.create_error();
-    error["code"] = error_code::internal_error;
-    error["message"] = "Camera capture failed";
-    return;
+    auto error = mcp_response.create_error();
+    error["code"] = e.code();
+    error["message"] = e.what();
   }
 
-  auto base64_image = base64::encode(fb->buf, fb->len);
-  esp_camera_fb_return(fb);
+  if (mcp_response.http_code() != 200)
+    metric_increment(metric_counter::errors);
+
+  // The response is complete: the connection is only locked for other replies while it is sent
+  stage_timer send_timer(metric_stage::send);
+  websocket_writer writer(message);
+  size_t length;
+  if (message.binary_attachments())
+    // The images follow the JSON text message as binary messages, referenced as "binary:<n>"
+    length = mcp_response.write_to(writer, [&](const uint8_t *data, size_t length)
+                                   { writer.send_binary(data, length); });
+  else
+    length = mcp_response.write_to(writer);
 
-  auto result = response.create_result();
-  auto result_content = result["content"].to<JsonArray>();
-  auto result_content_item = result_content.add<JsonObject>();
-  result_content_item["type"] = "text";
-  result_content_item["text"] = "Image captured successfully. Size: " + String(base64_image.length()) + " bytes (base64 encoded)";
-
-  auto result_content_image_item = result_content.add<JsonObject>();
-  result_content_image_item["type"] = "image";
-  result_content_image_item["data"] = base64_image;
-  result_content_image_item["mimeType"] = "image/jpeg";
+  writer.end();
+  metric_increment(metric_counter::response_bytes, length);
 }
 
-void tool_wifi_status(mcp_response &response)
+void handle_websocket(http_request &request, http_response &response)
 {
-  auto result = response.create_result();
-  auto result_content = result["content"].to<JsonArray>();
-  auto result_content_item = result_content.add<JsonObject>();
-  result_content_item["type"] = "text";
-
-  auto status_text = String();
-  status_text += "IP Address: " + WiFi.localIP().toString() + "\n";
-  status_text += "Signal Strength: " + String(WiFi.RSSI()) + " dBm\n";
-  status_text += "MAC Address: " + WiFi.macAddress() + "\n";
-  status_text += "Gateway: " + WiFi.gatewayIP().toString() + "\n";
-  status_text += "DNS: " + WiFi.dnsIP().toString() + "\n";
-  result_content_item["text"] = status_text;
+  response.add_header("Access-Control-Allow-Origin", "*");
+  websockets.accept(request, response);
 }
 
-void tool_system_status(mcp_response &response)
+// Opens the event stream (Server-Sent Events) of the session in the Mcp-Session-Id header
+void handle_event_stream(http_request &request, http_response &response)
 {
-  auto result = response.create_result();
-  auto result_content = result["content"].to<JsonArray>();
-  auto result_content_item = result_content.add<JsonObject>();
-  result_content_item["type"] = "text";
-
-  // Get the tem
-
-  auto status_text = String("System Status:\n");
-  status_text += "Uptime: " + String(millis() / 1000) + " seconds\n";
-  status_text += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
-  status_text += "Min Free Heap: " + String(ESP.getMinFreeHeap()) + " bytes\n";
-  status_text += "Max Alloc Heap: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
-  status_text += "CPU Frequency: " + String(getCpuFrequencyMhz()) + " MHz\n";
-  status_text += "Flash Size: " + String(ESP.getFlashChipSize()) + " bytes\n";
-  status_text += "Flash Speed: " + String(ESP.getFlashChipSpeed()) + " Hz\n";
-  status_text += "Sketch Size: " + String(ESP.getSketchSize()) + " bytes\n";
-  status_text += "Free Sketch Space: " + String(ESP.getFreeSketchSpace()) + " bytes\n";
-  status_text += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
-  status_text += "Reset Reason: " + String(esp_reset_reason()) + "\n";
-  status_text += "Camera initialized: " + String(camera_init_result == ESP_OK ? "Yes" : "No (code = 0x" + String(camera_init_result, 16) + ")") + "\n";
-  auto internal_temperature = (temprature_sens_read() - 32) / 1.8;
-  status_text += "Internal Temperature: " + String(internal_temperature, 2) + " °C\n";
-  result_content_item["text"] = status_text;
-}
+  auto session = request.header("Mcp-Session-Id");
+  if (request.header("Accept").indexOf("text/event-stream") < 0)
+  {
+    response.send(406, "text/plain", "Accept must include text/event-stream");
+    return;
+  }
 
-void handle_tools_call(const mcp_request &request, mcp_response &response)
-{
-  auto params = request.params();
-  auto tool_name = params["name"].as<String>();
-  auto arguments = params["arguments"].as<JsonObject>();
-
-  if (tool_name == "led")
-    tool_led(arguments, response);
-  else if (tool_name == "flash")
-    tool_flash(arguments, response);
-  else if (tool_name == "capture")
-    tool_capture(arguments, response);
-  else if (tool_name == "wifi_status")
-    tool_wifi_status(response);
-  else if (tool_name == "system_status")
-    tool_system_status(response);
-  else
+  if (!events.has_session(session))
   {
-    // Tool not found, set error
-    auto error = response.create_error();
-    if (tool_name.isEmpty())
-    {
-      error["code"] = error_code::invalid_request;
-      error["message"] = "Tool name is required";
-    }
-    else
-    {
-      error["code"] = error_code::method_not_found;
-      error["message"] = "Unknown tool: " + tool_name;
-    }
+    // Unknown or expired session: the client has to initialize again
+    response.send(session.isEmpty() ? 400 : 404, "text/plain", "Unknown session");
+    return;
   }
+
+  response.add_header("Cache-Control", "no-store");
+  response.begin(200, "text/event-stream", http_response::until_close);
+  // The event stream task takes over the connection; the worker continues with the next request
+  auto client = response.detach();
+  if (!events.attach(session, client))
+    client.stop();
 }
 
-void handleRoot()
+// CORS headers of the MCP endpoint; browsers cache the preflight answer for a day
+constexpr const char *root_cors_headers = "Access-Control-Allow-Origin: *\r\n"
+                                          "Access-Control-Allow-Methods: GET, POST, DELETE, OPTIONS\r\n"
+                                          "Access-Control-Allow-Headers: Content-Type, Authorization, Mcp-Session-Id, Last-Event-ID\r\n"
+                                          "Access-Control-Expose-Headers: Mcp-Session-Id\r\n"
+                                          "Access-Control-Max-Age: 86400\r\n"
+                                          // Content negotiation for caches and proxies
+                                          "Vary: Accept-Encoding\r\n";
+
+void handleRoot(http_request &request, http_response &response)
 {
   // Add CORS headers for all requests
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type, Authorization");
-  server.sendHeader("Access-Control-Max-Age", "86400");
-  // Content negotiation for caches and proxies
-  server.sendHeader("Vary", "Accept-Encoding");
+  response.add_headers(root_cors_headers);
 
-  if (server.method() == HTTP_OPTIONS)
+  if (request.method() == http_method::options)
   {
     // Handle preflight CORS requests
-    server.send(200, "text/plain", "OK");
+    response.send(204, "text/plain", "");
+    return;
+  }
+
+  if (request.method() == http_method::get)
+  {
+    handle_event_stream(request, response);
+    return;
+  }
+
+  if (request.method() == http_method::delete_)
+  {
+    // Client ends the session
+    if (events.end_session(request.header("Mcp-Session-Id")))
+      response.send(200, "text/plain", "OK");
+    else
+      response.send(404, "text/plain", "Unknown session");
+
     return;
   }
 
-  if (server.method() != HTTP_POST)
+  if (request.method() != http_method::post)
   {
-    server.send(405, "text/plain", "Only POST allowed");
+    response.send(405, "text/plain", "Only GET, POST and DELETE allowed");
     return;
   }
 
-  mcp_response mcp_response;
+  metric_increment(metric_counter::requests);
+  // The documents are allocated in the arena, which is reset when the request is done
+  json_arena_pool::lease arena(json_arenas);
+  mcp_response mcp_response(arena.allocator());
   try
   {
-    mcp_request mcp_request(server.arg("plain"));
+    stage_timer parse_timer(metric_stage::parse);
+    mcp_message message(request.body(), request.body_length(), arena.allocator());
+    parse_timer.stop();
+    if (message.is_batch())
+    {
+      handle_batch(message, arena.arena(), response);
+      return;
+    }
+
+    auto mcp_request = message[0];
     mcp_response.set_id(mcp_request.id());
 
     // Handle MCP methods
-    if (mcp_request.method() == "initialize")
-      handle_initialize(mcp_response);
-    else if (mcp_request.method() == "notifications/initialized")
+    if (mcp_request.method() == "notifications/initialized")
     {
       // JSON-RPC notification: do not return a JSON-RPC response body
       log_d("Notifications/initialized received; returning 204 No Content");
-      server.send(204, "text/plain", "");
+      response.send(204, "text/plain", "");
       return;
     }
     else if (mcp_request.method() == "tools/list")
-      handle_tools_list(mcp_response);
-    else if (mcp_request.method() == "tools/call")
-      handle_tools_call(mcp_request, mcp_response);
+    {
+      // Send the precomputed result with the request id spliced in
+      String id;
+      serializeJson(mcp_request.id(), id);
+      auto deflate = request.accepts_encoding("deflate") && tools_list_result.can_deflate();
+      if (deflate)
+        response.add_header("Content-Encoding", "deflate");
+
+      stage_timer send_timer(metric_stage::send);
+      auto length = tools_list_result.length(id, deflate);
+      response.begin(200, "application/json", length);
+      tools_list_result.write_to(response, id, deflate);
+      response.end();
+      metric_increment(metric_counter::response_bytes, length);
+      return;
+    }
     else
     {
-      auto error = mcp_response.create_error();
-      error["code"] = error_code::method_not_found;
-      error["message"] = "Method not found: " + mcp_request.method();
+      if (mcp_request.method() == "initialize")
+      {
+        // The session id identifies the event stream of the client
+        auto session = events.create_session();
+        if (!session.isEmpty())
+          response.add_header("Mcp-Session-Id", session);
+      }
+
+      request_handlers.run([&]()
+                           { handle_method(mcp_request, mcp_response); });
     }
   }
   catch (const mcp_exception &e)
@@ -479,30 +498,266 @@ void handleRoot()
     error["message"] = e.what();
   }
 
-  auto response = mcp_response.get_http_response();
-  // Http Code, Content-Type, and Body
-  auto http_code = std::get<0>(response);
-  auto content_type = std::get<1>(response);
-  auto body = std::get<2>(response);
+  auto http_code = mcp_response.http_code();
+  if (http_code != 200)
+    metric_increment(metric_counter::errors);
+
+  stage_timer send_timer(metric_stage::send);
+  auto length = mcp_response.length();
+  metric_increment(metric_counter::response_bytes, length);
 
 #ifdef ENABLE_GZIP
-  // Try deflate if the client accepts it; fall back to plain text on any failure
-  if (client_accepts("deflate"))
+  // Compress while sending if the client accepts it and the body is not mostly (base64 encoded) image data
+  auto encoding = request.accepts_encoding("gzip") ? content_encoding::gzip : request.accepts_encoding("deflate") ? content_encoding::deflate
+                                                                                                                  : content_encoding::identity;
+  if (encoding != content_encoding::identity && deflate_stream::worthwhile("application/json", length, mcp_response.attachments_length()))
   {
-    String deflated;
-    if (deflate_compress(body, deflated))
+    deflate_stream compressed(response, encoding);
+    if (compressed.begin())
     {
-      server.sendHeader("Content-Encoding", "deflate");
-      log_d("Sending deflate response: %d %s len=%u (deflate)", http_code, content_type, (unsigned)deflated.length());
-      server.send(http_code, content_type, deflated);
+      response.add_header("Content-Encoding", deflate_stream::name(encoding));
+      // Compressed length is unknown: chunked transfer encoding
+      response.begin(http_code, "application/json");
+      mcp_response.write_to(compressed);
+      compressed.end();
+      response.end();
+      log_d("Sent response: %d len=%u (%s %u)", http_code, static_cast<unsigned>(length), deflate_stream::name(encoding), static_cast<unsigned>(compressed.bytes_out()));
       return;
     }
   }
-#endif  
+#endif
 
-  // Deflate not enabled or failed, fall back to plain text
-  log_d("Sending response: %d %s len=%u", http_code, content_type, (unsigned)body.length());
-  server.send(http_code, content_type, body);
+  // Attachments are base64 encoded while sending
+  response.begin(http_code, "application/json", length);
+  mcp_response.write_to(response);
+  response.end();
+  log_d("Sent response: %d len=%u", http_code, static_cast<unsigned>(length));
+}
+
+// Sends the raw JPEG bytes of a stored capture (?token=...) or of a fresh frame
+void handle_capture_jpg(http_request &request, http_response &response)
+{
+  response.add_header("Access-Control-Allow-Origin", "*");
+  response.add_header("Cache-Control", "no-store");
+
+  if (request.method() != http_method::get)
+  {
+    response.send(405, "text/plain", "Only GET allowed");
+    return;
+  }
+
+  if (request.has_arg("token"))
+  {
+    auto token = request.arg("token");
+    size_t length = 0;
+    auto data = find_capture(token, length);
+    if (!data)
+    {
+      response.send(404, "text/plain", "Unknown or expired token");
+      return;
+    }
+
+    response.send(200, "image/jpeg", data.get(), length);
+    return;
+  }
+
+  if (camera_init_result != ESP_OK)
+  {
+    response.send(503, "text/plain", "Camera not initialized or failed to initialize");
+    return;
+  }
+
+  auto max_age = request.has_arg("max_age") ? strtoul(request.arg("max_age").c_str(), nullptr, 10) : CAPTURE_MAX_AGE;
+  auto image = capture_frame(request.arg("flash") == "on", max_age, camera_sensor.configured());
+  if (!image)
+  {
+    response.send(500, "text/plain", "Camera capture failed");
+    return;
+  }
+
+  // Sent from a copy, so the frame buffer goes back to the driver before the (possibly slow) send
+  auto copy = copy_jpeg(image->fb, image->sequence);
+  image.reset();
+  if (!copy)
+  {
+    response.send(500, "text/plain", "Not enough memory for the image");
+    return;
+  }
+
+  response.send(200, "image/jpeg", copy->data, copy->length);
+}
+
+// Starts a multipart/x-mixed-replace stream. Optional arguments: fps (maximum frame rate) and max_width (downscale wider frames)
+void handle_stream(http_request &request, http_response &response)
+{
+  if (request.method() != http_method::get)
+  {
+    response.send(405, "text/plain", "Only GET allowed");
+    return;
+  }
+
+  if (camera_init_result != ESP_OK)
+  {
+    response.send(503, "text/plain", "Camera not initialized or failed to initialize");
+    return;
+  }
+
+  if (stream.client_count() >= mjpeg_stream::max_clients)
+  {
+    response.send(503, "text/plain", "Maximum number of stream clients reached");
+    return;
+  }
+
+  auto max_fps = request.has_arg("fps") ? request.arg("fps").toFloat() : 0.0f;
+  auto max_width = request.has_arg("max_width") ? request.arg("max_width").toInt() : 0;
+  response.add_header("Access-Control-Allow-Origin", "*");
+  response.add_header("Cache-Control", "no-store");
+  response.begin(200, (String("multipart/x-mixed-replace; boundary=") + mjpeg_stream::boundary).c_str(), http_response::until_close);
+  // The stream task takes over the connection; the worker continues with the next request
+  auto client = response.detach();
+  if (!stream.add_client(client, max_fps, max(0L, max_width)))
+    client.stop();
+}
+
+#ifdef RECORDING
+// Sends a recording. Arguments: name and optionally t (seconds from the start) to return a single frame as JPEG
+void handle_recording(http_request &request, http_response &response)
+{
+  response.add_header("Access-Control-Allow-Origin", "*");
+  if (request.method() != http_method::get)
+  {
+    response.send(405, "text/plain", "Only GET allowed");
+    return;
+  }
+
+  auto name = request.arg("name");
+  if (request.has_arg("t"))
+  {
+    auto image = video_recorder.frame_at(name, request.arg("t").toFloat());
+    if (image)
+      response.send(200, "image/jpeg", image->data, image->length);
+    else
+      response.send(404, "text/plain", "No frame available");
+
+    return;
+  }
+
+  auto file = video_recorder.open(name);
+  if (!file)
+  {
+    response.send(404, "text/plain", "Unknown recording");
+    return;
+  }
+
+  std::unique_ptr<uint8_t, decltype(&free)> buffer(static_cast<uint8_t *>(malloc(RECORDING_READ_SIZE)), &free);
+  if (!buffer)
+  {
+    response.send(500, "text/plain", "Not enough memory");
+    return;
+  }
+
+  response.add_header("Content-Disposition", "attachment; filename=\"" + name + "\"");
+  response.begin(200, "video/x-msvideo", file.size());
+  size_t length;
+  while ((length = file.read(buffer.get(), RECORDING_READ_SIZE)) > 0)
+    response.write(buffer.get(), length);
+
+  response.end();
+}
+#endif
+
+// Metrics in the Prometheus text format
+void handle_metrics(http_request &request, http_response &response)
+{
+  if (request.method() != http_method::get)
+  {
+    response.send(405, "text/plain", "Only GET allowed");
+    return;
+  }
+
+  response.add_header("Cache-Control", "no-store");
+  response.begin(200, "text/plain; version=0.0.4");
+  response.printf("# TYPE esp32cam_uptime_seconds gauge\nesp32cam_uptime_seconds %lu\n", millis() / 1000);
+  response.printf("# TYPE esp32cam_heap_free_bytes gauge\nesp32cam_heap_free_bytes %u\n", ESP.getFreeHeap());
+  response.printf("# TYPE esp32cam_heap_min_free_bytes gauge\nesp32cam_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+  response.printf("# TYPE esp32cam_psram_free_bytes gauge\nesp32cam_psram_free_bytes %u\n", ESP.getFreePsram());
+  response.printf("# TYPE esp32cam_wifi_rssi_dbm gauge\nesp32cam_wifi_rssi_dbm %d\n", WiFi.RSSI());
+  auto cache = captures.status();
+  response.printf("# TYPE esp32cam_capture_cache_bytes gauge\nesp32cam_capture_cache_bytes %u\n", static_cast<unsigned>(cache.bytes));
+  response.printf("# TYPE esp32cam_capture_cache_hits_total counter\nesp32cam_capture_cache_hits_total %u\n", static_cast<unsigned>(cache.hits));
+  response.printf("# TYPE esp32cam_capture_cache_misses_total counter\nesp32cam_capture_cache_misses_total %u\n", static_cast<unsigned>(cache.misses));
+  write_metrics(response);
+  response.end();
+}
+
+// Pushes notifications for motion events, new frames and low memory
+void check_notifications()
+{
+  static unsigned long last_check = 0;
+  auto now = millis();
+  if (now - last_check < EVENT_CHECK_INTERVAL || events.session_count() == 0)
+    return;
+
+  last_check = now;
+#ifdef MOTION_DETECTION
+  // Events announced as started and as ended
+  static uint32_t last_started = 0;
+  static uint32_t last_ended = 0;
+  if (motion.status().last_event > last_ended)
+  {
+    for (const auto &event : motion.events(last_ended))
+    {
+      if (event.id > last_started)
+      {
+        last_started = event.id;
+        push_notification("notice", "motion", [&event](JsonObject data)
+                          { data["event"] = event.id;
+                            data["state"] = "started";
+                            data["blocks"] = event.peak_blocks;
+                            data["sequence"] = event.sequence; });
+      }
+
+      if (event.end && event.id > last_ended)
+      {
+        last_ended = event.id;
+        push_notification("info", "motion", [&event](JsonObject data)
+                          { data["event"] = event.id;
+                            data["state"] = "ended";
+                            data["duration"] = (event.end - event.start) / 1000.0;
+                            data["peak_blocks"] = event.peak_blocks; });
+      }
+    }
+  }
+#endif
+
+#ifdef CAMERA_GRAB_TASK
+  // New frames, at most every EVENT_FRAME_INTERVAL
+  static unsigned long last_frame_notification = 0;
+  static uint32_t last_frame_sequence = 0;
+  if (now - last_frame_notification >= EVENT_FRAME_INTERVAL)
+  {
+    auto sequence = frames.sequence();
+    if (sequence != last_frame_sequence)
+    {
+      last_frame_notification = now;
+      last_frame_sequence = sequence;
+      push_notification("debug", "frame", [sequence](JsonObject data)
+                        { data["sequence"] = sequence; });
+    }
+  }
+#endif
+
+  static bool low_heap = false;
+  auto free_heap = ESP.getFreeHeap();
+  if (!low_heap && free_heap < LOW_HEAP_THRESHOLD)
+  {
+    low_heap = true;
+    push_notification("warning", "memory", [free_heap](JsonObject data)
+                      { data["free_heap"] = free_heap;
+                        data["min_free_heap"] = ESP.getMinFreeHeap(); });
+  }
+  else if (low_heap && free_heap > LOW_HEAP_THRESHOLD + LOW_HEAP_HYSTERESIS)
+    low_heap = false;
 }
 
 // WiFi event handlers
@@ -518,10 +773,19 @@ void onWiFiEvent(WiFiEvent_t event)
     log_d("WiFi got IP address: %s", WiFi.localIP().toString().c_str());
     wifiConnected = true;
     reconnectAttempts = 0;
+    push_notification("info", "wifi", [](JsonObject data)
+                      { data["state"] = "connected";
+                        data["ip"] = WiFi.localIP().toString();
+                        data["rssi"] = WiFi.RSSI(); });
     break;
 
   case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
     log_d("WiFi disconnected!");
+    // Delivered when a client reconnects to the event stream
+    if (wifiConnected)
+      push_notification("warning", "wifi", [](JsonObject data)
+                        { data["state"] = "disconnected"; });
+
     wifiConnected = false;
     break;
 
@@ -588,12 +852,50 @@ void setup()
   // Initialize camera
   camera_init_result = esp_camera_init(&esp32cam_aithinker_settings);
   if (camera_init_result == ESP_OK)
+  {
     log_i("Camera initialized successfully");
+    camera_sensor.begin();
+#ifdef CAMERA_GRAB_TASK
+    frames.begin(CAMERA_GRAB_INTERVAL, CAPTURE_CORE);
+#endif
+    // Frames are encoded on the capture core and sent from the network core
+    stream.begin(stream_frame, CAPTURE_CORE, NETWORK_CORE);
+#ifdef MOTION_DETECTION
+    motion.begin(stream_frame, MOTION_INTERVAL, CAPTURE_CORE);
+#endif
+#ifdef FRAME_HISTORY
+    history.begin(stream_frame, HISTORY_SIZE, HISTORY_FRAMES, HISTORY_INTERVAL, CAPTURE_CORE);
+#endif
+#ifdef RECORDING
+    // 1-bit mode leaves GPIO 4 (flash) alone. Without SD card, record to the SPIFFS partition
+    if (SD_MMC.begin("/sdcard", true))
+      video_recorder.begin(SD_MMC, RECORDING_DIRECTORY, stream_frame, CAPTURE_CORE);
+    else if (SPIFFS.begin(true))
+      video_recorder.begin(SPIFFS, RECORDING_DIRECTORY, stream_frame, CAPTURE_CORE);
+    else
+      log_e("No file system for recordings");
+#endif
+  }
   else
     log_e("Camera init failed with error 0x%x", camera_init_result);
 
-  server.on("/", HTTP_ANY, handleRoot);
-  server.begin();
+  server.on("/", handleRoot);
+  server.on("/capture.jpg", handle_capture_jpg);
+  server.on("/stream", handle_stream);
+  server.on("/metrics", handle_metrics);
+  server.on("/ws", handle_websocket);
+#ifdef RECORDING
+  server.on("/recording", handle_recording);
+#endif
+  // The arenas belong to the request path of the firmware, so their use is added to the system_status of the tools
+  system_status_details = [](String &status_text)
+  { status_text += "JSON Arena High-Water Mark: " + String(json_arenas.high_water_mark()) + " of " + String(json_arenas.size()) + " bytes (" + String(json_arenas.overflows()) + " overflows)\n"; };
+  // Requests are received and answered by worker tasks on the network core, the methods are handled on the capture core
+  request_handlers.begin(REQUEST_HANDLERS, CAPTURE_CORE, HTTP_WORKERS + WEBSOCKET_WORKERS);
+  server.keep_alive(HTTP_KEEP_ALIVE_TIMEOUT, HTTP_KEEP_ALIVE_REQUESTS);
+  server.begin(HTTP_WORKERS, NETWORK_CORE);
+  events.begin(NETWORK_CORE);
+  websockets.begin(handle_websocket_message, WEBSOCKET_WORKERS, NETWORK_CORE);
 }
 
 void loop()
@@ -604,10 +906,8 @@ void loop()
   // Check WiFi connection status and handle reconnection first
   checkWiFiConnection();
 
-  // Handle web server requests only if WiFi is connected
-  if (wifiConnected)
-    server.handleClient();
-
   // Handle OTA (works even with WiFi issues for recovery)
   ArduinoOTA.handle();
+
+  check_notifications();
 }
\ No newline at end of file
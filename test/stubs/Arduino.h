@@ -0,0 +1,841 @@
+#pragma once
+
+// Host (native) replacement of the parts of the Arduino core and FreeRTOS that the libraries use, so they can be
+// built and tested on the development machine. Tasks are threads, ticks are milliseconds and PSRAM is the heap.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <esp_heap_caps.h>
+#include <esp_random.h>
+
+using std::max;
+using std::min;
+
+// Time
+
+inline std::chrono::steady_clock::time_point native_start_time()
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return start;
+}
+
+inline unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - native_start_time()).count();
+}
+
+inline unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - native_start_time()).count();
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Memory: there is no PSRAM, the heap is used
+
+inline void *ps_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+inline void *ps_calloc(size_t count, size_t size)
+{
+    return calloc(count, size);
+}
+
+inline void *ps_realloc(void *pointer, size_t size)
+{
+    return realloc(pointer, size);
+}
+
+// Chip: the GPIOs are not connected and the status values are fixed
+
+#define LOW 0x0
+#define HIGH 0x1
+#define OUTPUT 0x03
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value)
+{
+    (void)pin;
+    (void)value;
+}
+
+inline uint32_t getCpuFrequencyMhz()
+{
+    return 240;
+}
+
+typedef enum
+{
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+} esp_reset_reason_t;
+
+inline esp_reset_reason_t esp_reset_reason()
+{
+    return ESP_RST_POWERON;
+}
+
+// Fahrenheit, like the driver
+extern "C" inline uint8_t temprature_sens_read()
+{
+    return 128;
+}
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap() const
+    {
+        return 200000;
+    }
+    uint32_t getMinFreeHeap() const
+    {
+        return 150000;
+    }
+    uint32_t getMaxAllocHeap() const
+    {
+        return 110000;
+    }
+    uint32_t getFreePsram() const
+    {
+        return 4000000;
+    }
+    uint32_t getFlashChipSize() const
+    {
+        return 4194304;
+    }
+    uint32_t getFlashChipSpeed() const
+    {
+        return 80000000;
+    }
+    uint32_t getSketchSize() const
+    {
+        return 1048576;
+    }
+    uint32_t getFreeSketchSpace() const
+    {
+        return 1966080;
+    }
+    const char *getSdkVersion() const
+    {
+        return "native";
+    }
+};
+
+static const EspClass ESP = EspClass();
+
+// Logging: errors and warnings by default, like the release build
+
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL 2
+#endif
+
+#define NATIVE_LOG(level, letter, format, ...)                           \
+    do                                                                   \
+    {                                                                    \
+        if (CORE_DEBUG_LEVEL >= level)                                   \
+            fprintf(stderr, "[" letter "] " format "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define log_e(format, ...) NATIVE_LOG(1, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) NATIVE_LOG(2, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) NATIVE_LOG(3, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) NATIVE_LOG(4, "D", format, ##__VA_ARGS__)
+#define log_v(format, ...) NATIVE_LOG(5, "V", format, ##__VA_ARGS__)
+
+// FreeRTOS: tasks are detached threads (the cores are ignored), notifications and queues use condition variables
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define errQUEUE_FULL 0
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+struct native_task
+{
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+typedef native_task *TaskHandle_t;
+
+inline native_task *&native_task_slot()
+{
+    static thread_local native_task *task = nullptr;
+    return task;
+}
+
+// Task of the calling thread. Threads not created by xTaskCreatePinnedToCore (main) get one at first use
+inline native_task *native_current_task()
+{
+    auto &task = native_task_slot();
+    if (!task)
+        task = new native_task();
+
+    return task;
+}
+
+// Waits on condition for ticks (portMAX_DELAY: forever). Returns the value of the predicate
+template <typename Predicate>
+bool native_wait(std::condition_variable &condition, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate predicate)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        condition.wait(lock, predicate);
+        return true;
+    }
+
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks), predicate);
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    (void)core;
+    // Created here, so notifications given before the thread runs are not lost. Tasks never end, neither does the handle
+    auto task = new native_task();
+    if (handle)
+        *handle = task;
+
+    std::thread([function, parameter, task]()
+                { native_task_slot() = task;
+                  function(parameter); })
+        .detach();
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_size, void *parameter, UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_size, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline BaseType_t xPortGetCoreID()
+{
+    return 1;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->notified.notify_all();
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    auto task = native_current_task();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    native_wait(task->notified, lock, ticks, [task]()
+                { return task->notifications > 0; });
+    auto value = task->notifications;
+    if (value > 0)
+        task->notifications = clear ? 0 : value - 1;
+
+    return value;
+}
+
+struct native_queue
+{
+    native_queue(size_t length, size_t item_size)
+        : length(length), item_size(item_size)
+    {
+    }
+
+    const size_t length;
+    const size_t item_size;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+typedef native_queue *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return new native_queue(length, item_size);
+}
+
+inline void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!native_wait(queue->changed, lock, ticks, [queue]()
+                     { return queue->items.size() < queue->length; }))
+        return errQUEUE_FULL;
+
+    auto bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return xQueueSend(queue, item, ticks);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!native_wait(queue->changed, lock, ticks, [queue]()
+                     { return !queue->items.empty(); }))
+        return pdFALSE;
+
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+// String: the Arduino API on top of std::string
+
+class String
+{
+public:
+    String() = default;
+    String(const char *value)
+        : value_(value ? value : "")
+    {
+    }
+    String(const char *value, unsigned int length)
+        : value_(value, length)
+    {
+    }
+    String(const std::string &value)
+        : value_(value)
+    {
+    }
+    explicit String(char c)
+        : value_(1, c)
+    {
+    }
+    explicit String(int value, unsigned char base = 10)
+        : value_(format_integer(value, base))
+    {
+    }
+    explicit String(unsigned int value, unsigned char base = 10)
+        : value_(format_unsigned(value, base))
+    {
+    }
+    explicit String(long value, unsigned char base = 10)
+        : value_(format_integer(value, base))
+    {
+    }
+    explicit String(unsigned long value, unsigned char base = 10)
+        : value_(format_unsigned(value, base))
+    {
+    }
+    explicit String(long long value, unsigned char base = 10)
+        : value_(format_integer(value, base))
+    {
+    }
+    explicit String(unsigned long long value, unsigned char base = 10)
+        : value_(format_unsigned(value, base))
+    {
+    }
+    explicit String(float value, unsigned int decimals = 2)
+        : value_(format_double(value, decimals))
+    {
+    }
+    explicit String(double value, unsigned int decimals = 2)
+        : value_(format_double(value, decimals))
+    {
+    }
+
+    String &operator=(const char *value)
+    {
+        value_ = value ? value : "";
+        return *this;
+    }
+
+    const char *c_str() const
+    {
+        return value_.c_str();
+    }
+    unsigned int length() const
+    {
+        return value_.length();
+    }
+    bool isEmpty() const
+    {
+        return value_.empty();
+    }
+    bool reserve(unsigned int size)
+    {
+        value_.reserve(size);
+        return true;
+    }
+
+    bool concat(const String &value)
+    {
+        value_ += value.value_;
+        return true;
+    }
+    bool concat(const char *value)
+    {
+        if (!value)
+            return false;
+
+        value_ += value;
+        return true;
+    }
+    bool concat(const char *value, unsigned int length)
+    {
+        value_.append(value, length);
+        return true;
+    }
+    bool concat(char c)
+    {
+        value_ += c;
+        return true;
+    }
+    template <typename T>
+    bool concat(T value)
+    {
+        return concat(String(value));
+    }
+
+    template <typename T>
+    String &operator+=(const T &value)
+    {
+        concat(value);
+        return *this;
+    }
+
+    char charAt(unsigned int index) const
+    {
+        return index < value_.length() ? value_[index] : 0;
+    }
+    char operator[](unsigned int index) const
+    {
+        return charAt(index);
+    }
+    char &operator[](unsigned int index)
+    {
+        return value_[index];
+    }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < value_.length())
+            value_[index] = c;
+    }
+
+    bool equals(const String &other) const
+    {
+        return value_ == other.value_;
+    }
+    bool equalsIgnoreCase(const String &other) const
+    {
+        if (value_.length() != other.value_.length())
+            return false;
+
+        for (size_t i = 0; i < value_.length(); i++)
+            if (tolower(static_cast<unsigned char>(value_[i])) != tolower(static_cast<unsigned char>(other.value_[i])))
+                return false;
+
+        return true;
+    }
+    bool startsWith(const String &prefix) const
+    {
+        return value_.compare(0, prefix.value_.length(), prefix.value_) == 0;
+    }
+    bool endsWith(const String &suffix) const
+    {
+        return value_.length() >= suffix.value_.length() && value_.compare(value_.length() - suffix.value_.length(), suffix.value_.length(), suffix.value_) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        return position(value_.find(c, from));
+    }
+    int indexOf(const String &value, unsigned int from = 0) const
+    {
+        return position(value_.find(value.value_, from));
+    }
+    int lastIndexOf(char c) const
+    {
+        return position(value_.rfind(c));
+    }
+    int lastIndexOf(const String &value) const
+    {
+        return position(value_.rfind(value.value_));
+    }
+
+    String substring(unsigned int from) const
+    {
+        return from < value_.length() ? String(value_.substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+
+        return from < value_.length() ? String(value_.substr(from, to - from)) : String();
+    }
+
+    void replace(char find, char replacement)
+    {
+        std::replace(value_.begin(), value_.end(), find, replacement);
+    }
+    void replace(const String &find, const String &replacement)
+    {
+        if (find.isEmpty())
+            return;
+
+        for (size_t position = value_.find(find.value_); position != std::string::npos; position = value_.find(find.value_, position + replacement.value_.length()))
+            value_.replace(position, find.value_.length(), replacement.value_);
+    }
+    void remove(unsigned int index)
+    {
+        if (index < value_.length())
+            value_.erase(index);
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < value_.length())
+            value_.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (auto &c : value_)
+            c = tolower(static_cast<unsigned char>(c));
+    }
+    void toUpperCase()
+    {
+        for (auto &c : value_)
+            c = toupper(static_cast<unsigned char>(c));
+    }
+    void trim()
+    {
+        auto begin = value_.find_first_not_of(" \t\r\n\f\v");
+        if (begin == std::string::npos)
+        {
+            value_.clear();
+            return;
+        }
+
+        value_ = value_.substr(begin, value_.find_last_not_of(" \t\r\n\f\v") - begin + 1);
+    }
+
+    long toInt() const
+    {
+        return atol(value_.c_str());
+    }
+    float toFloat() const
+    {
+        return atof(value_.c_str());
+    }
+    double toDouble() const
+    {
+        return atof(value_.c_str());
+    }
+
+    void getBytes(unsigned char *buffer, unsigned int size, unsigned int index = 0) const
+    {
+        toCharArray(reinterpret_cast<char *>(buffer), size, index);
+    }
+    void toCharArray(char *buffer, unsigned int size, unsigned int index = 0) const
+    {
+        if (size == 0)
+            return;
+
+        auto length = index < value_.length() ? std::min<size_t>(size - 1, value_.length() - index) : 0;
+        memcpy(buffer, value_.c_str() + index, length);
+        buffer[length] = '\0';
+    }
+
+    friend bool operator==(const String &a, const String &b)
+    {
+        return a.value_ == b.value_;
+    }
+    friend bool operator==(const String &a, const char *b)
+    {
+        return a.value_ == (b ? b : "");
+    }
+    friend bool operator==(const char *a, const String &b)
+    {
+        return b == a;
+    }
+    friend bool operator!=(const String &a, const String &b)
+    {
+        return !(a == b);
+    }
+    friend bool operator!=(const String &a, const char *b)
+    {
+        return !(a == b);
+    }
+    friend bool operator<(const String &a, const String &b)
+    {
+        return a.value_ < b.value_;
+    }
+    friend bool operator>(const String &a, const String &b)
+    {
+        return b < a;
+    }
+
+private:
+    static int position(size_t position)
+    {
+        return position == std::string::npos ? -1 : static_cast<int>(position);
+    }
+
+    template <typename T>
+    static std::string format_unsigned(T value, unsigned char base)
+    {
+        char digits[66];
+        auto p = digits + sizeof(digits);
+        *--p = '\0';
+        do
+        {
+            auto digit = value % base;
+            *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value);
+
+        return p;
+    }
+
+    template <typename T>
+    static std::string format_integer(T value, unsigned char base)
+    {
+        if (value >= 0 || base != 10)
+            return format_unsigned(static_cast<unsigned long long>(value), base);
+
+        return "-" + format_unsigned(0ULL - static_cast<unsigned long long>(value), base);
+    }
+
+    static std::string format_double(double value, unsigned int decimals)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "%.*f", static_cast<int>(decimals), value);
+        return text;
+    }
+
+    std::string value_;
+};
+
+// Result of String concatenation in the Arduino core
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &value)
+        : String(value)
+    {
+    }
+    StringSumHelper(const char *value)
+        : String(value)
+    {
+    }
+};
+
+inline StringSumHelper operator+(const String &a, const String &b)
+{
+    String sum(a);
+    sum.concat(b);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &a, const char *b)
+{
+    String sum(a);
+    sum.concat(b);
+    return sum;
+}
+
+inline StringSumHelper operator+(const char *a, const String &b)
+{
+    String sum(a);
+    sum.concat(b);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &a, char b)
+{
+    String sum(a);
+    sum.concat(b);
+    return sum;
+}
+
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value, StringSumHelper>::type operator+(const String &a, T b)
+{
+    String sum(a);
+    sum.concat(String(b));
+    return sum;
+}
+
+// Print and Stream
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- > 0)
+            written += write(*buffer++);
+
+        return written;
+    }
+    size_t write(const char *text)
+    {
+        return text ? write(reinterpret_cast<const uint8_t *>(text), strlen(text)) : 0;
+    }
+    size_t write(const char *buffer, size_t size)
+    {
+        return write(reinterpret_cast<const uint8_t *>(buffer), size);
+    }
+    virtual int availableForWrite()
+    {
+        return 0;
+    }
+    virtual void flush()
+    {
+    }
+
+    size_t print(const String &value)
+    {
+        return write(value.c_str(), value.length());
+    }
+    size_t print(const char *value)
+    {
+        return write(value);
+    }
+    size_t print(char c)
+    {
+        return write(static_cast<uint8_t>(c));
+    }
+    template <typename T>
+    size_t print(T value)
+    {
+        return print(String(value));
+    }
+    size_t println()
+    {
+        return write("\r\n");
+    }
+    template <typename T>
+    size_t println(T value)
+    {
+        return print(value) + println();
+    }
+
+    __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...)
+    {
+        va_list arguments;
+        va_start(arguments, format);
+        char small[64];
+        va_list copy;
+        va_copy(copy, arguments);
+        auto length = vsnprintf(small, sizeof(small), format, copy);
+        va_end(copy);
+        if (length < 0)
+        {
+            va_end(arguments);
+            return 0;
+        }
+
+        if (static_cast<size_t>(length) < sizeof(small))
+        {
+            va_end(arguments);
+            return write(small, length);
+        }
+
+        std::vector<char> large(length + 1);
+        vsnprintf(large.data(), large.size(), format, arguments);
+        va_end(arguments);
+        return write(large.data(), length);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout)
+    {
+        timeout_ = timeout;
+    }
+    unsigned long getTimeout() const
+    {
+        return timeout_;
+    }
+
+    virtual size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        size_t count = 0;
+        int c;
+        while (count < length && (c = read()) >= 0)
+            buffer[count++] = c;
+
+        return count;
+    }
+    size_t readBytes(char *buffer, size_t length)
+    {
+        return readBytes(reinterpret_cast<uint8_t *>(buffer), length);
+    }
+
+protected:
+    unsigned long timeout_ = 1000;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+// Host replacement of the Arduino file system API: a file system in RAM. The capacity can be limited to test what
+// happens when the medium is full (writes are then partial, like on SPIFFS or an SD card).
+
+#include <Arduino.h>
+
+#include <map>
+#include <memory>
+#include <set>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    struct ram_storage
+    {
+        std::mutex mutex;
+        std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+        std::set<std::string> directories{"/"};
+        size_t capacity = SIZE_MAX;
+
+        size_t used() const
+        {
+            size_t used = 0;
+            for (const auto &file : files)
+                used += file.second->size();
+
+            return used;
+        }
+    };
+
+    class File : public Stream
+    {
+    public:
+        File() = default;
+
+        size_t write(uint8_t c) override
+        {
+            return write(&c, 1);
+        }
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            if (!data_ || !writable_)
+                return 0;
+
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            auto used = storage_->used();
+            // Overwritten bytes take no space
+            auto growth = position_ + size > data_->size() ? position_ + size - data_->size() : 0;
+            if (used + growth > storage_->capacity)
+            {
+                auto free = storage_->capacity > used ? storage_->capacity - used : 0;
+                size = data_->size() - std::min(position_, data_->size()) + free;
+            }
+
+            if (position_ + size > data_->size())
+                data_->resize(position_ + size);
+
+            memcpy(data_->data() + position_, buffer, size);
+            position_ += size;
+            return size;
+        }
+
+        int available() override
+        {
+            return data_ && position_ < data_->size() ? data_->size() - position_ : 0;
+        }
+        int read() override
+        {
+            uint8_t c;
+            return read(&c, 1) == 1 ? c : -1;
+        }
+        int peek() override
+        {
+            return available() > 0 ? (*data_)[position_] : -1;
+        }
+        size_t read(uint8_t *buffer, size_t size)
+        {
+            size = std::min<size_t>(size, available());
+            if (size > 0)
+                memcpy(buffer, data_->data() + position_, size);
+
+            position_ += size;
+            return size;
+        }
+
+        bool seek(uint32_t position, SeekMode mode = SeekSet)
+        {
+            if (!data_)
+                return false;
+
+            size_t target = mode == SeekSet ? position : mode == SeekCur ? position_ + position
+                                                                        : data_->size() + position;
+            if (target > data_->size())
+                return false;
+
+            position_ = target;
+            return true;
+        }
+        size_t position() const
+        {
+            return position_;
+        }
+        size_t size() const
+        {
+            return data_ ? data_->size() : 0;
+        }
+        void close()
+        {
+            data_.reset();
+            storage_.reset();
+            children_.clear();
+            directory_ = false;
+        }
+
+        const char *path() const
+        {
+            return path_.c_str();
+        }
+        const char *name() const
+        {
+            auto slash = path_.rfind('/');
+            return path_.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+        }
+        bool isDirectory() const
+        {
+            return directory_;
+        }
+        File openNextFile(const char *mode = FILE_READ)
+        {
+            if (!directory_ || next_child_ >= children_.size())
+                return File();
+
+            return File(storage_, children_[next_child_++], mode);
+        }
+        void rewindDirectory()
+        {
+            next_child_ = 0;
+        }
+
+        operator bool() const
+        {
+            return data_ || directory_;
+        }
+
+    private:
+        friend class FS;
+
+        File(std::shared_ptr<ram_storage> storage, const std::string &path, const char *mode)
+            : storage_(storage), path_(path)
+        {
+            std::lock_guard<std::mutex> lock(storage->mutex);
+            if (storage->directories.count(path))
+            {
+                directory_ = true;
+                auto prefix = path == "/" ? path : path + "/";
+                for (const auto &file : storage->files)
+                    if (file.first.compare(0, prefix.length(), prefix) == 0 && file.first.find('/', prefix.length()) == std::string::npos)
+                        children_.push_back(file.first);
+
+                return;
+            }
+
+            auto file = storage->files.find(path);
+            if (mode[0] == 'r')
+            {
+                if (file != storage->files.end())
+                    data_ = file->second;
+
+                return;
+            }
+
+            // Write and append create the file; write truncates it
+            if (file == storage->files.end())
+                file = storage->files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+            else if (mode[0] == 'w')
+                file->second->clear();
+
+            data_ = file->second;
+            writable_ = true;
+            position_ = mode[0] == 'a' ? data_->size() : 0;
+        }
+
+        std::shared_ptr<ram_storage> storage_;
+        std::shared_ptr<std::vector<uint8_t>> data_;
+        std::string path_;
+        bool writable_ = false;
+        size_t position_ = 0;
+        bool directory_ = false;
+        std::vector<std::string> children_;
+        size_t next_child_ = 0;
+    };
+
+    class FS
+    {
+    public:
+        FS()
+            : storage_(std::make_shared<ram_storage>())
+        {
+        }
+
+        File open(const char *path, const char *mode = FILE_READ, bool create = false)
+        {
+            (void)create;
+            File file(storage_, path, mode);
+            return file ? file : File();
+        }
+        File open(const String &path, const char *mode = FILE_READ, bool create = false)
+        {
+            return open(path.c_str(), mode, create);
+        }
+
+        bool exists(const char *path)
+        {
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            return storage_->files.count(path) || storage_->directories.count(path);
+        }
+        bool exists(const String &path)
+        {
+            return exists(path.c_str());
+        }
+        bool mkdir(const char *path)
+        {
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            storage_->directories.insert(path);
+            return true;
+        }
+        bool mkdir(const String &path)
+        {
+            return mkdir(path.c_str());
+        }
+        bool remove(const char *path)
+        {
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            return storage_->files.erase(path) > 0;
+        }
+        bool remove(const String &path)
+        {
+            return remove(path.c_str());
+        }
+
+        // Limits the total size of the files; further writes are partial
+        void set_capacity(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            storage_->capacity = capacity;
+        }
+        size_t used()
+        {
+            std::lock_guard<std::mutex> lock(storage_->mutex);
+            return storage_->used();
+        }
+
+    private:
+        std::shared_ptr<ram_storage> storage_;
+    };
+}
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+// String that can be written to and read from as a stream
+class StreamString : public Stream, public String
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        return concat(static_cast<char>(c)) ? 1 : 0;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        return concat(reinterpret_cast<const char *>(buffer), size) ? size : 0;
+    }
+
+    int available() override
+    {
+        return length() - position_;
+    }
+    int read() override
+    {
+        return position_ < length() ? static_cast<uint8_t>(charAt(position_++)) : -1;
+    }
+    int peek() override
+    {
+        return position_ < length() ? static_cast<uint8_t>(charAt(position_)) : -1;
+    }
+
+private:
+    unsigned int position_ = 0;
+};
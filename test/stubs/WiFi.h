@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+
+class IPAddress
+{
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0)
+        : bytes_{a, b, c, d}
+    {
+    }
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2], bytes_[3]);
+        return String(text);
+    }
+
+private:
+    uint8_t bytes_[4];
+};
+
+// Host replacement of the station interface: always connected, on the loopback address
+class WiFiClass
+{
+public:
+    IPAddress localIP() const
+    {
+        return IPAddress(127, 0, 0, 1);
+    }
+    IPAddress gatewayIP() const
+    {
+        return IPAddress(127, 0, 0, 1);
+    }
+    IPAddress dnsIP() const
+    {
+        return IPAddress(127, 0, 0, 1);
+    }
+    int8_t RSSI() const
+    {
+        return -60;
+    }
+    String macAddress() const
+    {
+        return String("00:00:00:00:00:00");
+    }
+};
+
+static const WiFiClass WiFi = WiFiClass();
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+// Host replacement of the WiFi client: a connection in memory. The test writes what the peer sends with
+// peer_send() and reads what the client wrote with peer_received(). Copies share the connection, like on the device
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() = default;
+
+    // New connected client
+    static WiFiClient connection()
+    {
+        WiFiClient client;
+        client.connection_ = std::make_shared<state>();
+        return client;
+    }
+
+    size_t write(uint8_t c) override
+    {
+        return write(&c, 1);
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        if (!connected())
+            return 0;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        connection_->output.append(reinterpret_cast<const char *>(buffer), size);
+        return size;
+    }
+
+    int available() override
+    {
+        if (!connection_)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        return connection_->input.size();
+    }
+    int read() override
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int read(uint8_t *buffer, size_t size)
+    {
+        if (!connection_)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        size = std::min(size, connection_->input.size());
+        memcpy(buffer, connection_->input.data(), size);
+        connection_->input.erase(0, size);
+        return size;
+    }
+    int peek() override
+    {
+        if (!connection_)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        return connection_->input.empty() ? -1 : static_cast<uint8_t>(connection_->input[0]);
+    }
+
+    uint8_t connected()
+    {
+        if (!connection_)
+            return false;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        return connection_->open;
+    }
+    void stop()
+    {
+        if (!connection_)
+            return;
+
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        connection_->open = false;
+    }
+    // There is no socket
+    int fd() const
+    {
+        return -1;
+    }
+    void setTimeout(uint32_t seconds)
+    {
+        Stream::setTimeout(seconds * 1000);
+    }
+
+    operator bool()
+    {
+        return connected();
+    }
+    bool operator==(const WiFiClient &other) const
+    {
+        return connection_ == other.connection_;
+    }
+
+    // The peer side of the connection
+    void peer_send(const String &data)
+    {
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        connection_->input.append(data.c_str(), data.length());
+    }
+    String peer_received()
+    {
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        String received(connection_->output.c_str(), connection_->output.length());
+        connection_->output.clear();
+        return received;
+    }
+
+private:
+    struct state
+    {
+        std::mutex mutex;
+        std::string input;
+        std::string output;
+        bool open = true;
+    };
+
+    std::shared_ptr<state> connection_;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <map>
+
+// Host replacement of the WiFi server: connections are queued by the test with connect()
+class WiFiServer
+{
+public:
+    explicit WiFiServer(uint16_t port = 80, uint8_t max_clients = 4)
+        : port_(port), max_clients_(max_clients)
+    {
+    }
+
+    void begin(uint16_t port = 0)
+    {
+        if (port)
+            port_ = port;
+
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        listening()[port_] = this;
+    }
+    void setNoDelay(bool no_delay)
+    {
+        (void)no_delay;
+    }
+
+    // Returns the next queued connection, or a client that is not connected
+    WiFiClient available()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.empty())
+            return WiFiClient();
+
+        auto client = pending_.front();
+        pending_.pop_front();
+        return client;
+    }
+    WiFiClient accept()
+    {
+        return available();
+    }
+
+    // Opens a connection to the server; the test is the peer
+    WiFiClient connect()
+    {
+        auto client = WiFiClient::connection();
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(client);
+        return client;
+    }
+    // Opens a connection to the server listening on port (begin() called). Returns a client that is not connected if there is none
+    static WiFiClient connect(uint16_t port)
+    {
+        WiFiServer *server;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex());
+            auto found = listening().find(port);
+            if (found == listening().end())
+                return WiFiClient();
+
+            server = found->second;
+        }
+
+        return server->connect();
+    }
+
+private:
+    // Never destroyed, like the servers (global objects of the firmware)
+    static std::mutex &registry_mutex()
+    {
+        static auto mutex = new std::mutex();
+        return *mutex;
+    }
+    static std::map<uint16_t, WiFiServer *> &listening()
+    {
+        static auto servers = new std::map<uint16_t, WiFiServer *>();
+        return *servers;
+    }
+
+    uint16_t port_;
+    uint8_t max_clients_;
+    std::mutex mutex_;
+    std::deque<WiFiClient> pending_;
+};
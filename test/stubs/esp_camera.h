@@ -0,0 +1,317 @@
+#pragma once
+
+// Host replacement of the esp32-camera driver. The fake camera replays JPEG frames that were loaded from files (or
+// added from memory) in a loop. When frames of the frame size set on the sensor were added, only those are replayed,
+// so a frame size change returns real frames of that size. Frame buffers are copies, so any number can be held at the
+// same time.
+
+#include <sys/time.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum
+{
+    PIXFORMAT_RGB565,
+    PIXFORMAT_YUV422,
+    PIXFORMAT_YUV420,
+    PIXFORMAT_GRAYSCALE,
+    PIXFORMAT_JPEG,
+    PIXFORMAT_RGB888,
+    PIXFORMAT_RAW,
+    PIXFORMAT_RGB444,
+    PIXFORMAT_RGB555,
+} pixformat_t;
+
+typedef enum
+{
+    FRAMESIZE_96X96,
+    FRAMESIZE_QQVGA,
+    FRAMESIZE_QCIF,
+    FRAMESIZE_HQVGA,
+    FRAMESIZE_240X240,
+    FRAMESIZE_QVGA,
+    FRAMESIZE_CIF,
+    FRAMESIZE_HVGA,
+    FRAMESIZE_VGA,
+    FRAMESIZE_SVGA,
+    FRAMESIZE_XGA,
+    FRAMESIZE_HD,
+    FRAMESIZE_SXGA,
+    FRAMESIZE_UXGA,
+    FRAMESIZE_FHD,
+    FRAMESIZE_P_HD,
+    FRAMESIZE_P_3MP,
+    FRAMESIZE_QXGA,
+    FRAMESIZE_QHD,
+    FRAMESIZE_WQXGA,
+    FRAMESIZE_P_FHD,
+    FRAMESIZE_QSXGA,
+    FRAMESIZE_INVALID
+} framesize_t;
+
+typedef enum
+{
+    ASPECT_RATIO_4X3,
+    ASPECT_RATIO_3X2,
+    ASPECT_RATIO_16X10,
+    ASPECT_RATIO_5X3,
+    ASPECT_RATIO_16X9,
+    ASPECT_RATIO_21X9,
+    ASPECT_RATIO_5X4,
+    ASPECT_RATIO_1X1,
+    ASPECT_RATIO_9X16
+} aspect_ratio_t;
+
+typedef struct
+{
+    const uint16_t width;
+    const uint16_t height;
+    const aspect_ratio_t aspect_ratio;
+} resolution_info_t;
+
+// Dimensions of the frame sizes, indexed by framesize_t
+static const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96, ASPECT_RATIO_1X1},
+    {160, 120, ASPECT_RATIO_4X3},
+    {176, 144, ASPECT_RATIO_5X4},
+    {240, 176, ASPECT_RATIO_3X2},
+    {240, 240, ASPECT_RATIO_1X1},
+    {320, 240, ASPECT_RATIO_4X3},
+    {400, 296, ASPECT_RATIO_4X3},
+    {480, 320, ASPECT_RATIO_3X2},
+    {640, 480, ASPECT_RATIO_4X3},
+    {800, 600, ASPECT_RATIO_4X3},
+    {1024, 768, ASPECT_RATIO_4X3},
+    {1280, 720, ASPECT_RATIO_16X9},
+    {1280, 1024, ASPECT_RATIO_5X4},
+    {1600, 1200, ASPECT_RATIO_4X3},
+    {1920, 1080, ASPECT_RATIO_16X9},
+    {720, 1280, ASPECT_RATIO_9X16},
+    {864, 1536, ASPECT_RATIO_9X16},
+    {2048, 1536, ASPECT_RATIO_4X3},
+    {2560, 1440, ASPECT_RATIO_16X9},
+    {2560, 1600, ASPECT_RATIO_16X10},
+    {1080, 1920, ASPECT_RATIO_9X16},
+    {2560, 1920, ASPECT_RATIO_4X3},
+};
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;
+    size_t width;
+    size_t height;
+    pixformat_t format;
+    struct timeval timestamp;
+} camera_fb_t;
+
+typedef struct
+{
+    framesize_t framesize;
+    uint8_t quality;
+} camera_status_t;
+
+// The settings the libraries change; the others are not emulated
+typedef struct _sensor sensor_t;
+struct _sensor
+{
+    camera_status_t status;
+    int (*set_framesize)(sensor_t *sensor, framesize_t framesize);
+    int (*set_quality)(sensor_t *sensor, int quality);
+};
+
+namespace fake_camera
+{
+    inline int set_framesize(sensor_t *sensor, framesize_t framesize)
+    {
+        sensor->status.framesize = framesize;
+        return 0;
+    }
+
+    inline int set_quality(sensor_t *sensor, int quality)
+    {
+        sensor->status.quality = quality;
+        return 0;
+    }
+
+    struct state
+    {
+        state()
+        {
+            sensor.status = {FRAMESIZE_UXGA, 12};
+            sensor.set_framesize = set_framesize;
+            sensor.set_quality = set_quality;
+        }
+
+        struct stored_frame
+        {
+            std::vector<uint8_t> data;
+            uint16_t width;
+            uint16_t height;
+        };
+
+        std::mutex mutex;
+        std::vector<stored_frame> frames;
+        size_t next = 0;
+        uint32_t taken = 0;
+        uint32_t outstanding = 0;
+        sensor_t sensor;
+    };
+
+    // Never destroyed: tasks (detached threads) may still use the camera while the program exits
+    inline state &instance()
+    {
+        static auto camera = new state();
+        return *camera;
+    }
+
+    // Reads the width and height from the start of frame (SOFn) segment. Returns false if there is none
+    inline bool jpeg_size(const uint8_t *data, size_t length, uint16_t &width, uint16_t &height)
+    {
+        if (length < 4 || data[0] != 0xff || data[1] != 0xd8)
+            return false;
+
+        size_t position = 2;
+        while (position + 9 <= length && data[position] == 0xff)
+        {
+            auto marker = data[position + 1];
+            auto segment_length = static_cast<size_t>(data[position + 2] << 8 | data[position + 3]);
+            // SOF0 - SOF15 without DHT (c4), JPG (c8) and DAC (cc)
+            if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+            {
+                height = data[position + 5] << 8 | data[position + 6];
+                width = data[position + 7] << 8 | data[position + 8];
+                return true;
+            }
+
+            position += 2 + segment_length;
+        }
+
+        return false;
+    }
+
+    // Adds a frame that is replayed after the frames already added. Returns false if it is not a JPEG
+    inline bool add(const uint8_t *data, size_t length)
+    {
+        uint16_t width, height;
+        if (!jpeg_size(data, length, width, height))
+            return false;
+
+        auto &camera = instance();
+        std::lock_guard<std::mutex> lock(camera.mutex);
+        camera.frames.push_back({std::vector<uint8_t>(data, data + length), width, height});
+        return true;
+    }
+
+    // Adds the JPEG file at path. Returns false if it cannot be read or is not a JPEG
+    inline bool load(const char *path)
+    {
+        auto file = fopen(path, "rb");
+        if (!file)
+            return false;
+
+        std::vector<uint8_t> data;
+        uint8_t buffer[4096];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.insert(data.end(), buffer, buffer + length);
+
+        fclose(file);
+        return add(data.data(), data.size());
+    }
+
+    // Removes the frames and resets the counters and settings
+    inline void reset()
+    {
+        auto &camera = instance();
+        std::lock_guard<std::mutex> lock(camera.mutex);
+        camera.frames.clear();
+        camera.next = 0;
+        camera.taken = 0;
+        camera.sensor.status = {FRAMESIZE_UXGA, 12};
+    }
+
+    // Frame buffer holding a copy of data, returned with esp_camera_fb_return()
+    inline camera_fb_t *frame_buffer(const uint8_t *data, size_t length, uint16_t width, uint16_t height)
+    {
+        auto fb = new camera_fb_t();
+        fb->buf = static_cast<uint8_t *>(malloc(length ? length : 1));
+        memcpy(fb->buf, data, length);
+        fb->len = length;
+        fb->width = width;
+        fb->height = height;
+        fb->format = PIXFORMAT_JPEG;
+        gettimeofday(&fb->timestamp, nullptr);
+        std::lock_guard<std::mutex> lock(instance().mutex);
+        instance().outstanding++;
+        return fb;
+    }
+
+    // Frames taken from the camera and frame buffers not yet returned
+    inline uint32_t taken()
+    {
+        std::lock_guard<std::mutex> lock(instance().mutex);
+        return instance().taken;
+    }
+    inline uint32_t outstanding()
+    {
+        std::lock_guard<std::mutex> lock(instance().mutex);
+        return instance().outstanding;
+    }
+}
+
+inline camera_fb_t *esp_camera_fb_get()
+{
+    auto &camera = fake_camera::instance();
+    fake_camera::state::stored_frame stored;
+    {
+        std::lock_guard<std::mutex> lock(camera.mutex);
+        if (camera.frames.empty())
+            return nullptr;
+
+        // The next frame of the frame size on the sensor; the next frame of any size if there is none
+        auto count = camera.frames.size();
+        auto index = camera.next;
+        const auto &size = resolution[camera.sensor.status.framesize];
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto &candidate = camera.frames[(camera.next + i) % count];
+            if (candidate.width == size.width && candidate.height == size.height)
+            {
+                index = (camera.next + i) % count;
+                break;
+            }
+        }
+
+        stored = camera.frames[index];
+        camera.next = (index + 1) % count;
+        camera.taken++;
+    }
+
+    return fake_camera::frame_buffer(stored.data.data(), stored.data.size(), stored.width, stored.height);
+}
+
+inline void esp_camera_fb_return(camera_fb_t *fb)
+{
+    if (!fb)
+        return;
+
+    free(fb->buf);
+    delete fb;
+    std::lock_guard<std::mutex> lock(fake_camera::instance().mutex);
+    fake_camera::instance().outstanding--;
+}
+
+inline sensor_t *esp_camera_sensor_get()
+{
+    return &fake_camera::instance().sensor;
+}
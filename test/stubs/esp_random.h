@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+// Host replacement of the hardware random number generator
+inline uint32_t esp_random()
+{
+    static thread_local std::mt19937 generator(std::random_device{}());
+    return generator();
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <sys/time.h>
+
+#include <cstdint>
+
+// Host replacement of the high resolution timer (microseconds). The fake camera stamps its frames with gettimeofday(),
+// so this uses the same clock, like the driver stamps frames with this timer
+inline int64_t esp_timer_get_time()
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return now.tv_sec * 1000000LL + now.tv_usec;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Host replacement of the esp32-camera image converters. There is no JPEG codec: the "decoder" derives the pixels from
+// the JPEG bytes and the "encoder" writes a minimal JPEG (SOI, SOF0 with the size, subsampled pixels, EOI). The sizes
+// and buffer handling match the driver, which is what the libraries depend on.
+
+#include <esp_camera.h>
+
+#include <algorithm>
+
+typedef enum
+{
+    JPG_SCALE_NONE,
+    JPG_SCALE_2X,
+    JPG_SCALE_4X,
+    JPG_SCALE_8X,
+    JPG_SCALE_MAX = JPG_SCALE_8X
+} jpg_scale_t;
+
+// Writes (width >> scale) * (height >> scale) RGB565 pixels (big endian). Returns false if src is not a JPEG
+inline bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale)
+{
+    uint16_t width, height;
+    if (!fake_camera::jpeg_size(src, src_len, width, height))
+        return false;
+
+    size_t pixels = static_cast<size_t>(width >> scale) * (height >> scale);
+    for (size_t i = 0; i < pixels; i++)
+    {
+        auto value = src[(i * 2654435761u) % src_len];
+        // Gray: the same level in all channels
+        uint16_t pixel = (value >> 3) << 11 | (value >> 2) << 5 | value >> 3;
+        out[i * 2] = pixel >> 8;
+        out[i * 2 + 1] = pixel;
+    }
+
+    return true;
+}
+
+// Allocates *out (with malloc) and writes a JPEG of width x height. Quality is 0-100 like the driver: higher quality
+// keeps more bytes
+inline bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t **out, size_t *out_len)
+{
+    if (format != PIXFORMAT_RGB565 || src_len < static_cast<size_t>(width) * height * 2)
+        return false;
+
+    const uint8_t header[] = {0xff, 0xd8, 0xff, 0xc0, 0x00, 0x0b, 0x08, static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width), 0x01, 0x01, 0x11, 0x00};
+    size_t step = 2 + (100 - std::min<uint8_t>(quality, 100)) / 4;
+    size_t data_length = src_len / step;
+    *out_len = sizeof(header) + data_length + 2;
+    *out = static_cast<uint8_t *>(malloc(*out_len));
+    if (!*out)
+        return false;
+
+    memcpy(*out, header, sizeof(header));
+    for (size_t i = 0; i < data_length; i++)
+        // No markers in the data
+        (*out)[sizeof(header) + i] = src[i * step] & 0xfe;
+
+    (*out)[*out_len - 2] = 0xff;
+    (*out)[*out_len - 1] = 0xd9;
+    return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// The stub WiFiClient has no socket (fd() is -1), so the socket options of the libraries fail harmlessly
@@ -0,0 +1,193 @@
+#pragma once
+
+// Benchmark helpers of the native tests. A benchmark runs its body until enough CPU time (or wall time, for work of
+// other threads) has passed and records the time per operation; the results of a test program are written as one JSON document to stdout (and to the file
+// in the BENCHMARK_OUTPUT environment variable, if set), so runs can be compared by a script.
+
+#include <Arduino.h>
+#include <esp_camera.h>
+
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The JPEG replayed by the fake camera, relative to the project directory (the working directory of pio test)
+#define FAKE_CAMERA_IMAGE "assets/images/esp32-cam 1200x1200.jpg"
+
+struct benchmark_result
+{
+    std::string name;
+    // Input of the run, for example the frame size
+    std::string variant;
+    uint32_t iterations;
+    double ns_per_op;
+    // Bytes processed and produced per operation (0 if not applicable)
+    size_t bytes_in;
+    size_t bytes_out;
+    // Largest amount of memory allocated by an operation (0 if not measured)
+    size_t peak_bytes;
+    // 99th percentile of the latency of an operation (0 if not measured), for operations run concurrently
+    double p99_ns;
+};
+
+// Frame sizes of the benchmarks with the typical JPEG length of the ESP32-CAM (quality 12) and a JPEG of that size and
+// about that length (from the same scene). Loaded into the fake camera with benchmark_load_frames(), a capture with
+// the frame size returns that image. benchmark_frame() cuts frames of the length from the replayed image, so the data
+// has the statistics of real entropy coded JPEG data
+struct benchmark_frame_size
+{
+    const char *name;
+    size_t length;
+    framesize_t frame_size;
+    const char *image;
+};
+
+static const benchmark_frame_size benchmark_frame_sizes[] = {
+    {"QVGA", 10 * 1024, FRAMESIZE_QVGA, "assets/images/esp32-cam 320x240.jpg"},
+    {"VGA", 30 * 1024, FRAMESIZE_VGA, "assets/images/esp32-cam 640x480.jpg"},
+    {"SVGA", 50 * 1024, FRAMESIZE_SVGA, "assets/images/esp32-cam 800x600.jpg"},
+    {"UXGA", 128 * 1024, FRAMESIZE_UXGA, "assets/images/esp32-cam 1600x1200.jpg"}};
+
+// Adds the images of the benchmark frame sizes to the fake camera. Returns false if one cannot be loaded
+inline bool benchmark_load_frames()
+{
+    for (const auto &size : benchmark_frame_sizes)
+        if (!fake_camera::load(size.image))
+        {
+            printf("Unable to load %s (run from the project directory)\n", size.image);
+            return false;
+        }
+
+    return true;
+}
+
+// CPU time of the calling thread in nanoseconds
+inline uint64_t benchmark_cpu_time()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Monotonic time in nanoseconds, for work that is done by other threads (the tasks of the HTTP server)
+inline uint64_t benchmark_wall_time()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Runs body at least min_iterations times and until min_ms milliseconds of clock time have passed
+inline benchmark_result benchmark_run(const char *name, const std::string &variant, std::function<void()> body, uint32_t min_iterations = 10, unsigned long min_ms = 200, uint64_t (*clock)() = benchmark_cpu_time)
+{
+    // Warm up (caches, lazy initialization)
+    body();
+
+    uint32_t iterations = 0;
+    auto start = clock();
+    uint64_t elapsed;
+    do
+    {
+        body();
+        iterations++;
+        elapsed = clock() - start;
+    } while (iterations < min_iterations || elapsed < min_ms * 1000000ULL);
+
+    return {name, variant, iterations, static_cast<double>(elapsed) / iterations, 0, 0, 0, 0};
+}
+
+// Collected results of the test program
+inline std::vector<benchmark_result> &benchmark_results()
+{
+    static std::vector<benchmark_result> results;
+    return results;
+}
+
+inline void benchmark_record(const benchmark_result &result)
+{
+    benchmark_results().push_back(result);
+}
+
+inline std::string benchmark_json()
+{
+    std::string json = "{\"benchmarks\":[";
+    char line[512];
+    for (size_t i = 0; i < benchmark_results().size(); i++)
+    {
+        const auto &result = benchmark_results()[i];
+        auto ops_per_s = result.ns_per_op > 0 ? 1e9 / result.ns_per_op : 0.0;
+        auto mb_per_s = result.bytes_in && result.ns_per_op > 0 ? result.bytes_in / result.ns_per_op * 1000 : 0.0;
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"variant\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.1f,\"ops_per_s\":%.1f,\"p99_ns\":%.1f,\"bytes_in\":%u,\"bytes_out\":%u,\"mb_per_s\":%.2f,\"peak_bytes\":%u}",
+                 i ? "," : "", result.name.c_str(), result.variant.c_str(), static_cast<unsigned>(result.iterations), result.ns_per_op, ops_per_s, result.p99_ns,
+                 static_cast<unsigned>(result.bytes_in), static_cast<unsigned>(result.bytes_out), mb_per_s, static_cast<unsigned>(result.peak_bytes));
+        json += line;
+    }
+
+    return json + "\n]}\n";
+}
+
+// Writes the results as JSON to stdout and to $BENCHMARK_OUTPUT
+inline void benchmark_report()
+{
+    auto json = benchmark_json();
+    fputs(json.c_str(), stdout);
+    auto path = getenv("BENCHMARK_OUTPUT");
+    if (!path)
+        return;
+
+    auto file = fopen(path, "w");
+    if (file)
+    {
+        fputs(json.c_str(), file);
+        fclose(file);
+    }
+}
+
+// Takes a frame from the fake camera and keeps its first length bytes (the whole frame if it is shorter)
+inline std::vector<uint8_t> benchmark_frame(size_t length)
+{
+    auto fb = esp_camera_fb_get();
+    if (!fb)
+        return {};
+
+    std::vector<uint8_t> data(fb->buf, fb->buf + std::min(length, fb->len));
+    esp_camera_fb_return(fb);
+    return data;
+}
+
+// Print that only counts the bytes
+class counting_print : public Print
+{
+public:
+    size_t write(uint8_t) override
+    {
+        count++;
+        return 1;
+    }
+    size_t write(const uint8_t *, size_t size) override
+    {
+        count += size;
+        return size;
+    }
+
+    size_t count = 0;
+};
+
+// Print that keeps the bytes
+class string_print : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        data += static_cast<char>(c);
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        data.append(reinterpret_cast<const char *>(buffer), size);
+        return size;
+    }
+
+    std::string data;
+};
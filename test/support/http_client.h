@@ -0,0 +1,50 @@
+#pragma once
+
+// Peer side of HTTP connections to an http_server over the in-memory connections of the WiFi stubs
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+// Reads from the connection until count responses (status lines) and their bodies have been received or timeout
+// milliseconds passed
+inline String http_receive(WiFiClient &client, size_t count, unsigned long timeout = 1000)
+{
+    String received;
+    auto start = millis();
+    while (millis() - start < timeout)
+    {
+        received += client.peer_received();
+        size_t complete = 0;
+        auto position = 0;
+        for (;;)
+        {
+            auto header_end = received.indexOf("\r\n\r\n", position);
+            if (header_end < 0)
+                break;
+
+            auto length = 0;
+            auto content_length = received.indexOf("Content-Length: ", position);
+            if (content_length >= 0 && content_length < header_end)
+                length = received.substring(content_length + 16).toInt();
+
+            if (static_cast<int>(received.length()) < header_end + 4 + length)
+                break;
+
+            complete++;
+            position = header_end + 4 + length;
+        }
+
+        if (complete >= count)
+            return received;
+
+        delay(1);
+    }
+
+    return received;
+}
+
+// POST request of body to path
+inline String http_post(const char *path, const String &body)
+{
+    return "POST " + String(path) + " HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: " + String(body.length()) + "\r\n\r\n" + body;
+}
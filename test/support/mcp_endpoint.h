@@ -0,0 +1,60 @@
+#pragma once
+
+// MCP endpoint of the native tests: POST / of the firmware without sessions, batches and compression. tools/list is
+// answered with the cached result and tools/call with the tools of the firmware (lib/camera_tools), in the HTTP worker.
+
+#include <camera_tools.h>
+#include <http_server.h>
+#include <mcp.h>
+
+inline void mcp_endpoint(http_request &request, http_response &response)
+{
+    if (request.method() != http_method::post)
+    {
+        response.send(405, "text/plain", "Only POST allowed");
+        return;
+    }
+
+    mcp_response mcp_response;
+    try
+    {
+        mcp_message message(request.body(), request.body_length());
+        auto mcp_request = message[0];
+        mcp_response.set_id(mcp_request.id());
+        if (mcp_request.method() == "tools/list")
+        {
+            String id;
+            serializeJson(mcp_request.id(), id);
+            response.begin(200, "application/json", tools_list_result.length(id, false));
+            tools_list_result.write_to(response, id, false);
+            response.end();
+            return;
+        }
+
+        if (mcp_request.method() == "tools/call")
+            handle_tools_call(mcp_request, mcp_response);
+        else
+        {
+            auto error = mcp_response.create_error();
+            error["code"] = error_code::method_not_found;
+            error["message"] = "Method not found: " + String(mcp_request.method().c_str());
+        }
+    }
+    catch (const mcp_exception &e)
+    {
+        auto error = mcp_response.create_error();
+        error["code"] = e.code();
+        error["message"] = e.what();
+    }
+
+    // Attachments are base64 encoded while sending
+    response.begin(mcp_response.http_code(), "application/json", mcp_response.length());
+    mcp_response.write_to(response);
+    response.end();
+}
+
+// Body of a tools/call request of the capture tool; arguments is a JSON object
+inline String mcp_capture_request(int id, const String &arguments)
+{
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + String(id) + ",\"method\":\"tools/call\",\"params\":{\"name\":\"capture\",\"arguments\":" + arguments + "}}";
+}
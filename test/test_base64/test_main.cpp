@@ -0,0 +1,210 @@
+// Table driven base64 codec against a straightforward reference encoder, with random data
+
+#include <unity.h>
+
+#include <base64_codec.h>
+#include <benchmark.h>
+#include <esp_random.h>
+
+#include <string>
+#include <vector>
+
+// RFC 4648 with padding, one 6-bit lookup per character
+static size_t reference_encode(const uint8_t *data, size_t length, char *output)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    auto out = output;
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t bits = data[i] << 16;
+        if (i + 1 < length)
+            bits |= data[i + 1] << 8;
+        if (i + 2 < length)
+            bits |= data[i + 2];
+
+        *out++ = alphabet[bits >> 18 & 63];
+        *out++ = alphabet[bits >> 12 & 63];
+        *out++ = i + 1 < length ? alphabet[bits >> 6 & 63] : '=';
+        *out++ = i + 2 < length ? alphabet[bits & 63] : '=';
+    }
+
+    return out - output;
+}
+
+static std::string reference_encode(const std::vector<uint8_t> &data)
+{
+    std::string encoded(base64_encoded_length(data.size()), '\0');
+    reference_encode(data.data(), data.size(), &encoded[0]);
+    return encoded;
+}
+
+static std::vector<uint8_t> random_data(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (auto &byte : data)
+        byte = esp_random();
+
+    return data;
+}
+
+static std::string encode(const std::vector<uint8_t> &data)
+{
+    std::string encoded(base64_encoded_length(data.size()), '\0');
+    TEST_ASSERT_EQUAL(encoded.size(), base64_encode(data.data(), data.size(), &encoded[0]));
+    return encoded;
+}
+
+static bool decode(const std::string &input, std::vector<uint8_t> &output)
+{
+    output.assign(base64_decoded_max_length(input.size()), 0);
+    size_t length = 0;
+    if (!base64_decode(input.data(), input.size(), output.data(), length))
+        return false;
+
+    TEST_ASSERT_LESS_OR_EQUAL(output.size(), length);
+    output.resize(length);
+    return true;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_rfc_4648_vectors()
+{
+    const char *const vectors[][2] = {{"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}};
+    for (const auto &vector : vectors)
+    {
+        std::vector<uint8_t> data(vector[0], vector[0] + strlen(vector[0]));
+        TEST_ASSERT_EQUAL_STRING(vector[1], encode(data).c_str());
+    }
+}
+
+static void test_decoded_max_length_fits_unpadded_input()
+{
+    TEST_ASSERT_EQUAL(0, base64_decoded_max_length(0));
+    TEST_ASSERT_EQUAL(3, base64_decoded_max_length(2));
+    TEST_ASSERT_EQUAL(3, base64_decoded_max_length(3));
+    TEST_ASSERT_EQUAL(3, base64_decoded_max_length(4));
+    TEST_ASSERT_EQUAL(6, base64_decoded_max_length(7));
+
+    // "foobar" without padding: 7 characters decode to 5 bytes
+    std::vector<uint8_t> decoded;
+    TEST_ASSERT_TRUE(decode("Zm9vYmE", decoded));
+    TEST_ASSERT_EQUAL(5, decoded.size());
+    TEST_ASSERT_EQUAL(0, memcmp("fooba", decoded.data(), 5));
+}
+
+static void test_round_trip_random_data()
+{
+    for (size_t length = 0; length < 2000; length += 1 + length / 8)
+    {
+        auto data = random_data(length);
+        auto encoded = encode(data);
+        TEST_ASSERT_TRUE(reference_encode(data) == encoded);
+
+        std::vector<uint8_t> decoded;
+        TEST_ASSERT_TRUE(decode(encoded, decoded));
+        TEST_ASSERT_TRUE(data == decoded);
+
+        // Without padding
+        auto unpadded = encoded.substr(0, encoded.find('='));
+        TEST_ASSERT_TRUE(decode(unpadded, decoded));
+        TEST_ASSERT_TRUE(data == decoded);
+    }
+}
+
+static void test_print_output_matches_buffer_output()
+{
+    // Longer than one chunk, not a multiple of 3
+    auto data = random_data(5000);
+    string_print output;
+    unsigned long encode_time = 0;
+    TEST_ASSERT_EQUAL(base64_encoded_length(data.size()), base64_encode(data.data(), data.size(), output, &encode_time));
+    TEST_ASSERT_TRUE(encode(data) == output.data);
+}
+
+static void test_invalid_input_is_rejected()
+{
+    const char *const invalid[] = {"Z", "Zm9vY", "Zm9v!mFy", "Zm 9v", "Zm9v\nYmFy", "Zg=a", "=Zg="};
+    std::vector<uint8_t> decoded;
+    for (auto input : invalid)
+        TEST_ASSERT_FALSE_MESSAGE(decode(input, decoded), input);
+}
+
+static void test_random_input_does_not_overrun()
+{
+    // Any input: decoding stays within base64_decoded_max_length() and valid results encode back to the input
+    for (auto i = 0; i < 5000; i++)
+    {
+        auto bytes = random_data(esp_random() % 24);
+        std::string input;
+        for (auto byte : bytes)
+            input += "ABCxyz019+/=!"[byte % 13];
+
+        std::vector<uint8_t> decoded;
+        if (!decode(input, decoded) || input.size() % 4 != 0 || input.find('=') != std::string::npos)
+            continue;
+
+        TEST_ASSERT_TRUE(encode(decoded) == input);
+    }
+}
+
+static void benchmark_encode()
+{
+    for (const auto &size : benchmark_frame_sizes)
+    {
+        auto frame = benchmark_frame(size.length);
+        std::string encoded(base64_encoded_length(frame.size()), '\0');
+        auto table = benchmark_run("base64_encode", std::string(size.name) + " table", [&]()
+                                   { base64_encode(frame.data(), frame.size(), &encoded[0]); });
+        table.bytes_in = frame.size();
+        table.bytes_out = encoded.size();
+        benchmark_record(table);
+
+        auto reference = benchmark_run("base64_encode", std::string(size.name) + " reference", [&]()
+                                       { reference_encode(frame.data(), frame.size(), &encoded[0]); });
+        reference.bytes_in = frame.size();
+        reference.bytes_out = encoded.size();
+        benchmark_record(reference);
+    }
+}
+
+static void benchmark_decode()
+{
+    auto frame = benchmark_frame(benchmark_frame_sizes[1].length);
+    auto encoded = encode(frame);
+    std::vector<uint8_t> decoded(base64_decoded_max_length(encoded.size()));
+    size_t length;
+    auto result = benchmark_run("base64_decode", benchmark_frame_sizes[1].name, [&]()
+                                { base64_decode(encoded.data(), encoded.size(), decoded.data(), length); });
+    result.bytes_in = encoded.size();
+    result.bytes_out = length;
+    benchmark_record(result);
+}
+
+int main()
+{
+    if (!fake_camera::load(FAKE_CAMERA_IMAGE))
+    {
+        printf("Unable to load %s (run from the project directory)\n", FAKE_CAMERA_IMAGE);
+        return 1;
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_rfc_4648_vectors);
+    RUN_TEST(test_decoded_max_length_fits_unpadded_input);
+    RUN_TEST(test_round_trip_random_data);
+    RUN_TEST(test_print_output_matches_buffer_output);
+    RUN_TEST(test_invalid_input_is_rejected);
+    RUN_TEST(test_random_input_does_not_overrun);
+    RUN_TEST(benchmark_encode);
+    RUN_TEST(benchmark_decode);
+    auto failures = UNITY_END();
+    benchmark_report();
+    return failures;
+}
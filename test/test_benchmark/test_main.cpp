@@ -0,0 +1,256 @@
+// Benchmarks of the request path with frames from the fake camera: request parsing, tools/list, capture calls (through
+// the capture tool of the firmware and through the HTTP server) and deflate (streaming against compressing the whole
+// body at once), per frame size.
+// Run with: pio test -e native -f test_benchmark -v (results are printed as JSON)
+
+#include <unity.h>
+
+#include <base64_codec.h>
+#include <benchmark.h>
+#include <camera_tools.h>
+#include <deflate_stream.h>
+#include <http_client.h>
+#include <http_server.h>
+#include <json_arena.h>
+#include <mcp.h>
+#include <mcp_endpoint.h>
+
+constexpr uint16_t TEST_PORT = 8080;
+// Interval of the grab task: longer than re-encoding a crop of the largest frame size, so consecutive cached captures
+// share a frame
+constexpr unsigned long GRAB_INTERVAL = 5;
+
+// Never destroyed: the server tasks run until the program exits
+static http_server &server = *new http_server(TEST_PORT);
+
+// A capture call as an MCP client sends it, checked against the tool declarations of the firmware
+static const char capture_request[] = R"({"jsonrpc":"2.0","id":17,"method":"tools/call","params":{"name":"capture","arguments":{"flash":"off","frame_size":"VGA","quality":80,"scale":2,"crop":{"x":0,"y":0,"width":320,"height":240}}}})";
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_fake_camera_replays_the_frame_size()
+{
+    auto sensor = esp_camera_sensor_get();
+    for (const auto &size : benchmark_frame_sizes)
+    {
+        sensor->set_framesize(sensor, size.frame_size);
+        auto fb = esp_camera_fb_get();
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_EQUAL(resolution[size.frame_size].width, fb->width);
+        TEST_ASSERT_EQUAL(resolution[size.frame_size].height, fb->height);
+        TEST_ASSERT_EQUAL_UINT8(0xff, fb->buf[0]);
+        TEST_ASSERT_EQUAL_UINT8(0xd8, fb->buf[1]);
+        esp_camera_fb_return(fb);
+    }
+
+    sensor->set_framesize(sensor, FRAMESIZE_UXGA);
+    TEST_ASSERT_EQUAL(0, fake_camera::outstanding());
+}
+
+// The JPEG the fake camera replays for the frame size. Only used before the grab task is started
+static std::vector<uint8_t> replayed_frame(const benchmark_frame_size &size)
+{
+    auto sensor = esp_camera_sensor_get();
+    sensor->set_framesize(sensor, size.frame_size);
+    auto frame = benchmark_frame(SIZE_MAX);
+    sensor->set_framesize(sensor, FRAMESIZE_UXGA);
+    return frame;
+}
+
+static void test_start()
+{
+    TEST_ASSERT_TRUE(camera_sensor.begin());
+    TEST_ASSERT_TRUE(frames.begin(GRAB_INTERVAL, tskNO_AFFINITY));
+    server.on("/", mcp_endpoint);
+    TEST_ASSERT_TRUE(server.begin(2, tskNO_AFFINITY));
+}
+
+static void benchmark_request_parse()
+{
+    json_arena arena(16384, MALLOC_CAP_8BIT);
+    auto parse = [&](ArduinoJson::Allocator *allocator)
+    {
+        mcp_message message(capture_request, sizeof(capture_request) - 1, allocator);
+        auto request = message[0];
+        TEST_ASSERT_EQUAL_STRING("tools/call", request.method().c_str());
+    };
+
+    auto heap = benchmark_run("request_parse", "heap", [&]()
+                              { parse(json_heap_allocator()); });
+    heap.bytes_in = sizeof(capture_request) - 1;
+    benchmark_record(heap);
+
+    auto arena_result = benchmark_run("request_parse", "arena", [&]()
+                                      { parse(&arena);
+                                        arena.reset(); });
+    arena_result.bytes_in = sizeof(capture_request) - 1;
+    arena_result.peak_bytes = arena.high_water_mark();
+    benchmark_record(arena_result);
+}
+
+static void benchmark_tools_list()
+{
+    for (auto deflated : {false, true})
+    {
+        if (deflated && !tools_list_result.can_deflate())
+            continue;
+
+        counting_print output;
+        auto result = benchmark_run("tools_list", deflated ? "deflated" : "plain", [&]()
+                                    { output.count = 0;
+                                      tools_list_result.write_to(output, "17", deflated); });
+        TEST_ASSERT_EQUAL(tools_list_result.length("17", deflated), output.count);
+        result.bytes_out = output.count;
+        benchmark_record(result);
+    }
+}
+
+// Arguments of the capture calls per frame size: the frame as taken, and the center quarter scaled by 2 (decoded and
+// re-encoded), for a new frame every time and shared through the capture cache while the frame is not older than max_age
+static std::vector<std::pair<std::string, String>> capture_arguments(const benchmark_frame_size &size)
+{
+    auto width = resolution[size.frame_size].width;
+    auto height = resolution[size.frame_size].height;
+    auto frame_size = "\"frame_size\":\"" + String(size.name) + "\"";
+    auto crop = frame_size + ",\"scale\":2,\"crop\":{\"x\":" + String(width / 4) + ",\"y\":" + String(height / 4) + ",\"width\":" + String(width / 2) + ",\"height\":" + String(height / 2) + "}";
+    return {{size.name, "{" + frame_size + "}"},
+            {std::string(size.name) + " crop", "{" + crop + ",\"max_age\":0}"},
+            {std::string(size.name) + " crop cached", "{" + crop + ",\"max_age\":60000}"}};
+}
+
+// The capture tool as the MCP endpoint calls it: parsing the request, the capture (from the grab task) and writing the
+// response with the base64 encoded image
+static void benchmark_capture()
+{
+    for (const auto &size : benchmark_frame_sizes)
+        for (const auto &arguments : capture_arguments(size))
+        {
+            auto body = mcp_capture_request(17, arguments.second);
+            auto call = [&](Print &output)
+            {
+                mcp_message message(body.c_str(), body.length());
+                auto request = message[0];
+                mcp_response response;
+                response.set_id(request.id());
+                handle_tools_call(request, response);
+                TEST_ASSERT_EQUAL(200, response.http_code());
+                auto length = response.length();
+                TEST_ASSERT_EQUAL(length, response.write_to(output));
+            };
+
+            string_print text;
+            call(text);
+            TEST_ASSERT_TRUE_MESSAGE(text.data.find("\"type\":\"image\"") != std::string::npos, arguments.first.c_str());
+            if (arguments.first == size.name)
+            {
+                auto dimensions = "base64 encoded, " + std::to_string(resolution[size.frame_size].width) + "x" + std::to_string(resolution[size.frame_size].height);
+                TEST_ASSERT_TRUE_MESSAGE(text.data.find(dimensions) != std::string::npos, arguments.first.c_str());
+            }
+
+            counting_print output;
+            auto result = benchmark_run("capture", arguments.first, [&]()
+                                        { output.count = 0;
+                                          call(output); });
+            result.bytes_in = body.length();
+            result.bytes_out = output.count;
+            benchmark_record(result);
+        }
+}
+
+// Capture calls through the HTTP server (a connection per request), timed by the wall clock as the work is done by the
+// HTTP worker
+static void benchmark_capture_http()
+{
+    for (const auto &size : benchmark_frame_sizes)
+    {
+        auto arguments = capture_arguments(size);
+        const auto &full_frame = arguments.front();
+        auto request = http_post("/", mcp_capture_request(17, full_frame.second));
+        size_t received_length = 0;
+        auto result = benchmark_run("capture_http", full_frame.first, [&]()
+                                    { auto client = WiFiServer::connect(TEST_PORT);
+                                      client.peer_send(request);
+                                      auto received = http_receive(client, 1, 5000);
+                                      TEST_ASSERT_TRUE(received.startsWith("HTTP/1.1 200 OK\r\n"));
+                                      TEST_ASSERT_TRUE(received.indexOf("\"type\":\"image\"") > 0);
+                                      received_length = received.length();
+                                      client.stop(); }, 10, 200, benchmark_wall_time);
+        result.bytes_in = request.length();
+        result.bytes_out = received_length;
+        benchmark_record(result);
+    }
+}
+
+static void benchmark_deflate()
+{
+    for (const auto &size : benchmark_frame_sizes)
+    {
+        auto frame = replayed_frame(size);
+        counting_print output;
+        size_t bytes_in = 0;
+        auto result = benchmark_run("deflate", size.name, [&]()
+                                    { output.count = 0;
+                                      deflate_stream compressed(output, content_encoding::deflate);
+                                      TEST_ASSERT_TRUE(compressed.begin());
+                                      base64_encode(frame.data(), frame.size(), compressed);
+                                      TEST_ASSERT_TRUE(compressed.end());
+                                      bytes_in = compressed.bytes_in(); });
+        result.bytes_in = bytes_in;
+        result.bytes_out = output.count;
+        result.peak_bytes = sizeof(tdefl_compressor);
+        benchmark_record(result);
+    }
+}
+
+// The alternative to streaming: the whole body (the base64 text) built in memory and compressed at once with
+// mz_compress2 into a buffer of mz_compressBound bytes. The peak memory is computed, not measured: the body, the output
+// buffer and the compressor (allocated by mz_compress2), against the compressor alone when streaming
+static void benchmark_deflate_whole_body()
+{
+    for (const auto &size : benchmark_frame_sizes)
+    {
+        auto frame = replayed_frame(size);
+        auto body_length = base64_encoded_length(frame.size());
+        auto bound = mz_compressBound(body_length);
+        mz_ulong compressed_length = 0;
+        auto result = benchmark_run("deflate_whole_body", size.name, [&]()
+                                    { auto body = static_cast<uint8_t *>(malloc(body_length));
+                                      auto compressed = static_cast<uint8_t *>(malloc(bound));
+                                      TEST_ASSERT_NOT_NULL(body);
+                                      TEST_ASSERT_NOT_NULL(compressed);
+                                      base64_encode(frame.data(), frame.size(), reinterpret_cast<char *>(body));
+                                      compressed_length = bound;
+                                      TEST_ASSERT_EQUAL(MZ_OK, mz_compress2(compressed, &compressed_length, body, body_length, MZ_DEFAULT_LEVEL));
+                                      free(compressed);
+                                      free(body); });
+        result.bytes_in = body_length;
+        result.bytes_out = compressed_length;
+        result.peak_bytes = body_length + bound + sizeof(tdefl_compressor);
+        benchmark_record(result);
+    }
+}
+
+int main()
+{
+    if (!benchmark_load_frames())
+        return 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fake_camera_replays_the_frame_size);
+    RUN_TEST(benchmark_request_parse);
+    RUN_TEST(benchmark_tools_list);
+    RUN_TEST(benchmark_deflate);
+    RUN_TEST(benchmark_deflate_whole_body);
+    RUN_TEST(test_start);
+    RUN_TEST(benchmark_capture);
+    RUN_TEST(benchmark_capture_http);
+    auto failures = UNITY_END();
+    benchmark_report();
+    return failures;
+}
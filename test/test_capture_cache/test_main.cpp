@@ -0,0 +1,181 @@
+// Sharing, size limit and eviction of the capture cache
+
+#include <unity.h>
+
+#include <base64_codec.h>
+#include <capture_cache.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Capture of length bytes, counting the calls
+static capture_cache::producer make(size_t length, bool encode, int &calls)
+{
+    return [length, encode, &calls]()
+    {
+        calls++;
+        auto capture = std::make_shared<cached_capture>();
+        auto data = static_cast<uint8_t *>(malloc(length));
+        memset(data, 'x', length);
+        capture->image = std::make_shared<const jpeg_image>(data, length, 16, 16, 0);
+        capture->encode = encode;
+        return capture;
+    };
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_requests_for_the_same_frame_share_the_capture()
+{
+    capture_cache cache(1000, 1000);
+    int calls = 0;
+    bool hit;
+    auto first = cache.get(1, "a", make(30, true, calls), hit);
+    TEST_ASSERT_FALSE(hit);
+    auto second = cache.get(1, "a", make(30, true, calls), hit);
+    TEST_ASSERT_TRUE(hit);
+    TEST_ASSERT_TRUE(first == second);
+    TEST_ASSERT_EQUAL(1, calls);
+
+    // Other parameters or frame: made again
+    cache.get(1, "b", make(30, true, calls), hit);
+    TEST_ASSERT_FALSE(hit);
+    TEST_ASSERT_EQUAL(2, calls);
+}
+
+static void test_encoding_is_made_once_and_counted()
+{
+    capture_cache cache(1000, 1000);
+    int calls = 0;
+    bool hit;
+    auto capture = cache.get(1, "a", make(30, true, calls), hit);
+    TEST_ASSERT_EQUAL(30 + base64_encoded_length(30), cache.status().bytes);
+    auto encoded = capture->base64();
+    TEST_ASSERT_NOT_NULL(encoded);
+    TEST_ASSERT_EQUAL(0, strncmp("eHh4", encoded, 4));
+    TEST_ASSERT_TRUE(encoded == capture->base64());
+}
+
+static void test_hash_is_made_on_first_use()
+{
+    // A 64x64 JPEG from the encoder
+    std::vector<uint8_t> pixels(64 * 64 * 2, 0x5a);
+    uint8_t *jpeg;
+    size_t length;
+    TEST_ASSERT_TRUE(fmt2jpg(pixels.data(), pixels.size(), 64, 64, PIXFORMAT_RGB565, 12, &jpeg, &length));
+    auto capture = std::make_shared<cached_capture>();
+    capture->image = std::make_shared<const jpeg_image>(jpeg, length, 64, 64, 0);
+
+    uint64_t expected, hash = 0;
+    TEST_ASSERT_TRUE(average_hash(jpeg, length, 64, 64, expected));
+    TEST_ASSERT_TRUE(capture->hash(hash));
+    TEST_ASSERT_TRUE(expected == hash);
+    hash = 0;
+    TEST_ASSERT_TRUE(capture->hash(hash));
+    TEST_ASSERT_TRUE(expected == hash);
+
+    // Not a JPEG
+    capture_cache cache(1000, 1000);
+    int calls = 0;
+    bool hit;
+    TEST_ASSERT_FALSE(cache.get(1, "a", make(30, false, calls), hit)->hash(hash));
+}
+
+static void test_captures_that_do_not_fit_are_not_kept()
+{
+    capture_cache cache(100, 1000);
+    int calls = 0;
+    bool hit;
+    // 60 bytes and 80 characters of base64
+    auto capture = cache.get(1, "a", make(60, true, calls), hit);
+    TEST_ASSERT_NOT_NULL(capture.get());
+    TEST_ASSERT_EQUAL(0, cache.status().entries);
+    TEST_ASSERT_EQUAL(0, cache.status().bytes);
+
+    // Without encoding it fits
+    cache.get(1, "b", make(60, false, calls), hit);
+    TEST_ASSERT_EQUAL(1, cache.status().entries);
+    TEST_ASSERT_EQUAL(60, cache.status().bytes);
+}
+
+static void test_put_evicts_older_frames_and_the_oldest_captures()
+{
+    capture_cache cache(100, 1000);
+    int calls = 0;
+    bool hit;
+    cache.get(1, "a", make(40, false, calls), hit);
+    cache.get(1, "b", make(40, false, calls), hit);
+    TEST_ASSERT_EQUAL(2, cache.status().entries);
+
+    // A newer frame: the captures of frame 1 are never requested again
+    cache.get(2, "a", make(10, false, calls), hit);
+    TEST_ASSERT_EQUAL(1, cache.status().entries);
+    TEST_ASSERT_EQUAL(10, cache.status().bytes);
+
+    cache.get(2, "b", make(50, false, calls), hit);
+    cache.get(2, "c", make(50, false, calls), hit);
+    TEST_ASSERT_EQUAL(2, cache.status().entries);
+    TEST_ASSERT_EQUAL(100, cache.status().bytes);
+}
+
+static void test_expired_captures_are_made_again()
+{
+    capture_cache cache(1000, 20);
+    int calls = 0;
+    bool hit;
+    cache.get(1, "a", make(10, false, calls), hit);
+    delay(40);
+    cache.get(1, "a", make(10, false, calls), hit);
+    TEST_ASSERT_FALSE(hit);
+    TEST_ASSERT_EQUAL(2, calls);
+    TEST_ASSERT_EQUAL(1, cache.status().entries);
+    TEST_ASSERT_EQUAL(10, cache.status().bytes);
+}
+
+static void test_concurrent_requests_wait_for_the_capture()
+{
+    capture_cache cache(1000, 1000);
+    std::atomic<int> calls(0);
+    auto slow = [&calls]()
+    {
+        calls++;
+        delay(50);
+        auto capture = std::make_shared<cached_capture>();
+        capture->image = std::make_shared<const jpeg_image>(static_cast<uint8_t *>(malloc(10)), 10, 16, 16, 0);
+        return capture;
+    };
+
+    cached_capture_ptr captures[4];
+    std::vector<std::thread> threads;
+    for (auto &capture : captures)
+        threads.emplace_back([&cache, &capture, slow]()
+                             { bool hit;
+                               capture = cache.get(1, "a", slow, hit); });
+
+    for (auto &thread : threads)
+        thread.join();
+
+    TEST_ASSERT_EQUAL(1, calls.load());
+    for (const auto &capture : captures)
+        TEST_ASSERT_TRUE(capture == captures[0]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_requests_for_the_same_frame_share_the_capture);
+    RUN_TEST(test_encoding_is_made_once_and_counted);
+    RUN_TEST(test_hash_is_made_on_first_use);
+    RUN_TEST(test_captures_that_do_not_fit_are_not_kept);
+    RUN_TEST(test_put_evicts_older_frames_and_the_oldest_captures);
+    RUN_TEST(test_expired_captures_are_made_again);
+    RUN_TEST(test_concurrent_requests_wait_for_the_capture);
+    return UNITY_END();
+}
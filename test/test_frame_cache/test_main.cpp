@@ -0,0 +1,85 @@
+// Frame cache with the grab task running against the fake camera
+
+#include <unity.h>
+
+#include <benchmark.h>
+#include <frame_cache.h>
+
+// Never destroyed: the grab task runs until the program exits
+static frame_cache &cache = *new frame_cache();
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_get_waits_for_the_first_frame()
+{
+    TEST_ASSERT_TRUE(cache.begin(10, tskNO_AFFINITY));
+    auto latest = cache.get(1000, 1000);
+    TEST_ASSERT_NOT_NULL(latest.get());
+    TEST_ASSERT_EQUAL(1200, latest->fb->width);
+    TEST_ASSERT_EQUAL(1200, latest->fb->height);
+    TEST_ASSERT_GREATER_OR_EQUAL(latest->sequence, cache.sequence());
+}
+
+static void test_next_returns_a_newer_frame()
+{
+    auto first = cache.get(1000, 1000);
+    TEST_ASSERT_NOT_NULL(first.get());
+    auto second = cache.next(first->sequence + 1, 1000);
+    TEST_ASSERT_NOT_NULL(second.get());
+    TEST_ASSERT_GREATER_THAN(first->sequence, second->sequence);
+    TEST_ASSERT_TRUE(first->fb != second->fb);
+}
+
+static void test_zero_max_age_waits_for_a_new_frame()
+{
+    auto latest = cache.get(1000, 1000);
+    TEST_ASSERT_NOT_NULL(latest.get());
+    auto fresh = cache.get(0, 1000);
+    TEST_ASSERT_NOT_NULL(fresh.get());
+    TEST_ASSERT_GREATER_THAN(latest->sequence, fresh->sequence);
+}
+
+static void test_next_times_out()
+{
+    auto start = millis();
+    TEST_ASSERT_NULL(cache.next(cache.sequence() + 1000, 50).get());
+    TEST_ASSERT_GREATER_OR_EQUAL(50, millis() - start);
+}
+
+static void test_frames_are_returned_to_the_driver()
+{
+    {
+        auto held = cache.get(1000, 1000);
+        TEST_ASSERT_NOT_NULL(held.get());
+        // The grab task moves on; the held frame stays valid
+        TEST_ASSERT_NOT_NULL(cache.next(held->sequence + 3, 1000).get());
+        TEST_ASSERT_EQUAL_UINT8(0xff, held->fb->buf[0]);
+        TEST_ASSERT_EQUAL_UINT8(0xd8, held->fb->buf[1]);
+    }
+
+    // Only the latest frame of the cache is outstanding (and the one being grabbed)
+    TEST_ASSERT_LESS_OR_EQUAL(2, fake_camera::outstanding());
+}
+
+int main()
+{
+    if (!fake_camera::load(FAKE_CAMERA_IMAGE))
+    {
+        printf("Unable to load %s (run from the project directory)\n", FAKE_CAMERA_IMAGE);
+        return 1;
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_get_waits_for_the_first_frame);
+    RUN_TEST(test_next_returns_a_newer_frame);
+    RUN_TEST(test_zero_max_age_waits_for_a_new_frame);
+    RUN_TEST(test_next_times_out);
+    RUN_TEST(test_frames_are_returned_to_the_driver);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+// Ring buffer of the frame history: frames must stay intact until they are evicted
+
+#include <unity.h>
+
+#include <frame_history.h>
+
+// Never destroyed: the history task runs until the program exits
+static frame_history &history = *new frame_history();
+
+// Frame of length bytes, all set to value
+static void add_frame(size_t length, uint8_t value)
+{
+    std::vector<uint8_t> data(length, value);
+    frame image(fake_camera::frame_buffer(data.data(), data.size(), 16, 16));
+    history.add(image);
+}
+
+// Checks that every stored frame still holds its own bytes and returns the lengths, oldest first
+static std::vector<size_t> stored_lengths()
+{
+    std::vector<size_t> lengths;
+    for (const auto &stored : history.around(millis(), 100))
+    {
+        auto value = stored.image->data[0];
+        for (size_t i = 0; i < stored.image->length; i++)
+            TEST_ASSERT_EQUAL_UINT8(value, stored.image->data[i]);
+
+        lengths.push_back(stored.image->length);
+    }
+
+    return lengths;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_frames_fill_the_buffer()
+{
+    // No source: the history task stores nothing, the tests add the frames
+    TEST_ASSERT_TRUE(history.begin([]()
+                                   { return frame_ptr(); },
+                                   100, 4, 1000, tskNO_AFFINITY));
+    add_frame(10, 1);
+    add_frame(70, 2);
+    add_frame(15, 3);
+    TEST_ASSERT_TRUE((std::vector<size_t>{10, 70, 15}) == stored_lengths());
+    TEST_ASSERT_EQUAL(95, history.status().bytes);
+}
+
+static void test_wrap_around_evicts_the_overlapped_frames()
+{
+    // Does not fit at the end: stored at 0, evicting the frames of 10 and 70 bytes
+    add_frame(25, 4);
+    TEST_ASSERT_TRUE((std::vector<size_t>{15, 25}) == stored_lengths());
+}
+
+static void test_wrap_around_evicts_the_frames_behind_the_head()
+{
+    // Wraps again: the frame at 0 must be evicted although the oldest frame (at 80) does not overlap
+    add_frame(78, 5);
+    TEST_ASSERT_TRUE((std::vector<size_t>{78}) == stored_lengths());
+    TEST_ASSERT_EQUAL(78, history.status().bytes);
+}
+
+static void test_frame_count_is_limited()
+{
+    for (uint8_t i = 0; i < 10; i++)
+        add_frame(5, 10 + i);
+
+    // The frame of 78 bytes overlaps the first frames; at most 4 frames are kept
+    auto lengths = stored_lengths();
+    TEST_ASSERT_EQUAL(4, lengths.size());
+    TEST_ASSERT_EQUAL(4, history.status().frames);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_fill_the_buffer);
+    RUN_TEST(test_wrap_around_evicts_the_overlapped_frames);
+    RUN_TEST(test_wrap_around_evicts_the_frames_behind_the_head);
+    RUN_TEST(test_frame_count_is_limited);
+    return UNITY_END();
+}
@@ -0,0 +1,202 @@
+// HTTP server over the in-memory connections of the WiFi stubs, and a load test of the worker pool with concurrent MCP
+// capture calls (results are printed as JSON)
+
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <benchmark.h>
+#include <camera_tools.h>
+#include <http_client.h>
+#include <http_server.h>
+#include <mcp_endpoint.h>
+
+constexpr uint16_t TEST_PORT = 8080;
+// Workers of the server, as in the firmware
+constexpr size_t TEST_WORKERS = 2;
+// Capture calls per client of the load test
+constexpr auto LOAD_REQUESTS = 25;
+// Interval of the grab task that provides the frames of the capture calls
+constexpr unsigned long GRAB_INTERVAL = 10;
+
+// Never destroyed: the server tasks run until the program exits
+static http_server &server = *new http_server(TEST_PORT);
+
+static String request(const String &data, size_t responses = 1)
+{
+    auto client = WiFiServer::connect(TEST_PORT);
+    client.peer_send(data);
+    return http_receive(client, responses);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_start()
+{
+    server.on("/echo", [](http_request &request, http_response &response)
+              { response.send(200, "text/plain", reinterpret_cast<const uint8_t *>(request.body()), request.body_length()); });
+    server.on("/empty", [](http_request &, http_response &) {});
+    server.on("/gzip", [](http_request &request, http_response &response)
+              { response.send(200, "text/plain", request.accepts_encoding("gzip") ? "yes" : "no"); });
+    server.on("/", mcp_endpoint);
+    server.keep_alive(1000, 10);
+    TEST_ASSERT_TRUE(server.begin(TEST_WORKERS, tskNO_AFFINITY));
+    TEST_ASSERT_TRUE(camera_sensor.begin());
+    TEST_ASSERT_TRUE(frames.begin(GRAB_INTERVAL, tskNO_AFFINITY));
+}
+
+static void test_body_is_read_with_the_content_length()
+{
+    auto response = request("POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello");
+    TEST_ASSERT_TRUE(response.startsWith("HTTP/1.1 200 OK\r\n"));
+    TEST_ASSERT_TRUE(response.endsWith("\r\n\r\nhello"));
+}
+
+static void test_invalid_content_length_is_rejected()
+{
+    const char *const values[] = {"5x", "-1", "+5", "0x10", "", "18446744073709551621", "99999999999999999999999"};
+    for (auto value : values)
+    {
+        auto response = request(String("POST /echo HTTP/1.1\r\nContent-Length: ") + value + "\r\n\r\nhello");
+        TEST_ASSERT_TRUE_MESSAGE(response.startsWith("HTTP/1.1 400 Bad Request\r\n"), value);
+    }
+}
+
+static void test_conflicting_content_lengths_are_rejected()
+{
+    auto response = request("POST /echo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 3\r\n\r\nhello");
+    TEST_ASSERT_TRUE(response.startsWith("HTTP/1.1 400 Bad Request\r\n"));
+}
+
+static void test_pipelined_requests_are_answered_in_order()
+{
+    auto response = request("POST /echo HTTP/1.1\r\nContent-Length: 3\r\n\r\noneGET /empty HTTP/1.1\r\n\r\nPOST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nthree", 3);
+    auto first = response.indexOf("\r\n\r\none");
+    auto second = response.indexOf("HTTP/1.1 204");
+    auto third = response.indexOf("\r\n\r\nthree");
+    TEST_ASSERT_TRUE(first > 0);
+    TEST_ASSERT_TRUE(second > first);
+    TEST_ASSERT_TRUE(third > second);
+}
+
+static void test_no_content_has_no_length()
+{
+    auto response = request("GET /empty HTTP/1.1\r\n\r\n");
+    TEST_ASSERT_TRUE(response.startsWith("HTTP/1.1 204 No Content\r\n"));
+    TEST_ASSERT_TRUE(response.indexOf("Content-Length") < 0);
+    TEST_ASSERT_TRUE(response.indexOf("Transfer-Encoding") < 0);
+    TEST_ASSERT_TRUE(response.indexOf("Connection: keep-alive") > 0);
+}
+
+static void test_accept_encoding_weights()
+{
+    const struct
+    {
+        const char *header;
+        bool accepted;
+    } cases[] = {
+        {"gzip", true},
+        {"GZIP", true},
+        {"deflate, gzip;q=0.5", true},
+        {"gzip;q=0", false},
+        {"gzip; q=0.000", false},
+        {"x-gzip", false},
+        {"deflate", false},
+        {"*", true},
+        {"gzip;q=0, *", false},
+        {"deflate, *;q=0", false}};
+
+    for (const auto &test : cases)
+    {
+        auto response = request(String("GET /gzip HTTP/1.1\r\nAccept-Encoding: ") + test.header + "\r\n\r\n");
+        TEST_ASSERT_TRUE_MESSAGE(response.endsWith(test.accepted ? "\r\n\r\nyes" : "\r\n\r\nno"), test.header);
+    }
+}
+
+// Sends LOAD_REQUESTS requests one after the other, each on a new connection, and stores their latencies. Returns the
+// number of requests not answered with an image
+static int load_client(const String &request, uint64_t *latencies, size_t &received_length)
+{
+    auto failures = 0;
+    for (auto i = 0; i < LOAD_REQUESTS; i++)
+    {
+        auto sent = benchmark_wall_time();
+        auto client = WiFiServer::connect(TEST_PORT);
+        client.peer_send(request);
+        auto response = http_receive(client, 1, 5000);
+        latencies[i] = benchmark_wall_time() - sent;
+        client.stop();
+        if (!response.startsWith("HTTP/1.1 200 OK\r\n") || response.indexOf("\"type\":\"image\"") < 0)
+            failures++;
+
+        received_length = response.length();
+    }
+
+    return failures;
+}
+
+// Clients send capture calls (VGA frames of the grab task, base64 encoded) at the same time. More clients than
+// connection slots wait in the backlog of the listener. The requests per second and the 99th percentile of the
+// latency are recorded per number of clients
+static void benchmark_concurrent_captures()
+{
+    auto body = http_post("/", mcp_capture_request(1, "{\"frame_size\":\"VGA\"}"));
+    // The first capture changes the frame size and waits for a frame with it
+    auto warm_up = WiFiServer::connect(TEST_PORT);
+    warm_up.peer_send(body);
+    TEST_ASSERT_TRUE(http_receive(warm_up, 1, 5000).startsWith("HTTP/1.1 200 OK\r\n"));
+    warm_up.stop();
+
+    for (auto clients : {4, 8, 16})
+    {
+        std::vector<uint64_t> latencies(clients * LOAD_REQUESTS);
+        std::vector<size_t> received_lengths(clients);
+        std::atomic<int> failures(0);
+        std::vector<std::thread> threads;
+        auto start = benchmark_wall_time();
+        for (auto i = 0; i < clients; i++)
+            threads.emplace_back([&, i]()
+                                 { failures += load_client(body, &latencies[i * LOAD_REQUESTS], received_lengths[i]); });
+
+        for (auto &thread : threads)
+            thread.join();
+
+        auto elapsed = benchmark_wall_time() - start;
+        TEST_ASSERT_EQUAL(0, failures.load());
+
+        // Nearest rank
+        std::sort(latencies.begin(), latencies.end());
+        auto p99 = latencies[(latencies.size() * 99 + 99) / 100 - 1];
+        benchmark_result result = {"http_capture_load", std::to_string(clients) + " clients", static_cast<uint32_t>(latencies.size()),
+                                   static_cast<double>(elapsed) / latencies.size(), body.length(), received_lengths[0], 0, static_cast<double>(p99)};
+        benchmark_record(result);
+    }
+}
+
+int main()
+{
+    if (!benchmark_load_frames())
+        return 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_start);
+    RUN_TEST(test_body_is_read_with_the_content_length);
+    RUN_TEST(test_invalid_content_length_is_rejected);
+    RUN_TEST(test_conflicting_content_lengths_are_rejected);
+    RUN_TEST(test_pipelined_requests_are_answered_in_order);
+    RUN_TEST(test_no_content_has_no_length);
+    RUN_TEST(test_accept_encoding_weights);
+    RUN_TEST(benchmark_concurrent_captures);
+    auto failures = UNITY_END();
+    benchmark_report();
+    return failures;
+}
@@ -0,0 +1,122 @@
+// JSON arena: bump allocation, overflow to the heap, mark and rewind, and responses reused with their arena
+
+#include <unity.h>
+
+#include <esp_heap_caps.h>
+#include <json_arena.h>
+#include <mcp.h>
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+// The last allocation in the block is given back when freed
+static bool frees_in_place(json_arena &arena, void *pointer)
+{
+    auto before = arena.mark();
+    arena.deallocate(pointer);
+    return arena.mark() < before;
+}
+
+static void test_allocations_are_consecutive()
+{
+    json_arena arena(1024, MALLOC_CAP_8BIT);
+    auto first = static_cast<uint8_t *>(arena.allocate(10));
+    auto second = static_cast<uint8_t *>(arena.allocate(10));
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_TRUE(second > first);
+    TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(second) % 8);
+    TEST_ASSERT_TRUE(frees_in_place(arena, second));
+    TEST_ASSERT_EQUAL(0, arena.overflows());
+}
+
+static void test_full_block_overflows_to_the_heap()
+{
+    json_arena arena(64, MALLOC_CAP_8BIT);
+    auto large = arena.allocate(100);
+    TEST_ASSERT_NOT_NULL(large);
+    TEST_ASSERT_EQUAL(1, arena.overflows());
+    TEST_ASSERT_EQUAL(0, arena.mark());
+    arena.deallocate(large);
+}
+
+static void test_rewind_releases_the_allocations_after_the_mark()
+{
+    json_arena arena(1024, MALLOC_CAP_8BIT);
+    arena.allocate(100);
+    auto mark = arena.mark();
+    auto first = arena.allocate(200);
+    arena.allocate(300);
+    TEST_ASSERT_GREATER_THAN(mark, arena.mark());
+
+    arena.rewind(mark);
+    TEST_ASSERT_EQUAL(mark, arena.mark());
+    // The same bytes are used again
+    TEST_ASSERT_TRUE(arena.allocate(200) == first);
+    TEST_ASSERT_EQUAL(0, arena.overflows());
+}
+
+static void test_rewinding_in_a_loop_does_not_fill_the_block()
+{
+    // Without rewinding, 100 iterations of 400 bytes would overflow the 1 KB block
+    json_arena arena(1024, MALLOC_CAP_8BIT);
+    auto mark = arena.mark();
+    for (auto i = 0; i < 100; i++)
+    {
+        arena.rewind(mark);
+        arena.allocate(400);
+    }
+
+    TEST_ASSERT_EQUAL(0, arena.overflows());
+    TEST_ASSERT_LESS_OR_EQUAL(512, arena.high_water_mark());
+}
+
+static void test_rewind_ahead_of_the_mark_is_ignored()
+{
+    json_arena arena(1024, MALLOC_CAP_8BIT);
+    arena.allocate(10);
+    auto used = arena.mark();
+    arena.rewind(used + 100);
+    TEST_ASSERT_EQUAL(used, arena.mark());
+}
+
+static void test_reset_response_rewinds_its_arena()
+{
+    json_arena arena(4096, MALLOC_CAP_8BIT);
+    // Below the mark of the response: must survive its resets
+    auto before = static_cast<uint8_t *>(arena.allocate(16));
+    memset(before, 0x5a, 16);
+
+    mcp_response response(&arena);
+    size_t used = 0;
+    for (auto i = 0; i < 100; i++)
+    {
+        response.reset();
+        response.create_result()["text"] = String("the same text every time");
+        if (i == 0)
+            used = arena.mark();
+
+        TEST_ASSERT_EQUAL(used, arena.mark());
+    }
+
+    TEST_ASSERT_EQUAL(0, arena.overflows());
+    for (auto i = 0; i < 16; i++)
+        TEST_ASSERT_EQUAL_UINT8(0x5a, before[i]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_consecutive);
+    RUN_TEST(test_full_block_overflows_to_the_heap);
+    RUN_TEST(test_rewind_releases_the_allocations_after_the_mark);
+    RUN_TEST(test_rewinding_in_a_loop_does_not_fill_the_block);
+    RUN_TEST(test_rewind_ahead_of_the_mark_is_ignored);
+    RUN_TEST(test_reset_response_rewinds_its_arena);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+// JSON-RPC batches: mixed valid, invalid and notification entries, ids of the error responses, tools/list from the
+// precomputed result (also compressed, with an id longer than a stored deflate block), and arenas that are reused for
+// every request of a long batch
+
+#include <unity.h>
+
+#include <benchmark.h>
+#include <mcp_batch.h>
+
+#include <atomic>
+#include <string>
+
+// Never destroyed: the worker tasks run until the program exits
+static work_queue &handlers = *new work_queue();
+
+static mcp_cached_result tools_list([](JsonObject result)
+                                    { result["tools"].to<JsonArray>().add<JsonObject>()["name"] = "echo"; });
+
+static std::atomic<int> handled(0);
+
+// tools/call of "echo" returns the text argument, "fail" throws; other methods are not found
+static void handle(const mcp_request &request, mcp_response &response)
+{
+    handled++;
+    if (request.method() != "tools/call")
+    {
+        auto error = response.create_error();
+        error["code"] = error_code::method_not_found;
+        error["message"] = "Method not found";
+        return;
+    }
+
+    String name = request.params()["name"] | "";
+    if (name == "fail")
+        throw mcp_exception(error_code::invalid_params, "Failed");
+
+    response.create_result()["text"] = request.params()["arguments"]["text"] | "";
+}
+
+static mcp_batch batch(handle, handlers, &tools_list);
+
+// Writes the batch and parses the output into document. Returns the number of responses
+static size_t write(const char *json, JsonDocument &document, bool &begun, json_arena *first = nullptr, json_arena *second = nullptr)
+{
+    mcp_message message(json, strlen(json));
+    string_print output;
+    begun = false;
+    auto count = batch.write(message, first, second, output, [&]()
+                             { begun = true; });
+    if (count > 0)
+        TEST_ASSERT_FALSE(deserializeJson(document, output.data.c_str()));
+    else
+        TEST_ASSERT_EQUAL(0, output.data.length());
+
+    return count;
+}
+
+// True if the response has an id that is null (and not just no id)
+static bool has_null_id(JsonVariant response)
+{
+    String json;
+    serializeJson(response, json);
+    return json.indexOf("\"id\":null") >= 0;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_mixed_batch()
+{
+    const char *json = R"([
+        {"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"echo","arguments":{"text":"one"}}},
+        42,
+        {"jsonrpc":"2.0","method":"notifications/initialized"},
+        {"jsonrpc":"2.0","id":"list","method":"tools/list"},
+        {"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"fail"}},
+        {"jsonrpc":"2.0","id":4,"method":"unknown"}
+    ])";
+
+    JsonDocument document;
+    bool begun;
+    TEST_ASSERT_EQUAL(5, write(json, document, begun));
+    TEST_ASSERT_TRUE(begun);
+    auto responses = document.as<JsonArray>();
+    TEST_ASSERT_EQUAL(5, responses.size());
+
+    TEST_ASSERT_EQUAL(1, responses[0]["id"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("one", responses[0]["result"]["text"].as<const char *>());
+
+    // Not a request object: invalid request, id null
+    TEST_ASSERT_TRUE(has_null_id(responses[1]));
+    TEST_ASSERT_EQUAL(error_code::invalid_request, responses[1]["error"]["code"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("2.0", responses[1]["jsonrpc"].as<const char *>());
+
+    // The notification is not answered; tools/list is the precomputed result with the id spliced in
+    TEST_ASSERT_EQUAL_STRING("list", responses[2]["id"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("echo", responses[2]["result"]["tools"][0]["name"].as<const char *>());
+
+    TEST_ASSERT_EQUAL(3, responses[3]["id"].as<int>());
+    TEST_ASSERT_EQUAL(error_code::invalid_params, responses[3]["error"]["code"].as<int>());
+    TEST_ASSERT_EQUAL(4, responses[4]["id"].as<int>());
+    TEST_ASSERT_EQUAL(error_code::method_not_found, responses[4]["error"]["code"].as<int>());
+}
+
+static void test_invalid_entries_only()
+{
+    JsonDocument document;
+    bool begun;
+    TEST_ASSERT_EQUAL(3, write(R"([1, "text", null])", document, begun));
+    for (auto response : document.as<JsonArray>())
+    {
+        TEST_ASSERT_TRUE(has_null_id(response));
+        TEST_ASSERT_EQUAL(error_code::invalid_request, response["error"]["code"].as<int>());
+    }
+}
+
+static void test_notifications_only_are_not_answered()
+{
+    JsonDocument document;
+    bool begun;
+    handled = 0;
+    TEST_ASSERT_EQUAL(0, write(R"([{"jsonrpc":"2.0","method":"notifications/initialized"},{"jsonrpc":"2.0","method":"tools/call","params":{"name":"echo"}}])", document, begun));
+    TEST_ASSERT_FALSE(begun);
+    // Notifications are handled all the same
+    TEST_ASSERT_EQUAL(2, handled.load());
+}
+
+static void test_pipelined_on_the_work_queue()
+{
+    TEST_ASSERT_TRUE(handlers.begin(1, tskNO_AFFINITY, 2));
+    test_mixed_batch();
+}
+
+static void test_long_batch_reuses_the_arenas()
+{
+    std::string json = "[";
+    for (auto i = 0; i < 200; i++)
+        json += std::string(i ? "," : "") + R"({"jsonrpc":"2.0","id":)" + std::to_string(i) + R"(,"method":"tools/call","params":{"name":"echo","arguments":{"text":"some text to answer"}}})";
+
+    json += "]";
+
+    // Without rewinding, 200 responses would not fit in 4 KB
+    json_arena first(4096, MALLOC_CAP_8BIT), second(4096, MALLOC_CAP_8BIT);
+    JsonDocument document;
+    bool begun;
+    TEST_ASSERT_EQUAL(200, write(json.c_str(), document, begun, &first, &second));
+    TEST_ASSERT_EQUAL(0, first.overflows());
+    TEST_ASSERT_EQUAL(0, second.overflows());
+
+    auto responses = document.as<JsonArray>();
+    for (auto i = 0; i < 200; i++)
+    {
+        TEST_ASSERT_EQUAL(i, responses[i]["id"].as<int>());
+        TEST_ASSERT_EQUAL_STRING("some text to answer", responses[i]["result"]["text"].as<const char *>());
+    }
+}
+
+// The prefix with the id is written as stored blocks, which hold at most 65535 bytes each
+static void test_deflated_result_with_a_long_id()
+{
+    if (!tools_list.can_deflate())
+        TEST_IGNORE_MESSAGE("Compression not available");
+
+    auto id = "\"" + String(std::string(70000, 'x').c_str()) + "\"";
+    string_print output;
+    TEST_ASSERT_EQUAL(tools_list.length(id, true), tools_list.write_to(output, id, true));
+    TEST_ASSERT_EQUAL(tools_list.length(id, true), output.data.length());
+
+    // zlib header, then stored blocks with the prefix
+    auto prefix = "{\"jsonrpc\":\"2.0\",\"id\":" + std::string(id.c_str()) + ",\"result\":";
+    std::string stored;
+    size_t position = 2;
+    auto blocks = 0;
+    while (stored.length() < prefix.length())
+    {
+        auto data = reinterpret_cast<const uint8_t *>(output.data.data()) + position;
+        uint16_t length = data[1] | data[2] << 8;
+        uint16_t complement = data[3] | data[4] << 8;
+        TEST_ASSERT_EQUAL_UINT8(0, data[0]);
+        TEST_ASSERT_EQUAL_UINT16(static_cast<uint16_t>(~length), complement);
+        stored.append(output.data, position + 5, length);
+        position += 5 + length;
+        blocks++;
+    }
+
+    TEST_ASSERT_TRUE(stored == prefix);
+    TEST_ASSERT_EQUAL(2, blocks);
+    // Final stored block with the suffix before the checksum
+    TEST_ASSERT_TRUE(output.data.compare(output.data.length() - 10, 6, std::string("\x01\x01\x00\xfe\xff}", 6)) == 0);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    // Without started workers the requests are handled by the caller
+    RUN_TEST(test_mixed_batch);
+    RUN_TEST(test_invalid_entries_only);
+    RUN_TEST(test_notifications_only_are_not_answered);
+    RUN_TEST(test_pipelined_on_the_work_queue);
+    RUN_TEST(test_long_batch_reuses_the_arenas);
+    RUN_TEST(test_deflated_result_with_a_long_id);
+    return UNITY_END();
+}
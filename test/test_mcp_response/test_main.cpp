@@ -0,0 +1,191 @@
+// Responses with attachments: the streamed output is byte for byte the JSON of the same response with the base64
+// text in the document, for any data length, pre-encoded data and several attachments
+
+#include <unity.h>
+
+#include <benchmark.h>
+#include <mcp.h>
+
+#include <string>
+
+static std::vector<uint8_t> frame;
+
+// Bytes 0, 1, 2, ... (length 0 to 3 cover every padding)
+static std::vector<uint8_t> data_of(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++)
+        data[i] = static_cast<uint8_t>(i * 7 + 3);
+
+    return data;
+}
+
+static std::string encode(const std::vector<uint8_t> &data)
+{
+    std::string encoded(base64_encoded_length(data.size()), '\0');
+    base64_encode(data.data(), data.size(), &encoded[0]);
+    return encoded;
+}
+
+// The image content of a capture response; data is set by add
+template <typename Add>
+static void build(JsonObject result, Add add)
+{
+    auto content = result["content"].to<JsonArray>();
+    auto text = content.add<JsonObject>();
+    text["type"] = "text";
+    text["text"] = "Captured";
+    auto image = content.add<JsonObject>();
+    image["type"] = "image";
+    add(image);
+    image["mimeType"] = "image/jpeg";
+}
+
+// serializeJson of the response with the encoding in the document
+static std::string expected_json(const std::vector<uint8_t> &data)
+{
+    JsonDocument document;
+    document["jsonrpc"] = "2.0";
+    document["id"] = 7;
+    auto encoded = encode(data);
+    build(document["result"].to<JsonObject>(), [&](JsonObject image)
+          { image["data"] = encoded.c_str(); });
+    std::string json;
+    serializeJson(document, json);
+    return json;
+}
+
+static void set_id(mcp_response &response, int id)
+{
+    JsonDocument document;
+    auto variant = document.to<JsonVariant>();
+    variant.set(id);
+    response.set_id(variant);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_streamed_response_is_identical()
+{
+    for (auto length : {0, 1, 2, 3, 4, 5, 767, 768, 769, 1000, 4096})
+    {
+        auto data = data_of(length);
+        auto expected = expected_json(data);
+
+        auto released = 0;
+        string_print output;
+        {
+            mcp_response response;
+            set_id(response, 7);
+            build(response.create_result(), [&](JsonObject image)
+                  { response.attach_base64(image, "data", data.data(), data.size(), [&]()
+                                           { released++; }); });
+            TEST_ASSERT_EQUAL(expected.size(), response.length());
+            TEST_ASSERT_EQUAL(encode(data).size(), response.attachments_length());
+            TEST_ASSERT_EQUAL(expected.size(), response.write_to(output));
+            // Released once the data is written, not again when destroyed
+            TEST_ASSERT_EQUAL(1, released);
+        }
+
+        TEST_ASSERT_EQUAL(1, released);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), output.data.c_str());
+    }
+}
+
+static void test_camera_frame_is_identical()
+{
+    auto expected = expected_json(frame);
+    mcp_response response;
+    set_id(response, 7);
+    build(response.create_result(), [&](JsonObject image)
+          { response.attach_base64(image, "data", frame.data(), frame.size()); });
+    string_print output;
+    TEST_ASSERT_EQUAL(expected.size(), response.write_to(output));
+    TEST_ASSERT_TRUE(expected == output.data);
+}
+
+static void test_pre_encoded_attachment_is_identical()
+{
+    auto data = data_of(1000);
+    auto encoded = encode(data);
+    auto expected = expected_json(data);
+
+    mcp_response response;
+    set_id(response, 7);
+    build(response.create_result(), [&](JsonObject image)
+          { response.attach_base64(image, "data", data.data(), data.size(), encoded.c_str(), nullptr); });
+    string_print output;
+    TEST_ASSERT_EQUAL(expected.size(), response.length());
+    response.write_to(output);
+    TEST_ASSERT_TRUE(expected == output.data);
+}
+
+static void test_several_attachments_keep_their_order()
+{
+    auto first = data_of(10);
+    auto second = data_of(20);
+
+    JsonDocument document;
+    document["jsonrpc"] = "2.0";
+    document["id"] = 7;
+    auto result = document["result"].to<JsonObject>();
+    auto first_encoded = encode(first), second_encoded = encode(second);
+    result["a"] = first_encoded.c_str();
+    result["b"] = second_encoded.c_str();
+    std::string expected;
+    serializeJson(document, expected);
+
+    mcp_response response;
+    set_id(response, 7);
+    auto streamed = response.create_result();
+    response.attach_base64(streamed, "a", first.data(), first.size());
+    response.attach_base64(streamed, "b", second.data(), second.size());
+    string_print output;
+    TEST_ASSERT_EQUAL(expected.size(), response.length());
+    response.write_to(output);
+    TEST_ASSERT_TRUE(expected == output.data);
+}
+
+static void test_binary_attachments_follow_the_json()
+{
+    auto data = data_of(100);
+    mcp_response response;
+    set_id(response, 7);
+    build(response.create_result(), [&](JsonObject image)
+          { response.attach_base64(image, "data", data.data(), data.size()); });
+
+    string_print output;
+    std::vector<std::vector<uint8_t>> binaries;
+    response.write_to(output, [&](const uint8_t *binary, size_t length)
+                      { binaries.emplace_back(binary, binary + length); });
+
+    JsonDocument parsed;
+    TEST_ASSERT_FALSE(deserializeJson(parsed, output.data.c_str()));
+    TEST_ASSERT_EQUAL_STRING("binary:0", parsed["result"]["content"][1]["data"].as<const char *>());
+    TEST_ASSERT_EQUAL(1, binaries.size());
+    TEST_ASSERT_TRUE(binaries[0] == data);
+}
+
+int main()
+{
+    if (!fake_camera::load(FAKE_CAMERA_IMAGE))
+    {
+        printf("Unable to load %s (run from the project directory)\n", FAKE_CAMERA_IMAGE);
+        return 1;
+    }
+
+    frame = benchmark_frame(SIZE_MAX);
+    UNITY_BEGIN();
+    RUN_TEST(test_streamed_response_is_identical);
+    RUN_TEST(test_camera_frame_is_identical);
+    RUN_TEST(test_pre_encoded_attachment_is_identical);
+    RUN_TEST(test_several_attachments_keep_their_order);
+    RUN_TEST(test_binary_attachments_follow_the_json);
+    return UNITY_END();
+}
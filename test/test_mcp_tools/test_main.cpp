@@ -0,0 +1,183 @@
+// Tool registry: lookup and dispatch, argument validation against the declarations and the generated schemas
+
+#include <unity.h>
+
+#include <mcp_tools.h>
+
+constexpr const char *mode_values[] = {"fast", "slow", nullptr};
+
+constexpr mcp_param area_params[] = {
+    mcp_integer("width", "Width", 1, 100, mcp_unset, true),
+    mcp_integer("height", "Height", 1, 100)};
+
+constexpr mcp_param shape_params[] = {
+    mcp_string("mode", "Mode", mode_values, "fast"),
+    mcp_integer("count", "Count", 0, 10, 1),
+    mcp_number("ratio", "Ratio", 0, 1),
+    mcp_boolean("enabled", "Enabled"),
+    mcp_object("area", "Area", area_params),
+    mcp_string("label", "Label", nullptr, nullptr, true)};
+
+static const char *last_called = nullptr;
+
+static void alpha(JsonObject, mcp_response &response)
+{
+    last_called = "alpha";
+    response.create_result()["tool"] = "alpha";
+}
+
+static void shape(JsonObject arguments, mcp_response &response)
+{
+    last_called = "shape";
+    response.create_result()["label"] = arguments["label"].as<const char *>();
+}
+
+static void zulu(JsonObject, mcp_response &)
+{
+    last_called = "zulu";
+}
+
+constexpr mcp_tool tools[] = {
+    mcp_define_tool("alpha", "First", alpha),
+    mcp_define_tool("shape", "All parameter types", shape, shape_params),
+    mcp_define_tool("zulu", "Last", zulu)};
+
+static_assert(mcp_sorted(tools), "The tools must be sorted by name");
+
+constexpr mcp_tool unsorted[] = {
+    mcp_define_tool("zulu", "Last", zulu),
+    mcp_define_tool("alpha", "First", alpha)};
+
+static_assert(!mcp_sorted(unsorted), "Unsorted tools are detected");
+
+static const mcp_tool_registry registry(tools);
+
+// Calls the tool with the JSON arguments. Returns the error code of the mcp_exception (0 if none)
+static int call(const char *name, const char *arguments)
+{
+    JsonDocument document;
+    TEST_ASSERT_FALSE(deserializeJson(document, arguments));
+    mcp_response response;
+    last_called = nullptr;
+    try
+    {
+        registry.call(name, document.as<JsonObject>(), response);
+    }
+    catch (const mcp_exception &e)
+    {
+        TEST_ASSERT_NULL(last_called);
+        return e.code();
+    }
+
+    return 0;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_find_uses_the_sorted_table()
+{
+    TEST_ASSERT_EQUAL_STRING("alpha", registry.find("alpha")->name);
+    TEST_ASSERT_EQUAL_STRING("shape", registry.find("shape")->name);
+    TEST_ASSERT_EQUAL_STRING("zulu", registry.find("zulu")->name);
+    TEST_ASSERT_NULL(registry.find("beta"));
+    TEST_ASSERT_NULL(registry.find(""));
+}
+
+static void test_call_dispatches_to_the_handler()
+{
+    TEST_ASSERT_EQUAL(0, call("alpha", "{}"));
+    TEST_ASSERT_EQUAL_STRING("alpha", last_called);
+    TEST_ASSERT_EQUAL(0, call("zulu", "{}"));
+    TEST_ASSERT_EQUAL_STRING("zulu", last_called);
+    TEST_ASSERT_EQUAL(0, call("shape", R"({"label":"x"})"));
+    TEST_ASSERT_EQUAL_STRING("shape", last_called);
+}
+
+static void test_unknown_or_missing_tool()
+{
+    TEST_ASSERT_EQUAL(error_code::method_not_found, call("beta", "{}"));
+    TEST_ASSERT_EQUAL(error_code::invalid_request, call("", "{}"));
+    TEST_ASSERT_EQUAL(error_code::invalid_request, call(nullptr, "{}"));
+}
+
+static void test_valid_arguments()
+{
+    TEST_ASSERT_EQUAL(0, call("shape", R"({"label":"x","mode":"slow","count":10,"ratio":0.5,"enabled":true,"area":{"width":3}})"));
+    // Integers are numbers as well
+    TEST_ASSERT_EQUAL(0, call("shape", R"({"label":"x","ratio":1})"));
+    // No arguments object at all is the same as an empty one
+    TEST_ASSERT_EQUAL(0, call("alpha", "null"));
+}
+
+static void test_invalid_arguments()
+{
+    // additionalProperties: false
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("alpha", R"({"extra":1})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","area":{"width":3,"depth":1}})"));
+    // Required
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", "{}"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","area":{"height":3}})"));
+    // Types
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":1})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","count":1.5})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","count":"1"})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","enabled":1})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","area":[]})"));
+    // Enum and ranges
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","mode":"medium"})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","count":11})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","count":-1})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","ratio":1.01})"));
+    TEST_ASSERT_EQUAL(error_code::invalid_params, call("shape", R"({"label":"x","area":{"width":0}})"));
+}
+
+static void test_schema_is_generated_from_the_declaration()
+{
+    JsonDocument document;
+    registry.build_list(document.to<JsonObject>());
+    auto list = document["tools"].as<JsonArray>();
+    TEST_ASSERT_EQUAL(3, list.size());
+    TEST_ASSERT_EQUAL_STRING("alpha", list[0]["name"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("First", list[0]["description"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("object", list[0]["inputSchema"]["type"].as<const char *>());
+    TEST_ASSERT_FALSE(list[0]["inputSchema"]["additionalProperties"].as<bool>());
+    TEST_ASSERT_TRUE(list[0]["inputSchema"]["required"].isNull());
+
+    JsonObject schema = list[1]["inputSchema"];
+    JsonObject properties = schema["properties"];
+    TEST_ASSERT_EQUAL_STRING("string", properties["mode"]["type"].as<const char *>());
+    TEST_ASSERT_EQUAL(2, properties["mode"]["enum"].size());
+    TEST_ASSERT_EQUAL_STRING("slow", properties["mode"]["enum"][1].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("fast", properties["mode"]["default"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("integer", properties["count"]["type"].as<const char *>());
+    TEST_ASSERT_EQUAL(0, properties["count"]["minimum"].as<int>());
+    TEST_ASSERT_EQUAL(10, properties["count"]["maximum"].as<int>());
+    TEST_ASSERT_EQUAL(1, properties["count"]["default"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("number", properties["ratio"]["type"].as<const char *>());
+    TEST_ASSERT_TRUE(properties["ratio"]["default"].isNull());
+    TEST_ASSERT_EQUAL_STRING("boolean", properties["enabled"]["type"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("object", properties["area"]["type"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("integer", properties["area"]["properties"]["width"]["type"].as<const char *>());
+    TEST_ASSERT_EQUAL_STRING("width", properties["area"]["required"][0].as<const char *>());
+    TEST_ASSERT_FALSE(properties["area"]["additionalProperties"].as<bool>());
+    TEST_ASSERT_EQUAL(1, schema["required"].size());
+    TEST_ASSERT_EQUAL_STRING("label", schema["required"][0].as<const char *>());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_uses_the_sorted_table);
+    RUN_TEST(test_call_dispatches_to_the_handler);
+    RUN_TEST(test_unknown_or_missing_tool);
+    RUN_TEST(test_valid_arguments);
+    RUN_TEST(test_invalid_arguments);
+    RUN_TEST(test_schema_is_generated_from_the_declaration);
+    return UNITY_END();
+}
@@ -0,0 +1,221 @@
+// Motion kernels against straightforward reference implementations, with random data and edge cases
+
+#include <unity.h>
+
+#include <benchmark.h>
+#include <esp_random.h>
+#include <motion_kernels.h>
+
+#include <string>
+#include <vector>
+
+// One byte at a time
+static uint32_t reference_sad(const uint8_t *a, const uint8_t *b, size_t length)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+    return sum;
+}
+
+// Pixel by pixel, each block summed on its own
+static void reference_block_sad(const uint8_t *image, const uint8_t *background, uint16_t width, uint16_t height, uint8_t block, uint32_t *sums)
+{
+    for (auto row = 0; row < height / block; row++)
+        for (auto column = 0; column < width / block; column++)
+        {
+            uint32_t sum = 0;
+            for (auto y = row * block; y < (row + 1) * block; y++)
+                for (auto x = column * block; x < (column + 1) * block; x++)
+                    sum += reference_sad(image + y * width + x, background + y * width + x, 1);
+
+            sums[row * (width / block) + column] = sum;
+        }
+}
+
+static std::vector<uint8_t> random_data(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (auto &byte : data)
+        byte = esp_random();
+
+    return data;
+}
+
+// Resolutions of the analysis (the frame sizes decoded at 1/8 scale)
+struct motion_resolution
+{
+    const char *name;
+    uint16_t width;
+    uint16_t height;
+};
+
+static const motion_resolution motion_resolutions[] = {
+    {"QVGA", 40, 30},
+    {"VGA", 80, 60},
+    {"SVGA", 100, 75},
+    {"UXGA", 200, 150}};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_sad_matches_reference_for_all_lengths()
+{
+    // Around the 4 byte words and the flush of the lane sums every 128 words
+    for (size_t length = 0; length < 1100; length++)
+    {
+        auto a = random_data(length);
+        auto b = random_data(length);
+        TEST_ASSERT_EQUAL_UINT32(reference_sad(a.data(), b.data(), length), sad_u8(a.data(), b.data(), length));
+    }
+}
+
+static void test_sad_extremes()
+{
+    // Largest difference in every lane, in both directions: the lane sums must not overflow or borrow
+    for (auto length : {4, 512, 513, 4096, 30000})
+    {
+        std::vector<uint8_t> zeros(length, 0), ones(length, 255), alternating(length);
+        for (size_t i = 0; i < alternating.size(); i++)
+            alternating[i] = i % 2 ? 255 : 0;
+
+        TEST_ASSERT_EQUAL_UINT32(255u * length, sad_u8(zeros.data(), ones.data(), length));
+        TEST_ASSERT_EQUAL_UINT32(255u * length, sad_u8(ones.data(), zeros.data(), length));
+        TEST_ASSERT_EQUAL_UINT32(0, sad_u8(ones.data(), ones.data(), length));
+        TEST_ASSERT_EQUAL_UINT32(reference_sad(alternating.data(), ones.data(), length), sad_u8(alternating.data(), ones.data(), length));
+        TEST_ASSERT_EQUAL_UINT32(reference_sad(zeros.data(), alternating.data(), length), sad_u8(zeros.data(), alternating.data(), length));
+    }
+
+    // Differences of one around the lane boundaries
+    const uint8_t a[] = {0, 1, 254, 255, 128, 127, 1, 0};
+    const uint8_t b[] = {1, 0, 255, 254, 127, 128, 0, 1};
+    TEST_ASSERT_EQUAL_UINT32(8, sad_u8(a, b, sizeof(a)));
+}
+
+static void test_sad_unaligned()
+{
+    // The rows of the blocks start at any offset
+    auto a = random_data(1000);
+    auto b = random_data(1000);
+    for (size_t offset = 0; offset < 8; offset++)
+        for (size_t other = 0; other < 8; other++)
+            TEST_ASSERT_EQUAL_UINT32(reference_sad(a.data() + offset, b.data() + other, 900), sad_u8(a.data() + offset, b.data() + other, 900));
+}
+
+static void test_block_sad_matches_reference()
+{
+    // Sizes that are not a multiple of the block leave partial blocks at the right and bottom edges
+    const uint16_t sizes[][2] = {{8, 8}, {40, 30}, {100, 75}, {203, 151}};
+    for (const auto &size : sizes)
+        for (uint8_t block : {4, 8, 16})
+        {
+            auto width = size[0], height = size[1];
+            auto image = random_data(width * height);
+            auto background = random_data(width * height);
+            size_t blocks = (width / block) * (height / block);
+            std::vector<uint32_t> sums(blocks + 1, 0xdeadbeef), expected(blocks);
+            block_sad(image.data(), background.data(), width, height, block, sums.data());
+            reference_block_sad(image.data(), background.data(), width, height, block, expected.data());
+            for (size_t i = 0; i < blocks; i++)
+                TEST_ASSERT_EQUAL_UINT32(expected[i], sums[i]);
+
+            // Nothing written past the blocks
+            TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, sums[blocks]);
+        }
+}
+
+static void test_gray_conversion()
+{
+    // Big endian RGB565: black, white, red, green, blue. Y = (77 R + 150 G + 29 B) / 256 of the expanded channels
+    const uint8_t rgb565[] = {0x00, 0x00, 0xff, 0xff, 0xf8, 0x00, 0x07, 0xe0, 0x00, 0x1f};
+    uint8_t gray[5];
+    rgb565_to_gray(rgb565, gray, 5);
+    TEST_ASSERT_EQUAL_UINT8(0, gray[0]);
+    TEST_ASSERT_EQUAL_UINT8(250, gray[1]);
+    TEST_ASSERT_EQUAL_UINT8(74, gray[2]);
+    TEST_ASSERT_EQUAL_UINT8(147, gray[3]);
+    TEST_ASSERT_EQUAL_UINT8(28, gray[4]);
+}
+
+static void test_background_converges()
+{
+    // The background follows a constant image to within 2^shift - 1 (rounded, so it reaches it from both sides)
+    const size_t pixels = 256;
+    std::vector<uint8_t> image(pixels), background(pixels);
+    std::vector<uint16_t> average(pixels);
+    for (size_t i = 0; i < pixels; i++)
+    {
+        image[i] = i;
+        average[i] = (255 - i) << 8;
+    }
+
+    for (auto frame = 0; frame < 200; frame++)
+        update_background(image.data(), average.data(), background.data(), pixels, 4);
+
+    for (size_t i = 0; i < pixels; i++)
+        TEST_ASSERT_UINT8_WITHIN(1, image[i], background[i]);
+}
+
+static void benchmark_sad()
+{
+    for (const auto &resolution : motion_resolutions)
+    {
+        size_t pixels = resolution.width * resolution.height;
+        auto image = random_data(pixels);
+        auto background = random_data(pixels);
+        uint32_t sum = 0;
+        auto packed = benchmark_run("motion_sad", std::string(resolution.name) + " packed", [&]()
+                                    { sum = sad_u8(image.data(), background.data(), pixels); });
+        packed.bytes_in = pixels;
+        benchmark_record(packed);
+
+        uint32_t expected = 0;
+        auto reference = benchmark_run("motion_sad", std::string(resolution.name) + " reference", [&]()
+                                       { expected = reference_sad(image.data(), background.data(), pixels); });
+        reference.bytes_in = pixels;
+        benchmark_record(reference);
+        TEST_ASSERT_EQUAL_UINT32(expected, sum);
+    }
+}
+
+static void benchmark_block_sad()
+{
+    for (const auto &resolution : motion_resolutions)
+    {
+        size_t pixels = resolution.width * resolution.height;
+        auto image = random_data(pixels);
+        auto background = random_data(pixels);
+        std::vector<uint32_t> sums((resolution.width / 8) * (resolution.height / 8));
+        auto packed = benchmark_run("motion_block_sad", std::string(resolution.name) + " packed", [&]()
+                                    { block_sad(image.data(), background.data(), resolution.width, resolution.height, 8, sums.data()); });
+        packed.bytes_in = pixels;
+        benchmark_record(packed);
+
+        auto reference = benchmark_run("motion_block_sad", std::string(resolution.name) + " reference", [&]()
+                                       { reference_block_sad(image.data(), background.data(), resolution.width, resolution.height, 8, sums.data()); });
+        reference.bytes_in = pixels;
+        benchmark_record(reference);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sad_matches_reference_for_all_lengths);
+    RUN_TEST(test_sad_extremes);
+    RUN_TEST(test_sad_unaligned);
+    RUN_TEST(test_block_sad_matches_reference);
+    RUN_TEST(test_gray_conversion);
+    RUN_TEST(test_background_converges);
+    RUN_TEST(benchmark_sad);
+    RUN_TEST(benchmark_block_sad);
+    auto failures = UNITY_END();
+    benchmark_report();
+    return failures;
+}
@@ -0,0 +1,274 @@
+// Recorder writing to the RAM file system of the stubs: the structure of the AVI segments (RIFF size, movi list,
+// idx1 entries pointing at complete chunks), reading a frame back (also for dropped frames and in later segments), a
+// file system that runs full while recording, and the throughput of the write queue (results are printed as JSON)
+
+#include <unity.h>
+
+#include <benchmark.h>
+#include <recorder.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+constexpr auto RECORDING_DIRECTORY = "/recordings";
+constexpr auto AVI_HEADER_LENGTH = 224;
+constexpr auto AVI_MOVI_POSITION = 220;
+
+// Never destroyed: the recorder tasks run until the program exits
+static fs::FS &storage = *new fs::FS();
+static recorder &video = *new recorder();
+
+static std::vector<uint8_t> reference;
+
+static frame_ptr camera_frame()
+{
+    auto fb = esp_camera_fb_get();
+    return fb ? std::make_shared<const frame>(fb) : nullptr;
+}
+
+// Frame source of the recorder; only changed while not recording
+static frame_ptr (*source)() = camera_frame;
+
+// Frame source of the frame_at test: call n returns the reference with the byte n appended after the end of the image,
+// except the calls listed in dropped_calls (no frame: the slot is dropped)
+static std::atomic<uint32_t> numbered_calls(0);
+static std::set<uint32_t> dropped_calls;
+
+static frame_ptr numbered_frame()
+{
+    auto call = numbered_calls++;
+    if (dropped_calls.count(call))
+        return nullptr;
+
+    auto data = reference;
+    data.push_back(static_cast<uint8_t>(call));
+    uint16_t width, height;
+    fake_camera::jpeg_size(data.data(), data.size(), width, height);
+    return std::make_shared<const frame>(fake_camera::frame_buffer(data.data(), data.size(), width, height));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static std::vector<uint8_t> read_file(const String &name)
+{
+    auto file = storage.open(String(RECORDING_DIRECTORY) + "/" + name);
+    std::vector<uint8_t> data(file.size());
+    TEST_ASSERT_EQUAL(data.size(), file.read(data.data(), data.size()));
+    return data;
+}
+
+// Checks the structure of a segment and returns the number of frames in its index
+static uint32_t check_avi(const std::vector<uint8_t> &file)
+{
+    TEST_ASSERT_GREATER_OR_EQUAL(AVI_HEADER_LENGTH + 8, file.size());
+    TEST_ASSERT_EQUAL_MEMORY("RIFF", file.data(), 4);
+    TEST_ASSERT_EQUAL_MEMORY("AVI ", file.data() + 8, 4);
+    TEST_ASSERT_EQUAL_MEMORY("movi", file.data() + AVI_MOVI_POSITION, 4);
+
+    // The movi list is followed by idx1; the RIFF chunk ends with it
+    auto movi_length = get32(file.data() + 216);
+    auto index = AVI_MOVI_POSITION + movi_length;
+    TEST_ASSERT_LESS_OR_EQUAL(file.size() - 8, index);
+    TEST_ASSERT_EQUAL_MEMORY("idx1", file.data() + index, 4);
+    auto entries = get32(file.data() + index + 4) / 16;
+    TEST_ASSERT_LESS_OR_EQUAL(file.size(), index + 8 + entries * 16);
+    TEST_ASSERT_EQUAL(index + 8 + entries * 16 - 8, get32(file.data() + 4));
+    // Frames in avih and strh
+    TEST_ASSERT_EQUAL(entries, get32(file.data() + 48));
+    TEST_ASSERT_EQUAL(entries, get32(file.data() + 140));
+
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        auto entry = file.data() + index + 8 + i * 16;
+        TEST_ASSERT_EQUAL_MEMORY("00dc", entry, 4);
+        auto offset = get32(entry + 8);
+        auto length = get32(entry + 12);
+        // A complete chunk inside the movi list
+        TEST_ASSERT_LESS_OR_EQUAL(movi_length, offset + 8 + length);
+        auto chunk = file.data() + AVI_MOVI_POSITION + offset;
+        TEST_ASSERT_EQUAL_MEMORY("00dc", chunk, 4);
+        TEST_ASSERT_EQUAL(length, get32(chunk + 4));
+        TEST_ASSERT_EQUAL(reference.size(), length);
+        TEST_ASSERT_EQUAL_MEMORY(reference.data(), chunk + 8, length);
+    }
+
+    return entries;
+}
+
+// Waits until the queue is written and the headers of all segments are completed (frame count set)
+static void wait_until_written()
+{
+    auto start = millis();
+    while (millis() - start < 5000)
+    {
+        auto complete = video.status().queued == 0;
+        for (const auto &file : video.list())
+            if (complete)
+            {
+                auto data = read_file(file.name);
+                complete = data.size() >= AVI_HEADER_LENGTH && get32(data.data() + 48) > 0;
+            }
+
+        if (complete)
+            return;
+
+        delay(20);
+    }
+
+    TEST_FAIL_MESSAGE("Recording not written");
+}
+
+static void remove_recordings()
+{
+    for (const auto &file : video.list())
+        storage.remove(String(RECORDING_DIRECTORY) + "/" + file.name);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    remove_recordings();
+    storage.set_capacity(SIZE_MAX);
+}
+
+static void test_segments_are_valid_avi_files()
+{
+    TEST_ASSERT_TRUE(video.begin(storage, RECORDING_DIRECTORY, []()
+                                 { return source(); }, tskNO_AFFINITY));
+    TEST_ASSERT_TRUE(video.start(20, 4));
+    delay(300);
+    video.stop();
+    wait_until_written();
+
+    auto files = video.list();
+    TEST_ASSERT_GREATER_OR_EQUAL(2, files.size());
+    uint32_t frames = 0;
+    for (const auto &file : files)
+    {
+        auto data = read_file(file.name);
+        auto entries = check_avi(data);
+        TEST_ASSERT_LESS_OR_EQUAL(4, entries);
+        // Nothing after the index: the RIFF size is the file size - 8
+        TEST_ASSERT_EQUAL(data.size() - 8, get32(data.data() + 4));
+        frames += entries;
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(4, frames);
+
+    auto image = video.frame_at(files[0].name, 0);
+    TEST_ASSERT_NOT_NULL(image.get());
+    TEST_ASSERT_EQUAL(reference.size(), image->length);
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), image->data, image->length);
+}
+
+static void test_full_file_system_keeps_the_segment_valid()
+{
+    // Room for the header, two frames and half of the third
+    auto chunk = 8 + reference.size() + (reference.size() & 1);
+    storage.set_capacity(storage.used() + AVI_HEADER_LENGTH + 2 * chunk + chunk / 2);
+    TEST_ASSERT_TRUE(video.start(20, 8));
+    delay(300);
+    video.stop();
+    wait_until_written();
+
+    auto files = video.list();
+    TEST_ASSERT_EQUAL(1, files.size());
+    auto data = read_file(files[0].name);
+    // The partial third frame is not in the movi list; the index repeats the frames written for the slots that failed
+    TEST_ASSERT_GREATER_OR_EQUAL(2, check_avi(data));
+    TEST_ASSERT_EQUAL(4 + 2 * chunk, get32(data.data() + 216));
+    TEST_ASSERT_EQUAL(2, video.status().frames);
+
+    auto image = video.frame_at(files[0].name, 1);
+    TEST_ASSERT_NOT_NULL(image.get());
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), image->data, image->length);
+}
+
+// Frames are sampled every 50 ms into segments of 4 slots. Slots 2 and 3 (end of the first segment), 5 and 8 (start of
+// the third segment) have no frame. The frame at a time is the frame of its slot, the previous frame of the segment for
+// a dropped slot, and the next frame for dropped slots at the start of a segment; later segments start at their slot
+static void test_frame_at_follows_the_slots()
+{
+    const uint32_t expected[] = {0, 1, 1, 1, 4, 4, 6, 7, 9, 9, 10, 11};
+    constexpr auto SLOTS = sizeof(expected) / sizeof(expected[0]);
+    constexpr auto INTERVAL = 50;
+    constexpr auto SEGMENT_FRAMES = 4;
+    numbered_calls = 0;
+    dropped_calls = {2, 3, 5, 8};
+    source = numbered_frame;
+    TEST_ASSERT_TRUE(video.start(INTERVAL, SEGMENT_FRAMES));
+    while (numbered_calls < SLOTS)
+        delay(10);
+
+    video.stop();
+    wait_until_written();
+
+    auto files = video.list();
+    TEST_ASSERT_GREATER_OR_EQUAL(SLOTS / SEGMENT_FRAMES, files.size());
+    for (uint32_t slot = 0; slot < SLOTS; slot++)
+    {
+        // In the middle of the slot
+        auto seconds = (slot % SEGMENT_FRAMES + 0.5f) * INTERVAL / 1000;
+        auto image = video.frame_at(files[slot / SEGMENT_FRAMES].name, seconds);
+        TEST_ASSERT_NOT_NULL(image.get());
+        TEST_ASSERT_EQUAL(reference.size() + 1, image->length);
+        TEST_ASSERT_EQUAL_MESSAGE(expected[slot], image->data[image->length - 1], ("slot " + std::to_string(slot)).c_str());
+    }
+
+    source = camera_frame;
+    TEST_ASSERT_EQUAL(dropped_calls.size(), video.status().dropped);
+}
+
+// Records WRITE_FRAMES frames of the camera through the write queue, sampled every 5 ms, and checks that the writer
+// keeps up: at least half of the sampling rate, with the bytes of every frame chunk written
+static void benchmark_write_queue()
+{
+    constexpr auto INTERVAL = 5;
+    constexpr auto WRITE_FRAMES = 100;
+    TEST_ASSERT_TRUE(video.start(INTERVAL, 50));
+    auto start = benchmark_wall_time();
+    while (video.status().frames < WRITE_FRAMES && benchmark_wall_time() - start < 10000000000ULL)
+        delay(1);
+
+    auto elapsed = benchmark_wall_time() - start;
+    auto status = video.status();
+    video.stop();
+    wait_until_written();
+
+    auto frames_per_s = status.frames * 1e9 / elapsed;
+    auto bytes_per_s = status.bytes * 1e9 / elapsed;
+    auto chunk = 8 + reference.size() + (reference.size() & 1);
+    TEST_ASSERT_GREATER_OR_EQUAL(WRITE_FRAMES, status.frames);
+    TEST_ASSERT_EQUAL(status.frames * chunk, status.bytes);
+    TEST_ASSERT_TRUE_MESSAGE(frames_per_s >= 1000.0 / INTERVAL / 2, ("frames/s " + std::to_string(frames_per_s)).c_str());
+    TEST_ASSERT_TRUE_MESSAGE(bytes_per_s >= chunk * 1000.0 / INTERVAL / 2, ("bytes/s " + std::to_string(bytes_per_s)).c_str());
+
+    benchmark_result result = {"recorder_write", std::to_string(INTERVAL) + " ms interval", status.frames, static_cast<double>(elapsed) / status.frames, chunk, 0, 0, 0};
+    benchmark_record(result);
+}
+
+int main()
+{
+    if (!fake_camera::load(FAKE_CAMERA_IMAGE))
+    {
+        printf("Unable to load %s (run from the project directory)\n", FAKE_CAMERA_IMAGE);
+        return 1;
+    }
+
+    reference = benchmark_frame(SIZE_MAX);
+    UNITY_BEGIN();
+    RUN_TEST(test_segments_are_valid_avi_files);
+    RUN_TEST(test_full_file_system_keeps_the_segment_valid);
+    RUN_TEST(test_frame_at_follows_the_slots);
+    RUN_TEST(benchmark_write_queue);
+    auto failures = UNITY_END();
+    benchmark_report();
+    return failures;
+}
@@ -0,0 +1,97 @@
+// Work queue: work runs on the worker tasks while the caller continues, exceptions reach the caller
+
+#include <unity.h>
+
+#include <work_queue.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Never destroyed: the worker tasks run until the program exits
+static work_queue &queue = *new work_queue();
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void test_runs_in_the_caller_when_not_started()
+{
+    work_queue stopped;
+    auto caller = std::this_thread::get_id();
+    std::thread::id runner;
+    stopped.run([&]()
+                { runner = std::this_thread::get_id(); });
+    TEST_ASSERT_TRUE(runner == caller);
+}
+
+static void test_runs_on_a_worker()
+{
+    TEST_ASSERT_TRUE(queue.begin(2, tskNO_AFFINITY, 4));
+    TEST_ASSERT_TRUE(queue.running());
+    auto caller = std::this_thread::get_id();
+    std::thread::id runner;
+    queue.run([&]()
+              { runner = std::this_thread::get_id(); });
+    TEST_ASSERT_TRUE(runner != caller);
+}
+
+static void test_caller_continues_while_the_work_runs()
+{
+    // The work can only finish after the caller did something after submitting it
+    std::atomic<bool> caller_continued(false);
+    std::atomic<bool> finished(false);
+    auto job = queue.submit([&]()
+                            { while (!caller_continued)
+                                  std::this_thread::yield();
+                              finished = true; });
+    TEST_ASSERT_FALSE(finished);
+    caller_continued = true;
+    job->wait();
+    TEST_ASSERT_TRUE(finished);
+}
+
+static void test_jobs_of_several_callers_all_run()
+{
+    std::atomic<int> runs(0);
+    std::vector<work_queue::job_ptr> jobs;
+    for (auto i = 0; i < 32; i++)
+        jobs.push_back(queue.submit([&]()
+                                    { runs++; }));
+
+    for (auto &job : jobs)
+        job->wait();
+
+    TEST_ASSERT_EQUAL(32, runs.load());
+}
+
+static void test_wait_rethrows_the_exception()
+{
+    auto job = queue.submit([]()
+                            { throw std::runtime_error("failed"); });
+    try
+    {
+        job->wait();
+        TEST_FAIL_MESSAGE("No exception");
+    }
+    catch (const std::runtime_error &e)
+    {
+        TEST_ASSERT_EQUAL_STRING("failed", e.what());
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_runs_in_the_caller_when_not_started);
+    RUN_TEST(test_runs_on_a_worker);
+    RUN_TEST(test_caller_continues_while_the_work_runs);
+    RUN_TEST(test_jobs_of_several_callers_all_run);
+    RUN_TEST(test_wait_rethrows_the_exception);
+    return UNITY_END();
+}